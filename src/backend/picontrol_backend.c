@@ -1,110 +1,349 @@
 #include "backend/picontrol_backend.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "backend/picontrol_null.h"
+#include "backend/picontrol_record.h"
 #include "backend/picontrol_uinput.h"
 #include "logging/log_utils.h"
 #include "picontrol_config.h"
+#include "serialize/batch.h"
 #include "serialize/mouse.h"
+#include "util.h"
 
-#ifdef PICTRL_XDO  // TODO: Use an xdo definition directly?
-#include <xdo.h>
-
+#ifdef PICTRL_XDO
 #include "backend/picontrol_xdo.h"
 #endif
 
-static const char *PICTRL_BACKEND_NAMES[] = {"uinput", "xdo"};
+/*
+Every backend this build has. With no name given, the first one that starts
+up wins, so the order is also the order of preference. The null and record
+backends never get picked on their own.
+*/
+static const pictrl_backend_ops *const PICTRL_BACKENDS[] = {
+    &pictrl_uinput_backend_ops,
+#ifdef PICTRL_XDO
+    &pictrl_xdo_backend_ops,
+#endif
+    &pictrl_null_backend_ops,
+    &pictrl_record_backend_ops,
+};
+
+const char *pictrl_backend_name(const pictrl_backend *backend) {
+  return backend->ops->name;
+}
+
+void pictrl_backend_print_names(FILE *stream) {
+  for (size_t i = 0; i < PICTRL_SIZE(PICTRL_BACKENDS); i++) {
+    fprintf(stream, "%s%s", (i == 0) ? "" : ", ", PICTRL_BACKENDS[i]->name);
+  }
+}
+
+static bool start_backend(pictrl_backend *backend,
+                          const pictrl_backend_ops *ops) {
+  backend->impl = ops->new();
+  if (backend->impl == NULL) {
+    pictrl_log_warn("Could not start %s backend\n", ops->name);
+    return false;
+  }
+  backend->ops = ops;
+  return true;
+}
 
-const char *pictrl_backend_name(pictrl_backend_type type) {
-  // TODO: more robust way?
-  return PICTRL_BACKEND_NAMES[type];
+// Backends that don't actually emit anything have to be asked for by name
+static bool is_default_candidate(const pictrl_backend_ops *ops) {
+  return ops != &pictrl_null_backend_ops && ops != &pictrl_record_backend_ops;
 }
 
-pictrl_backend *pictrl_backend_new() {
+// `name` NULL picks the first backend that works (see PICTRL_BACKENDS)
+pictrl_backend *pictrl_backend_new(const char *name) {
   pictrl_backend *new_backend = malloc(sizeof(*new_backend));
-  int init_ret = 0;
-#ifdef PICTRL_XDO
-  new_backend->backend = (pictrl_backend_t *)pictrl_xdo_backend_new();
-  new_backend->type = PICTRL_BACKEND_XDO;
-#else  // default
-  new_backend->backend = (pictrl_backend_t *)pictrl_uinput_backend_new();
-  new_backend->type = PICTRL_BACKEND_UINPUT;
-  init_ret = pictrl_uinput_backend_init(&new_backend->backend->uinput);
-#endif
-  if (new_backend->backend == NULL || init_ret < 0) {
-    free(new_backend);
+  if (new_backend == NULL) {
     return NULL;
   }
+  new_backend->motion = (pictrl_motion_accum){0};
+
+  for (size_t i = 0; i < PICTRL_SIZE(PICTRL_BACKENDS); i++) {
+    const pictrl_backend_ops *ops = PICTRL_BACKENDS[i];
+    if (name == NULL ? !is_default_candidate(ops)
+                     : strcmp(name, ops->name) != 0) {
+      continue;
+    }
+    if (start_backend(new_backend, ops)) {
+      return new_backend;
+    }
+    if (name != NULL) {
+      break;
+    }
+  }
 
-  return new_backend;
+  if (name != NULL) {
+    pictrl_log_error("No usable backend named \"%s\"\n", name);
+  }
+  free(new_backend);
+  return NULL;
 }
 
+static void flush_motion(pictrl_backend *backend);
+
 void pictrl_backend_free(pictrl_backend *backend) {
-#ifdef PICTRL_XDO
-  pictrl_xdo_backend_free(&backend->backend->xdo);
-#else  // default
-  pictrl_uinput_backend_destroy(&backend->backend->uinput);
-  pictrl_uinput_backend_free(&backend->backend->uinput);
-#endif
+  flush_motion(backend);
+  backend->ops->free(backend->impl);
   free(backend);
 }
 
+// Calls `backend->ops->op(impl, ...)`, if the backend has it
+#define CALL_BACKEND(backend, op, ...)                                    \
+  do {                                                                    \
+    if ((backend)->ops->op != NULL) {                                     \
+      (backend)->ops->op((backend)->impl, __VA_ARGS__);                   \
+    } else {                                                              \
+      pictrl_log_stub("%s backend can't " #op "\n", (backend)->ops->name); \
+    }                                                                     \
+  } while (0)
+
+static void flush_motion_at(pictrl_backend *backend, uint64_t now_usec) {
+  pictrl_motion_accum *motion = &backend->motion;
+  if (motion->pending) {
+    // Only whole pixels go out, rounding towards 0 so the sub-pixel part we
+    // hold on to never makes the pointer overshoot either way
+    const PiCtrlMouseCoord coords = {.x = motion->dx / PICTRL_MOUSE_SUBPIXELS,
+                                     .y = motion->dy / PICTRL_MOUSE_SUBPIXELS};
+    const PiCtrlMouseScroll scroll = motion->scroll;
+    const bool abs_pending = motion->abs_pending;
+    motion->dx -= coords.x * PICTRL_MOUSE_SUBPIXELS;
+    motion->dy -= coords.y * PICTRL_MOUSE_SUBPIXELS;
+    motion->scroll = (PiCtrlMouseScroll){0};
+    motion->abs_pending = false;
+    motion->pending = false;
+    if (abs_pending) {
+      CALL_BACKEND(backend, move_mouse_abs, motion->abs);
+    }
+    if (coords.x != 0 || coords.y != 0) {
+      CALL_BACKEND(backend, move_mouse_rel, coords);
+    }
+    if (scroll.vertical != 0 || scroll.horizontal != 0) {
+      CALL_BACKEND(backend, scroll, scroll);
+    }
+  }
+  motion->last_emit_usec = now_usec;
+}
+
+// Anything that isn't a mouse move has to go out after the motion that came
+// before it
+static void flush_motion(pictrl_backend *backend) {
+  if (backend->motion.pending) {
+    flush_motion_at(backend, pictrl_now_usec());
+  }
+}
+
+static int64_t service_motion(pictrl_backend *backend) {
+  pictrl_motion_accum *motion = &backend->motion;
+  if (!motion->pending) {
+    return -1;
+  }
+
+  const uint64_t now = pictrl_now_usec();
+  const uint64_t frame_end = motion->last_emit_usec + PICTRL_MOUSE_FRAME_USEC;
+  if (now >= frame_end) {
+    flush_motion_at(backend, now);
+    return -1;
+  }
+  return (int64_t)(frame_end - now);
+}
+
+/*
+Emits anything that's been held back and is now due: coalesced mouse motion
+whose frame is over, and paced keystrokes. Returns how many microseconds until
+it should be called again, or -1 if nothing is waiting.
+
+Whoever drives the backend (the lws loop, or the pipeline's emitter thread) has
+to call this once the returned time is up, otherwise the tail end of a swipe or
+of a pasted string sits around until the next message comes in.
+*/
+int64_t pictrl_backend_service(pictrl_backend *backend) {
+  // Motion first, so it queues up behind any keystrokes already waiting
+  const int64_t motion_usec = service_motion(backend);
+  if (backend->ops->service == NULL) {
+    return motion_usec;
+  }
+
+  const int64_t backend_usec = backend->ops->service(backend->impl);
+  if (motion_usec < 0 || (backend_usec >= 0 && backend_usec < motion_usec)) {
+    return backend_usec;
+  }
+  return motion_usec;
+}
+
 void handle_mouse_click(pictrl_backend *backend, RawPiCtrlMessage *msg) {
-#ifdef PICTRL_XDO
-  (void)msg;
-  (void)backend;
-  pictrl_log_stub("Not implemented\n");
-#else
+  flush_motion(backend);
   const PiCtrlMouseBtnStatus btn = pictrl_get_mouse_status(msg);
-  picontrol_uinput_click_mouse(&backend->backend->uinput, btn);
-#endif
+  CALL_BACKEND(backend, click_mouse, btn);
+}
+
+/*
+Moves (and scrolls) are summed up and emitted at most once per
+PICTRL_MOUSE_FRAME_USEC: the first one after a quiet period goes out right away
+(so a single nudge has no added lag), and anything following it within the same
+frame is held until the frame ends (see `pictrl_backend_service()`).
+*/
+static void motion_received(pictrl_backend *backend) {
+  pictrl_motion_accum *motion = &backend->motion;
+  motion->pending = true;
+
+  const uint64_t now = pictrl_now_usec();
+  if (!motion->batching &&
+      now - motion->last_emit_usec >= PICTRL_MOUSE_FRAME_USEC) {
+    flush_motion_at(backend, now);
+  }
 }
 
 void handle_mouse_move(pictrl_backend *backend, RawPiCtrlMessage *msg) {
   // extract the relative X and Y mouse locations to move by
   const PiCtrlMouseCoord coords = pictrl_get_mouse_coords(msg);
 
-#ifdef PICTRL_XDO
-  pictrl_log_debug("Moving mouse (%d, %d) relative units using xdo.\n\n",
-                   coords.x, coords.y);
-  if (xdo_move_mouse_relative(&backend->backend->xdo, coords.x, coords.y) !=
-      0) {
-    pictrl_log_warn("Mouse was unable to be moved (%d, %d) relative units.\n",
-                    coords.x, coords.y);
-  }
-#else
-  picontrol_uinput_move_mouse_rel(&backend->backend->uinput, coords);
-#endif
+  backend->motion.dx += coords.x * PICTRL_MOUSE_SUBPIXELS;
+  backend->motion.dy += coords.y * PICTRL_MOUSE_SUBPIXELS;
+  motion_received(backend);
+}
+
+/*
+Same as `handle_mouse_move()`, but in fractions of a pixel. Slow, precise moves
+add up to a pixel at a time instead of getting lost (or rounded up into stairs)
+on the client, and fast ones don't have to be split up into 127 pixel chunks.
+*/
+void handle_mouse_move_hires(pictrl_backend *backend, RawPiCtrlMessage *msg) {
+  if (msg->header.payload_size < PICTRL_MOUSE_MV_HIRES_PAYLOAD_SIZE) {
+    pictrl_log_warn("High resolution mouse payload too small (%d bytes)\n",
+                    msg->header.payload_size);
+    return;
+  }
+  const PiCtrlMouseCoord coords = pictrl_get_mouse_coords_hires(msg);
+
+  backend->motion.dx += coords.x;
+  backend->motion.dy += coords.y;
+  motion_received(backend);
+}
+
+void handle_mouse_scroll(pictrl_backend *backend, RawPiCtrlMessage *msg) {
+  if (msg->header.payload_size < PICTRL_MOUSE_SCROLL_PAYLOAD_SIZE) {
+    pictrl_log_warn("Scroll payload too small (%d bytes)\n",
+                    msg->header.payload_size);
+    return;
+  }
+  const PiCtrlMouseScroll scroll = pictrl_get_mouse_scroll(msg);
+
+  backend->motion.scroll.vertical += scroll.vertical;
+  backend->motion.scroll.horizontal += scroll.horizontal;
+  motion_received(backend);
+}
+
+// A new position makes any relative moves before it (in this frame) moot
+void handle_mouse_abs(pictrl_backend *backend, RawPiCtrlMessage *msg) {
+  if (msg->header.payload_size < PICTRL_MOUSE_ABS_PAYLOAD_SIZE) {
+    pictrl_log_warn("Absolute mouse payload too small (%d bytes)\n",
+                    msg->header.payload_size);
+    return;
+  }
+
+  backend->motion.abs = pictrl_get_mouse_abs(msg);
+  backend->motion.abs_pending = true;
+  backend->motion.dx = 0;
+  backend->motion.dy = 0;
+  motion_received(backend);
 }
 
 void handle_text(pictrl_backend *backend, RawPiCtrlMessage *msg) {
-#ifdef PICTRL_XDO
-  // `xdo_enter_text_window` expects a null-terminated string, there are more
-  // efficient approaches but this works
-  static char text[MAX_BUF];
-  memcpy(text, msg->payload, msg->header.payload_size);
-  text[msg->header.payload_size] = 0;
-
-  xdo_enter_text_window(
-      &backend->backend->xdo, CURRENTWINDOW, text,
-      XDO_KEYSTROKE_DELAY);  // TODO: what if sizeof(char) != sizeof(uint8_t)?
-#else
-  picontrol_uinput_type_char(&backend->backend->uinput, *msg->payload);
-#endif
+  flush_motion(backend);
+  CALL_BACKEND(backend, type_text, msg->payload, msg->header.payload_size);
 }
 
 void handle_keysym(pictrl_backend *backend, RawPiCtrlMessage *msg) {
-#ifdef PICTRL_XDO
-  // `xdo_send_keysequence_window` expects a null-terminated string, there are
-  // more efficient approaches but this works
-  static char keysym[MAX_BUF];
-  memcpy(keysym, msg->payload, msg->header.payload_size);
-  keysym[msg->header.payload_size] = 0;
-
-  xdo_send_keysequence_window(&backend->backend->xdo, CURRENTWINDOW, keysym,
-                              XDO_KEYSTROKE_DELAY);
-#else
-  picontrol_uinput_type_keysym(&backend->backend->uinput, (char *)msg->payload);
-#endif
+  flush_motion(backend);
+  CALL_BACKEND(backend, type_keysym, (const char *)msg->payload,
+               msg->header.payload_size);
+}
+
+// Returns -1 on an unknown command
+static int dispatch_message(pictrl_backend *backend, RawPiCtrlMessage *msg);
+
+/*
+Handles every record in a PI_CTRL_BATCH, in order. Moves (and scrolls) in it
+all get summed up before any of them go out, so a batch of mouse samples
+becomes one event frame (one uinput write) instead of one plus whatever the
+rest of its PICTRL_MOUSE_FRAME_USEC frame coalesces. Anything else in the batch
+still flushes the motion before it, same as always.
+
+Returns -1 if any record was invalid (the rest still get handled).
+*/
+int handle_batch(pictrl_backend *backend, RawPiCtrlMessage *msg) {
+  pictrl_motion_accum *motion = &backend->motion;
+  int ret = 0;
+  motion->batching = true;
+
+  RawPiCtrlMessage record;
+  size_t offset = 0;
+  while (pictrl_batch_next(msg, &offset, &record)) {
+    if (record.header.cmd == PI_CTRL_BATCH) {
+      pictrl_log_error("Batches can't be nested\n");
+      ret = -1;
+      continue;
+    }
+    if (dispatch_message(backend, &record) != 0) {
+      ret = -1;
+    }
+  }
+
+  motion->batching = false;
+  if (motion->pending) {
+    const uint64_t now = pictrl_now_usec();
+    if (now - motion->last_emit_usec >= PICTRL_MOUSE_FRAME_USEC) {
+      flush_motion_at(backend, now);
+    }
+  }
+  return ret;
+}
+
+static int dispatch_message(pictrl_backend *backend, RawPiCtrlMessage *msg) {
+  switch (msg->header.cmd) {
+    case PI_CTRL_MOUSE_MV:
+      handle_mouse_move(backend, msg);
+      break;
+    case PI_CTRL_MOUSE_CLICK:
+      handle_mouse_click(backend, msg);
+      break;
+    case PI_CTRL_TEXT:
+      handle_text(backend, msg);
+      break;
+    case PI_CTRL_KEYSYM:
+      handle_keysym(backend, msg);
+      break;
+    case PI_CTRL_MOUSE_SCROLL:
+      handle_mouse_scroll(backend, msg);
+      break;
+    case PI_CTRL_MOUSE_ABS:
+      handle_mouse_abs(backend, msg);
+      break;
+    case PI_CTRL_MOUSE_MV_HIRES:
+      handle_mouse_move_hires(backend, msg);
+      break;
+    case PI_CTRL_BATCH:
+      return handle_batch(backend, msg);
+    // TODO: On disconnect command, return 0?
+    default:
+      pictrl_log_error("Invalid command: %d.\n", msg->header.cmd);
+      return -1;
+  }
+
+  return 0;
+}
+
+int pictrl_backend_handle_message(pictrl_backend *backend,
+                                  RawPiCtrlMessage *msg) {
+  if (backend->ops->message_received != NULL) {
+    backend->ops->message_received(backend->impl, pictrl_now_usec());
+  }
+  return dispatch_message(backend, msg);
 }
@@ -1,34 +1,52 @@
 #ifndef _PICTRL_BACKEND_H
 #define _PICTRL_BACKEND_H
 
-#include "backend/picontrol_uinput.h"
-#include "data_structures/ring_buffer.h"
-
-#ifdef PICTRL_XDO  // TODO: Use an xdo definition directly?
-#include <xdo.h>
-#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
-typedef enum { PICTRL_BACKEND_UINPUT, PICTRL_BACKEND_XDO } pictrl_backend_type;
+#include "backend/picontrol_backend_ops.h"
+#include "data_structures/ring_buffer.h"
+#include "model/mouse.h"
+#include "model/protocol.h"
 
-typedef union {
-  pictrl_uinput_t uinput;
-#ifdef PICTRL_XDO
-  xdo_t xdo;
-#endif
-} pictrl_backend_t;
+// Relative mouse motion (and scrolling) that has been received, but not emitted
+// yet
+typedef struct {
+  // In 1/PICTRL_MOUSE_SUBPIXELS of a pixel. Whatever's left over after
+  // emitting whole pixels stays here for next time. Relative to `abs` if
+  // `abs_pending`
+  int dx, dy;
+  PiCtrlMouseScroll scroll;
+  PiCtrlMouseAbs abs;  // Only the latest position counts
+  bool abs_pending;
+  bool pending;
+  bool batching;  // Hold it all until the batch is done, see `handle_batch()`
+  uint64_t last_emit_usec;
+} pictrl_motion_accum;
 
 typedef struct {
-  pictrl_backend_type type;
-  pictrl_backend_t *backend;
+  const pictrl_backend_ops *ops;
+  void *impl;  // What `ops->new()` returned
+  pictrl_motion_accum motion;
 } pictrl_backend;
 
-pictrl_backend *pictrl_backend_new();
+pictrl_backend *pictrl_backend_new(const char *name);
 void pictrl_backend_free(pictrl_backend *backend);
-const char *pictrl_backend_name(pictrl_backend_type type);
+const char *pictrl_backend_name(const pictrl_backend *backend);
+void pictrl_backend_print_names(FILE *stream);
 
 void handle_mouse_click(pictrl_backend *backend, RawPiCtrlMessage *msg);
 void handle_mouse_move(pictrl_backend *backend, RawPiCtrlMessage *msg);
+void handle_mouse_move_hires(pictrl_backend *backend, RawPiCtrlMessage *msg);
+void handle_mouse_scroll(pictrl_backend *backend, RawPiCtrlMessage *msg);
+void handle_mouse_abs(pictrl_backend *backend, RawPiCtrlMessage *msg);
 void handle_text(pictrl_backend *backend, RawPiCtrlMessage *msg);
 void handle_keysym(pictrl_backend *backend, RawPiCtrlMessage *msg);
+int handle_batch(pictrl_backend *backend, RawPiCtrlMessage *msg);
+
+int pictrl_backend_handle_message(pictrl_backend *backend,
+                                  RawPiCtrlMessage *msg);
+int64_t pictrl_backend_service(pictrl_backend *backend);
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef _PICTRL_BACKEND_OPS_H
+#define _PICTRL_BACKEND_OPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "model/mouse.h"
+
+/*
+What every backend (uinput, xdo, ...) has to implement. Each one exports a
+`const pictrl_backend_ops` and `pictrl_backend_new()` picks one by name at
+startup, so nothing above this cares which it got.
+
+`impl` is whatever `new()` returned. Anything a backend can't do can be left
+NULL, in which case it's skipped (and logged as a stub). `service` can be NULL
+if the backend never holds anything back, and `message_received` if it doesn't
+care when messages arrive.
+*/
+typedef struct {
+  const char *name;
+
+  void *(*new)();  // Creates and initializes the backend, NULL on failure
+  void (*free)(void *impl);
+
+  void (*move_mouse_rel)(void *impl, PiCtrlMouseCoord coords);
+  void (*move_mouse_abs)(void *impl, PiCtrlMouseAbs pos);
+  void (*scroll)(void *impl, PiCtrlMouseScroll scroll);
+  void (*click_mouse)(void *impl, PiCtrlMouseBtnStatus status);
+  void (*type_text)(void *impl, const uint8_t *text, size_t len);
+  void (*type_keysym)(void *impl, const char *keysym, size_t len);
+
+  // Releases anything the backend held back (see `pictrl_backend_service()`)
+  // and returns microseconds until it has more, or -1
+  int64_t (*service)(void *impl);
+
+  // Called with `pictrl_now_usec()` as each message comes in, before it's
+  // handled
+  void (*message_received)(void *impl, uint64_t recv_usec);
+} pictrl_backend_ops;
+
+#endif
@@ -0,0 +1,195 @@
+#define _GNU_SOURCE  // mremap()
+#include "backend/picontrol_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging/log_utils.h"
+
+static size_t file_size(size_t num_records) {
+  return sizeof(pictrl_journal_header) +
+         num_records * sizeof(pictrl_journal_record);
+}
+
+static pictrl_journal_record *records(pictrl_journal *journal) {
+  return (pictrl_journal_record *)(journal->header + 1);
+}
+
+/*
+Creates (or truncates) the journal at `path`, with room for `initial_records`
+before it has to grow. Returns NULL (and logs why) on failure.
+*/
+pictrl_journal *pictrl_journal_open(pictrl_journal *journal, const char *path,
+                                    size_t initial_records) {
+  if (initial_records == 0) {
+    initial_records = 1;
+  }
+
+  const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    pictrl_log_error("Could not open journal %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  const size_t size = file_size(initial_records);
+  if (ftruncate(fd, size) < 0) {
+    pictrl_log_error("Could not size journal %s: %s\n", path, strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    pictrl_log_error("Could not map journal %s: %s\n", path, strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  journal->fd = fd;
+  journal->header = map;
+  journal->capacity = initial_records;
+  journal->recv_usec = 0;
+
+  memcpy(journal->header->magic, PICTRL_JOURNAL_MAGIC,
+         sizeof(journal->header->magic));
+  journal->header->version = PICTRL_JOURNAL_VERSION;
+  journal->header->record_size = sizeof(pictrl_journal_record);
+  journal->header->num_records = 0;
+  return journal;
+}
+
+// Trims off the preallocated space that was never used, and unmaps the file
+void pictrl_journal_close(pictrl_journal *journal) {
+  if (journal->header == NULL) {
+    return;
+  }
+
+  const size_t num_records = journal->header->num_records;
+  munmap(journal->header, file_size(journal->capacity));
+  if (ftruncate(journal->fd, file_size(num_records)) < 0) {
+    pictrl_log_warn("Could not trim journal: %s\n", strerror(errno));
+  }
+  close(journal->fd);
+
+  journal->fd = -1;
+  journal->header = NULL;
+  journal->capacity = 0;
+}
+
+// Doubles the capacity until at least `min_capacity` records fit
+static bool grow(pictrl_journal *journal, size_t min_capacity) {
+  size_t new_capacity = journal->capacity;
+  while (new_capacity < min_capacity) {
+    new_capacity *= 2;
+  }
+
+  const size_t new_size = file_size(new_capacity);
+  if (ftruncate(journal->fd, new_size) < 0) {
+    pictrl_log_error("Could not grow journal: %s\n", strerror(errno));
+    return false;
+  }
+  void *map = mremap(journal->header, file_size(journal->capacity), new_size,
+                     MREMAP_MAYMOVE);
+  if (map == MAP_FAILED) {
+    pictrl_log_error("Could not remap journal: %s\n", strerror(errno));
+    return false;
+  }
+
+  journal->header = map;
+  journal->capacity = new_capacity;
+  return true;
+}
+
+/*
+Appends `num_events` events that went (or would have gone) to `device` at
+`emit_usec`, from a message received at `recv_usec`. It's all or nothing:
+returns false if the journal couldn't grow to fit them.
+
+`num_records` is only bumped once the records are in place, so a reader never
+sees a half written one.
+*/
+bool pictrl_journal_append(pictrl_journal *journal,
+                           pictrl_journal_device device,
+                           const struct input_event *events, size_t num_events,
+                           uint64_t recv_usec, uint64_t emit_usec) {
+  const size_t num_records = journal->header->num_records;
+  if (num_events > journal->capacity - num_records &&
+      !grow(journal, num_records + num_events)) {
+    return false;
+  }
+
+  pictrl_journal_record *record = &records(journal)[num_records];
+  for (size_t i = 0; i < num_events; i++, record++) {
+    record->recv_usec = recv_usec;
+    record->emit_usec = emit_usec;
+    record->device = device;
+    record->reserved = 0;
+    record->event = events[i];
+  }
+  journal->header->num_records = num_records + num_events;
+  return true;
+}
+
+/*
+Maps an existing journal read-only (i.e. to dump it) and checks that it's one
+we can read. Returns NULL (and logs why) if not, otherwise unmap it with
+`pictrl_journal_unmap()` and the `map_size` it gives back.
+*/
+const pictrl_journal_header *pictrl_journal_map(const char *path,
+                                                size_t *map_size) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    pictrl_log_error("Could not open journal %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < sizeof(pictrl_journal_header)) {
+    pictrl_log_error("%s is too small to be a journal\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  const size_t size = st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    pictrl_log_error("Could not map journal %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  const pictrl_journal_header *header = map;
+  const char *problem = NULL;
+  if (memcmp(header->magic, PICTRL_JOURNAL_MAGIC, sizeof(header->magic)) != 0) {
+    problem = "not a journal";
+  } else if (header->version != PICTRL_JOURNAL_VERSION) {
+    problem = "unsupported version";
+  } else if (header->record_size != sizeof(pictrl_journal_record)) {
+    problem = "written on a different kind of machine";
+  } else if (header->num_records >
+             (size - sizeof(*header)) / sizeof(pictrl_journal_record)) {
+    problem = "truncated";
+  }
+  if (problem != NULL) {
+    pictrl_log_error("Can't read journal %s: %s\n", path, problem);
+    munmap(map, size);
+    return NULL;
+  }
+
+  *map_size = size;
+  return header;
+}
+
+void pictrl_journal_unmap(const pictrl_journal_header *header,
+                          size_t map_size) {
+  munmap((void *)header, map_size);
+}
@@ -0,0 +1,80 @@
+#ifndef _PICTRL_JOURNAL_H
+#define _PICTRL_JOURNAL_H
+
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PICTRL_JOURNAL_MAGIC "PICTRLJ1"
+#define PICTRL_JOURNAL_VERSION 1
+
+// Which device an event would have gone to
+typedef enum {
+  PICTRL_JOURNAL_KEYBOARD = 0,  // Keys, clicks, relative moves and scrolling
+  PICTRL_JOURNAL_TABLET = 1,    // Absolute moves, and the clicks after them
+} pictrl_journal_device;
+
+/*
+Journal file layout: this header, followed by `num_records` records, all in
+host byte order (and with this host's `struct input_event`), so read it back on
+the same kind of machine that wrote it. `record_size` is there to catch a
+mismatch.
+
+Space past `num_records` is preallocated but not written yet.
+*/
+typedef struct {
+  char magic[8];  // PICTRL_JOURNAL_MAGIC, not null terminated
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t num_records;
+} pictrl_journal_header;
+
+typedef struct {
+  uint64_t recv_usec;  // When the message this came from was received
+  uint64_t emit_usec;  // When it would have been written to the device
+  uint32_t device;     // pictrl_journal_device
+  uint32_t reserved;
+  struct input_event event;  // As written, except `time` (uinput ignores it)
+} pictrl_journal_record;
+
+/*
+Append-only journal of emitted input events, memory mapped so appending is just
+a memcpy(). The file is preallocated, and doubled (ftruncate() + mremap()) when
+it fills up, so the only syscalls are the occasional growth, never one per
+event.
+
+Both timestamps are from `pictrl_now_usec()`, so `emit_usec - recv_usec` is how
+long the server held on to an event (including any pacing/coalescing).
+*/
+typedef struct {
+  int fd;
+  pictrl_journal_header *header;  // Start of the mapping
+  size_t capacity;                // Records the mapping has room for
+  uint64_t recv_usec;  // When the message being handled came in
+} pictrl_journal;
+
+// Prototypes
+pictrl_journal *pictrl_journal_open(pictrl_journal *journal, const char *path,
+                                    size_t initial_records);
+void pictrl_journal_close(pictrl_journal *journal);
+bool pictrl_journal_append(pictrl_journal *journal,
+                           pictrl_journal_device device,
+                           const struct input_event *events, size_t num_events,
+                           uint64_t recv_usec, uint64_t emit_usec);
+const pictrl_journal_header *pictrl_journal_map(const char *path,
+                                                size_t *map_size);
+void pictrl_journal_unmap(const pictrl_journal_header *header,
+                          size_t map_size);
+
+// Static "methods"
+static inline void pictrl_journal_set_received(pictrl_journal *journal,
+                                               uint64_t recv_usec) {
+  journal->recv_usec = recv_usec;
+}
+
+static inline const pictrl_journal_record *pictrl_journal_records(
+    const pictrl_journal_header *header) {
+  return (const pictrl_journal_record *)(header + 1);
+}
+#endif
@@ -0,0 +1,218 @@
+#include "backend/picontrol_key_pacer.h"
+
+#include <errno.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "logging/log_utils.h"
+
+// Capacity (in events) has to be a power of 2
+pictrl_key_pacer *pictrl_pacer_init(pictrl_key_pacer *pacer, size_t capacity,
+                                    uint64_t interval_usec,
+                                    size_t burst_reports,
+                                    size_t max_burst_events) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+      burst_reports == 0 || max_burst_events == 0) {
+    return NULL;
+  }
+
+  struct input_event *events = calloc(capacity, sizeof(*events));
+  if (events == NULL) {
+    return NULL;
+  }
+  pacer->events = events;
+  pacer->capacity = capacity;
+  pacer->mask = capacity - 1;
+  pacer->head = 0;
+  pacer->tail = 0;
+  pacer->interval_usec = interval_usec;
+  pacer->burst_reports = burst_reports;
+  pacer->max_burst_events = max_burst_events;
+  pacer->next_release_usec = 0;
+  pacer->dropped_events = 0;
+
+  return pacer;
+}
+
+void pictrl_pacer_destroy(pictrl_key_pacer *pacer) {
+  if (pacer == NULL) {
+    return;
+  }
+  free(pacer->events);
+
+  pacer->events = NULL;
+  pacer->capacity = 0;
+  pacer->mask = 0;
+  pacer->head = 0;
+  pacer->tail = 0;
+}
+
+/*
+Queues `num_events` events, which should be made up of whole reports. It's all
+or nothing: if they don't all fit, nothing is queued and we return false with
+errno set to ENOBUFS (and count them as dropped), so we never release half a
+keystroke. It's up to the caller to give up on (or retry) the rest of what it
+was typing.
+*/
+bool pictrl_pacer_push(pictrl_key_pacer *pacer,
+                       const struct input_event *events, size_t num_events) {
+  if (num_events > pacer->capacity - pictrl_pacer_size(pacer)) {
+    pictrl_log_warn("Pacer queue full (%zu of %zu events waiting), dropping "
+                    "%zu events\n",
+                    pictrl_pacer_size(pacer), pacer->capacity, num_events);
+    pacer->dropped_events += num_events;
+    errno = ENOBUFS;
+    return false;
+  }
+
+  const size_t start = pacer->tail & pacer->mask;
+  const size_t num_first_pass =
+      (num_events < pacer->capacity - start) ? num_events
+                                             : pacer->capacity - start;
+  memcpy(&pacer->events[start], events, num_first_pass * sizeof(*events));
+  memcpy(pacer->events, events + num_first_pass,
+         (num_events - num_first_pass) * sizeof(*events));
+  pacer->tail += num_events;
+  return true;
+}
+
+static inline bool is_syn_report(const struct input_event *ie) {
+  return ie->type == EV_SYN && ie->code == SYN_REPORT;
+}
+
+// How many reports we're allowed to release right now
+static size_t reports_due(pictrl_key_pacer *pacer, uint64_t now_usec) {
+  if (pacer->interval_usec == 0) {
+    return SIZE_MAX;
+  }
+  if (now_usec < pacer->next_release_usec) {
+    return 0;
+  }
+
+  // Don't let an idle period build up more than a burst's worth of credit
+  const uint64_t burst_usec = (pacer->burst_reports - 1) * pacer->interval_usec;
+  if (now_usec - pacer->next_release_usec > burst_usec) {
+    pacer->next_release_usec = now_usec - burst_usec;
+  }
+  return (now_usec - pacer->next_release_usec) / pacer->interval_usec + 1;
+}
+
+// How many reports end in the first `num_events` queued events. The rest of a
+// report that only partly went out gets counted once its SYN_REPORT does
+static size_t count_reports(const pictrl_key_pacer *pacer, size_t num_events) {
+  size_t num_reports = 0;
+  for (size_t i = 0; i < num_events; i++) {
+    if (is_syn_report(&pacer->events[(pacer->head + i) & pacer->mask])) {
+      num_reports++;
+    }
+  }
+  return num_reports;
+}
+
+static ssize_t write_fd(void *ctx, const struct iovec *iov, int iov_count) {
+  return writev(*(const int *)ctx, iov, iov_count);
+}
+
+/*
+Writes whatever is due at `now_usec` to `fd` in a single writev(), and returns
+how many microseconds until more is due (0 if it already is), or -1 if there's
+nothing left.
+
+A short write (or EAGAIN) leaves the rest queued for next time, and only what
+actually went out counts against the rate. After EAGAIN, the device's buffer is
+full, so we ask to be called back in a report interval (at least
+PICTRL_PACER_MIN_RETRY_USEC) rather than straight away, which would just spin
+whoever's driving us. Events the device flat out rejects
+are dropped (and counted) rather than retried forever, and so is an event that
+only got partly written, since writing it again would misalign the rest.
+*/
+int64_t pictrl_pacer_release(pictrl_key_pacer *pacer, int fd,
+                             uint64_t now_usec) {
+  return pictrl_pacer_release_to(pacer, &write_fd, &fd, now_usec);
+}
+
+// Same as `pictrl_pacer_release()`, but hands the events to `writer` (i.e. to
+// record them) instead of a device
+int64_t pictrl_pacer_release_to(pictrl_key_pacer *pacer,
+                                pictrl_pacer_writer writer, void *ctx,
+                                uint64_t now_usec) {
+  if (pictrl_pacer_empty(pacer)) {
+    return -1;
+  }
+  uint64_t retry_usec = 0;
+
+  // Gather as many whole reports as we're allowed, up to a burst
+  const size_t max_reports = reports_due(pacer, now_usec);
+  const size_t num_queued = pictrl_pacer_size(pacer);
+  size_t num_events = 0;
+  size_t num_reports = 0;
+  for (size_t i = 0; i < num_queued && i < pacer->max_burst_events &&
+                     num_reports < max_reports;
+       i++) {
+    if (is_syn_report(&pacer->events[(pacer->head + i) & pacer->mask])) {
+      num_reports++;
+      num_events = i + 1;
+    }
+  }
+  if (max_reports > 0 && num_events == 0) {
+    // No report boundary within a burst, just send what fits
+    num_reports = 1;
+    num_events = (num_queued < pacer->max_burst_events)
+                     ? num_queued
+                     : pacer->max_burst_events;
+  }
+
+  if (num_events > 0) {
+    const size_t start = pacer->head & pacer->mask;
+    const size_t num_first_pass = (num_events < pacer->capacity - start)
+                                      ? num_events
+                                      : pacer->capacity - start;
+    struct iovec iov[2] = {
+        {.iov_base = &pacer->events[start],
+         .iov_len = num_first_pass * sizeof(pacer->events[0])},
+        {.iov_base = pacer->events,
+         .iov_len = (num_events - num_first_pass) * sizeof(pacer->events[0])}};
+    const int iov_count = (num_first_pass == num_events) ? 1 : 2;
+
+    const ssize_t written = writer(ctx, iov, iov_count);
+    if (written >= 0) {
+      const size_t num_written = (size_t)written / sizeof(pacer->events[0]);
+      size_t num_released = num_written;
+      if ((size_t)written % sizeof(pacer->events[0]) != 0) {
+        pictrl_log_error("Device took part of an input event, dropping it\n");
+        num_released++;
+        pacer->dropped_events++;
+      }
+      num_reports = (num_released == num_events)
+                        ? num_reports
+                        : count_reports(pacer, num_released);
+      pacer->head += num_released;
+    } else if (errno == EAGAIN) {
+      num_reports = 0;
+      retry_usec = (pacer->interval_usec > PICTRL_PACER_MIN_RETRY_USEC)
+                       ? pacer->interval_usec
+                       : PICTRL_PACER_MIN_RETRY_USEC;
+    } else if (errno != EINTR) {
+      pictrl_log_error("Dropping %zu queued input events: %s\n", num_events,
+                       strerror(errno));
+      pacer->head += num_events;
+      pacer->dropped_events += num_events;
+      num_reports = 0;
+    } else {
+      num_reports = 0;
+    }
+    pacer->next_release_usec += num_reports * pacer->interval_usec;
+  }
+
+  if (pictrl_pacer_empty(pacer)) {
+    return -1;
+  }
+  const uint64_t due_usec = (pacer->next_release_usec > now_usec)
+                                ? pacer->next_release_usec - now_usec
+                                : 0;
+  return (int64_t)((due_usec > retry_usec) ? due_usec : retry_usec);
+}
@@ -0,0 +1,69 @@
+#ifndef _PICTRL_KEY_PACER_H
+#define _PICTRL_KEY_PACER_H
+
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*
+Queue of input reports that get released to a device at a fixed rate, instead
+of all at once. Typing a long string all at once overruns the buffer evdev
+keeps for each reader, and whatever doesn't fit gets dropped (the compositor
+sees SYN_DROPPED and loses keys), so text gets queued here and trickled out.
+
+Nothing in here sleeps: `pictrl_pacer_release()` writes whatever is due right
+now, and says how long until the next report is due. It's up to the caller to
+come back then (i.e. with an lws timer).
+
+Rate limiting works in whole reports (everything up to and including a
+SYN_REPORT): one report every `interval_usec`, where up to `burst_reports` can
+go out back to back if we've been idle for a while.
+*/
+typedef struct {
+  struct input_event *events;  // Ring, capacity is a power of 2
+  size_t capacity;
+  size_t mask;
+  size_t head;  // Free-running, next event to release
+  size_t tail;  // Free-running, next free slot
+
+  uint64_t interval_usec;  // 0 releases everything as soon as possible
+  size_t burst_reports;
+  size_t max_burst_events;  // Most events in a single write()
+  uint64_t next_release_usec;
+
+  uint64_t dropped_events;  // Couldn't be queued, or the device rejected them
+} pictrl_key_pacer;
+
+// Shortest we wait to retry a device that said it would block (EAGAIN)
+#define PICTRL_PACER_MIN_RETRY_USEC 1000  // 1ms
+
+// Where released events go, with the same contract as writev()
+typedef ssize_t (*pictrl_pacer_writer)(void *ctx, const struct iovec *iov,
+                                       int iov_count);
+
+// Prototypes
+pictrl_key_pacer *pictrl_pacer_init(pictrl_key_pacer *pacer, size_t capacity,
+                                    uint64_t interval_usec,
+                                    size_t burst_reports,
+                                    size_t max_burst_events);
+void pictrl_pacer_destroy(pictrl_key_pacer *pacer);
+bool pictrl_pacer_push(pictrl_key_pacer *pacer,
+                       const struct input_event *events, size_t num_events);
+int64_t pictrl_pacer_release(pictrl_key_pacer *pacer, int fd,
+                             uint64_t now_usec);
+int64_t pictrl_pacer_release_to(pictrl_key_pacer *pacer,
+                                pictrl_pacer_writer writer, void *ctx,
+                                uint64_t now_usec);
+
+// Static "methods"
+static inline size_t pictrl_pacer_size(const pictrl_key_pacer *pacer) {
+  return pacer->tail - pacer->head;
+}
+
+static inline bool pictrl_pacer_empty(const pictrl_key_pacer *pacer) {
+  return pictrl_pacer_size(pacer) == 0;
+}
+#endif
@@ -0,0 +1,63 @@
+#include "backend/picontrol_keysym.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+
+#include "backend/picontrol_keysym_table.h"  // Generated
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+
+// Returns the key code for `name` (case insensitive), or -1 if we don't know it
+int pictrl_keysym_lookup(const char *name, size_t len) {
+  const size_t mask = PICTRL_KEYSYM_TABLE_SIZE - 1;
+  const uint32_t displacement =
+      pictrl_keysym_displacements[pictrl_keysym_hash(name, len, 0) & mask];
+  const pictrl_keysym_entry *entry =
+      &pictrl_keysym_table[pictrl_keysym_hash(name, len, displacement) & mask];
+
+  // Anything not in the table still lands *somewhere*, so check it's really it
+  if (entry->name == NULL || entry->name_len != len ||
+      strncasecmp(entry->name, name, len) != 0) {
+    return -1;
+  }
+  return entry->code;
+}
+
+/*
+Parses a `len` byte (not necessarily null terminated) keysym combo, i.e.
+"Ctrl+Shift+t", into `combo`. Keys get pressed in the order they're listed, and
+released in the same order.
+
+Returns false (and leaves `combo` in an unspecified state) if any of the names
+are unknown or empty, or if there are more than PICTRL_MAX_SIMUL_KEYS of them.
+*/
+bool pictrl_keysym_parse_combo(const char *keysym, size_t len,
+                               pictrl_key_combo *combo) {
+  combo->num_keys = 0;
+
+  size_t start = 0;
+  while (start <= len) {
+    size_t end = start;
+    while (end < len && keysym[end] != PICTRL_KEYSYM_SEPARATOR) {
+      end++;
+    }
+
+    const int code = pictrl_keysym_lookup(&keysym[start], end - start);
+    if (code < 0) {
+      pictrl_log_warn("Unknown keysym \"%.*s\"\n", (int)(end - start),
+                      &keysym[start]);
+      return false;
+    }
+    if (combo->num_keys == PICTRL_MAX_SIMUL_KEYS) {
+      pictrl_log_warn("Keysym combo has more than %d keys\n",
+                      PICTRL_MAX_SIMUL_KEYS);
+      return false;
+    }
+    combo->keys[combo->num_keys++] = code;
+
+    start = end + 1;
+  }
+  return true;
+}
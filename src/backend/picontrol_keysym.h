@@ -0,0 +1,50 @@
+#ifndef _PICTRL_KEYSYM_H
+#define _PICTRL_KEYSYM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "backend/picontrol_uinput.h"
+
+// Separates the keys of a combo, i.e. "ctrl+shift+t"
+#define PICTRL_KEYSYM_SEPARATOR '+'
+
+/*
+Key names live in a perfect hash table that's generated at build time from
+`picontrol_keysym_names.def` (see `src/tools/gen_keysym_table.c`), so finding a
+name is always 2 hashes and 1 compare, and never allocates.
+
+It's the usual 2 level "hash and displace" table: the first hash picks a
+bucket, whose displacement is the seed for the second hash, which picks the
+slot. The generator found displacements where no 2 names share a slot.
+*/
+typedef struct {
+  const char *name;  // NULL for an empty slot
+  uint8_t name_len;
+  uint16_t code;
+} pictrl_keysym_entry;
+
+/*
+FNV-1a, lowercasing as it goes so lookups are case insensitive. Shared with the
+generator, so the table it spits out only works with this exact function.
+*/
+static inline uint32_t pictrl_keysym_hash(const char *name, size_t len,
+                                          uint32_t seed) {
+  uint32_t hash = 0x811C9DC5 ^ (seed * 0x9E3779B1);
+  for (size_t i = 0; i < len; i++) {
+    char c = name[i];
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    hash ^= (uint8_t)c;
+    hash *= 0x01000193;
+  }
+  return hash;
+}
+
+// Prototypes
+int pictrl_keysym_lookup(const char *name, size_t len);
+bool pictrl_keysym_parse_combo(const char *keysym, size_t len,
+                               pictrl_key_combo *combo);
+#endif
@@ -0,0 +1,130 @@
+#include "backend/picontrol_keysym_cache.h"
+
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "backend/picontrol_keysym.h"
+#include "picontrol_config.h"
+
+_Static_assert((PICTRL_KEYSYM_CACHE_ENTRIES &
+                (PICTRL_KEYSYM_CACHE_ENTRIES - 1)) == 0,
+               "PICTRL_KEYSYM_CACHE_ENTRIES must be a power of 2");
+_Static_assert(PICTRL_KEYSYM_CACHE_ENTRIES < PICTRL_KEYSYM_CACHE_NONE,
+               "PICTRL_KEYSYM_CACHE_ENTRIES doesn't fit in an entry index");
+
+#define BUCKET_MASK (PICTRL_KEYSYM_CACHE_ENTRIES - 1)
+
+void pictrl_keysym_cache_init(pictrl_keysym_cache *cache) {
+  memset(cache->buckets, PICTRL_KEYSYM_CACHE_NONE, sizeof(cache->buckets));
+  cache->num_entries = 0;
+  cache->lru_head = PICTRL_KEYSYM_CACHE_NONE;
+  cache->lru_tail = PICTRL_KEYSYM_CACHE_NONE;
+  cache->stats = (pictrl_keysym_cache_stats){0};
+}
+
+static uint32_t hash_key(const uint8_t *key, size_t key_len) {
+  return pictrl_keysym_hash((const char *)key, key_len, 0);
+}
+
+static void lru_unlink(pictrl_keysym_cache *cache, uint8_t index) {
+  pictrl_keysym_cache_entry *entry = &cache->entries[index];
+  if (entry->lru_prev == PICTRL_KEYSYM_CACHE_NONE) {
+    cache->lru_head = entry->lru_next;
+  } else {
+    cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+  }
+  if (entry->lru_next == PICTRL_KEYSYM_CACHE_NONE) {
+    cache->lru_tail = entry->lru_prev;
+  } else {
+    cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+  }
+}
+
+static void lru_push_front(pictrl_keysym_cache *cache, uint8_t index) {
+  pictrl_keysym_cache_entry *entry = &cache->entries[index];
+  entry->lru_prev = PICTRL_KEYSYM_CACHE_NONE;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head != PICTRL_KEYSYM_CACHE_NONE) {
+    cache->entries[cache->lru_head].lru_prev = index;
+  }
+  cache->lru_head = index;
+  if (cache->lru_tail == PICTRL_KEYSYM_CACHE_NONE) {
+    cache->lru_tail = index;
+  }
+}
+
+static void chain_unlink(pictrl_keysym_cache *cache, uint8_t index) {
+  uint8_t *link = &cache->buckets[cache->entries[index].hash & BUCKET_MASK];
+  while (*link != index) {
+    link = &cache->entries[*link].chain_next;
+  }
+  *link = cache->entries[index].chain_next;
+}
+
+/*
+Returns the events cached for `key`, or NULL if it's not cached (i.e. it needs
+to be parsed, then `pictrl_keysym_cache_put()`). A hit makes the entry the most
+recently used.
+*/
+const pictrl_keysym_cache_entry *pictrl_keysym_cache_get(
+    pictrl_keysym_cache *cache, const uint8_t *key, size_t key_len) {
+  const uint32_t hash = hash_key(key, key_len);
+  for (uint8_t i = cache->buckets[hash & BUCKET_MASK];
+       i != PICTRL_KEYSYM_CACHE_NONE; i = cache->entries[i].chain_next) {
+    const pictrl_keysym_cache_entry *entry = &cache->entries[i];
+    if (entry->hash == hash && entry->key_len == key_len &&
+        memcmp(entry->key, key, key_len) == 0) {
+      if (cache->lru_head != i) {
+        lru_unlink(cache, i);
+        lru_push_front(cache, i);
+      }
+      cache->stats.hits++;
+      return entry;
+    }
+  }
+
+  cache->stats.misses++;
+  return NULL;
+}
+
+/*
+Caches `events` for `key`, evicting the least recently used entry if we're
+full. Keys longer than PICTRL_KEYSYM_CACHE_KEY_MAX (nobody's shortcut is that
+long) and oversized event lists aren't cached, and we return false.
+
+Doesn't check if `key` is already cached, only call this after a miss.
+*/
+bool pictrl_keysym_cache_put(pictrl_keysym_cache *cache, const uint8_t *key,
+                             size_t key_len, const struct input_event *events,
+                             size_t num_events) {
+  if (key_len > PICTRL_KEYSYM_CACHE_KEY_MAX ||
+      num_events > PICTRL_KEYSYM_CACHE_MAX_EVENTS) {
+    return false;
+  }
+
+  uint8_t index;
+  if (cache->num_entries < PICTRL_KEYSYM_CACHE_ENTRIES) {
+    index = cache->num_entries++;
+  } else {
+    index = cache->lru_tail;
+    lru_unlink(cache, index);
+    chain_unlink(cache, index);
+    cache->stats.evictions++;
+  }
+
+  pictrl_keysym_cache_entry *entry = &cache->entries[index];
+  memcpy(entry->key, key, key_len);
+  entry->key_len = key_len;
+  entry->hash = hash_key(key, key_len);
+  memcpy(entry->events, events, num_events * sizeof(*events));
+  entry->num_events = num_events;
+
+  uint8_t *bucket = &cache->buckets[entry->hash & BUCKET_MASK];
+  entry->chain_next = *bucket;
+  *bucket = index;
+  lru_push_front(cache, index);
+  return true;
+}
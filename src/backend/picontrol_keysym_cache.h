@@ -0,0 +1,60 @@
+#ifndef _PICTRL_KEYSYM_CACHE_H
+#define _PICTRL_KEYSYM_CACHE_H
+
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "picontrol_config.h"
+
+// Same as PICTRL_UINPUT_FRAME_MAX_EVENTS, which we can't include from here
+#define PICTRL_KEYSYM_CACHE_MAX_EVENTS (2 * PICTRL_MAX_SIMUL_KEYS + 2)
+
+#define PICTRL_KEYSYM_CACHE_NONE UINT8_MAX  // End of a list, or no entry
+
+/*
+Small LRU cache from raw PI_CTRL_KEYSYM payloads (i.e. "Ctrl+c") to the exact
+events that type them, so a shortcut we've already seen skips the parsing and
+goes out as-is.
+
+Everything is preallocated: entries are linked into a hash chain (to find them)
+and an LRU list (to pick who gets evicted) by index, so nothing here allocates
+after init.
+*/
+typedef struct {
+  uint8_t key[PICTRL_KEYSYM_CACHE_KEY_MAX];
+  uint8_t key_len;
+  uint32_t hash;
+
+  struct input_event events[PICTRL_KEYSYM_CACHE_MAX_EVENTS];
+  size_t num_events;
+
+  uint8_t chain_next;  // Next entry in the same hash bucket
+  uint8_t lru_prev;    // Towards most recently used
+  uint8_t lru_next;    // Towards least recently used
+} pictrl_keysym_cache_entry;
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} pictrl_keysym_cache_stats;
+
+typedef struct {
+  pictrl_keysym_cache_entry entries[PICTRL_KEYSYM_CACHE_ENTRIES];
+  uint8_t buckets[PICTRL_KEYSYM_CACHE_ENTRIES];  // Head of each hash chain
+  uint8_t num_entries;
+  uint8_t lru_head;  // Most recently used
+  uint8_t lru_tail;  // Least recently used, evicted next
+  pictrl_keysym_cache_stats stats;
+} pictrl_keysym_cache;
+
+// Prototypes
+void pictrl_keysym_cache_init(pictrl_keysym_cache *cache);
+const pictrl_keysym_cache_entry *pictrl_keysym_cache_get(
+    pictrl_keysym_cache *cache, const uint8_t *key, size_t key_len);
+bool pictrl_keysym_cache_put(pictrl_keysym_cache *cache, const uint8_t *key,
+                             size_t key_len, const struct input_event *events,
+                             size_t num_events);
+#endif
@@ -0,0 +1,64 @@
+#include "backend/picontrol_null.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "logging/log_utils.h"
+
+static void *null_new() { return calloc(1, sizeof(pictrl_null_backend)); }
+
+static void null_free(void *impl) {
+  const pictrl_null_backend *counts = impl;
+  pictrl_log_info("Null backend discarded: %" PRIu64 " moves, %" PRIu64
+                  " absolute moves, %" PRIu64 " scrolls, %" PRIu64
+                  " clicks, %" PRIu64 " text bytes, %" PRIu64 " keysyms\n",
+                  counts->mouse_moves, counts->mouse_abs_moves,
+                  counts->scrolls, counts->clicks, counts->text_bytes,
+                  counts->keysyms);
+  free(impl);
+}
+
+static void null_move_mouse_rel(void *impl, PiCtrlMouseCoord coords) {
+  pictrl_null_backend *counts = impl;
+  counts->mouse_moves++;
+  counts->mouse_dx += coords.x;
+  counts->mouse_dy += coords.y;
+}
+
+static void null_move_mouse_abs(void *impl, PiCtrlMouseAbs pos) {
+  (void)pos;
+  ((pictrl_null_backend *)impl)->mouse_abs_moves++;
+}
+
+static void null_scroll(void *impl, PiCtrlMouseScroll scroll) {
+  (void)scroll;
+  ((pictrl_null_backend *)impl)->scrolls++;
+}
+
+static void null_click_mouse(void *impl, PiCtrlMouseBtnStatus status) {
+  (void)status;
+  ((pictrl_null_backend *)impl)->clicks++;
+}
+
+static void null_type_text(void *impl, const uint8_t *text, size_t len) {
+  (void)text;
+  ((pictrl_null_backend *)impl)->text_bytes += len;
+}
+
+static void null_type_keysym(void *impl, const char *keysym, size_t len) {
+  (void)keysym;
+  (void)len;
+  ((pictrl_null_backend *)impl)->keysyms++;
+}
+
+const pictrl_backend_ops pictrl_null_backend_ops = {
+    .name = "null",
+    .new = &null_new,
+    .free = &null_free,
+    .move_mouse_rel = &null_move_mouse_rel,
+    .move_mouse_abs = &null_move_mouse_abs,
+    .scroll = &null_scroll,
+    .click_mouse = &null_click_mouse,
+    .type_text = &null_type_text,
+    .type_keysym = &null_type_keysym,
+};
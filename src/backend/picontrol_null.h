@@ -0,0 +1,26 @@
+#ifndef _PICTRL_NULL_H
+#define _PICTRL_NULL_H
+
+#include <stdint.h>
+
+#include "backend/picontrol_backend_ops.h"
+
+/*
+Backend that doesn't emit anything, it just counts what it would have. Handy
+for measuring everything *but* the backend (network, decoding, dispatching,
+coalescing), and for running the server where there's no /dev/uinput or X (i.e.
+CI).
+*/
+typedef struct {
+  uint64_t mouse_moves;
+  int64_t mouse_dx, mouse_dy;  // What all the relative moves add up to
+  uint64_t mouse_abs_moves;
+  uint64_t scrolls;
+  uint64_t clicks;
+  uint64_t text_bytes;
+  uint64_t keysyms;
+} pictrl_null_backend;
+
+extern const pictrl_backend_ops pictrl_null_backend_ops;
+
+#endif
@@ -0,0 +1,298 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np()
+#include "backend/picontrol_pipeline.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backend/picontrol_backend.h"
+#include "data_structures/spsc_queue.h"
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+#include "util.h"
+
+static void pin_emitter(pthread_t emitter) {
+  const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_cpus < 2) {
+    pictrl_log_debug("Only 1 CPU online, not pinning emitter thread\n");
+    return;
+  }
+
+  const long cpu = (PICTRL_EMITTER_CPU < 0) ? num_cpus - 1 : PICTRL_EMITTER_CPU;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  const int ret = pthread_setaffinity_np(emitter, sizeof(cpus), &cpus);
+  if (ret != 0) {
+    pictrl_log_warn("Could not pin emitter thread to CPU %ld: %s\n", cpu,
+                    strerror(ret));
+    return;
+  }
+  pictrl_log_debug("Pinned emitter thread to CPU %ld\n", cpu);
+}
+
+// Waits on `sem` for at most `usec` microseconds, timed on the monotonic clock
+// so wall clock changes can't stretch or cut short the wait. Returns 0 once
+// `sem` has been posted, or -1 with errno ETIMEDOUT
+static int sem_wait_usec(sem_t *sem, int64_t usec) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += (usec % PICTRL_USEC_PER_SEC) * 1000;
+  deadline.tv_sec += usec / PICTRL_USEC_PER_SEC +
+                     deadline.tv_nsec / (PICTRL_USEC_PER_SEC * 1000);
+  deadline.tv_nsec %= PICTRL_USEC_PER_SEC * 1000;
+  int ret;
+  while ((ret = sem_clockwait(sem, CLOCK_MONOTONIC, &deadline)) < 0 &&
+         errno == EINTR) {
+  }
+  return ret;
+}
+
+// Returns true if we should keep going
+static bool emitter_sleep(pictrl_pipeline *pipeline) {
+  // Say we're going to sleep *before* the last look at the queue: anything
+  // published after that look will see the flag and wake us back up. Pairs
+  // with the fence in `pictrl_pipeline_submit()`
+  atomic_store(&pipeline->emitter_asleep, true);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!pictrl_spsc_empty(&pipeline->queue)) {
+    atomic_store(&pipeline->emitter_asleep, false);
+    return true;
+  }
+  if (!atomic_load(&pipeline->running)) {
+    return false;
+  }
+
+  atomic_fetch_add_explicit(&pipeline->idle_waits, 1, memory_order_relaxed);
+  const int64_t service_usec = pictrl_backend_service(pipeline->backend);
+  if (service_usec < 0) {
+    while (sem_wait(&pipeline->wakeup) < 0 && errno == EINTR) {
+    }
+  } else {
+    // The backend is holding input back (i.e. coalesced mouse motion), so only
+    // sleep until it needs to be flushed
+    sem_wait_usec(&pipeline->wakeup, service_usec);
+  }
+  atomic_store(&pipeline->emitter_asleep, false);
+  return true;
+}
+
+static void *emitter_main(void *arg) {
+  pictrl_pipeline *pipeline = (pictrl_pipeline *)arg;
+
+  // Keep going until we've been stopped *and* have drained everything that was
+  // submitted before that
+  while (true) {
+    pictrl_pipeline_msg *queued = pictrl_spsc_front(&pipeline->queue);
+    if (queued == NULL) {
+      if (!emitter_sleep(pipeline)) {
+        break;
+      }
+      continue;
+    }
+
+    RawPiCtrlMessage msg = {.header = queued->header,
+                            .payload = queued->payload};
+    pictrl_backend_handle_message(pipeline->backend, &msg);
+    pictrl_backend_service(pipeline->backend);
+    pictrl_spsc_release(&pipeline->queue);
+    atomic_fetch_add_explicit(&pipeline->emitted, 1, memory_order_relaxed);
+
+    // Pairs with the fence in `wait_for_room()`: either the submitter sees the
+    // slot we just released, or we see that it's waiting for one
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&pipeline->submitter_waiting, false)) {
+      sem_post(&pipeline->room);
+    }
+  }
+
+  return NULL;
+}
+
+pictrl_pipeline *pictrl_pipeline_new(pictrl_backend *backend) {
+  pictrl_pipeline *pipeline =
+      aligned_alloc(PICTRL_CACHE_LINE, sizeof(*pipeline));
+  if (pipeline == NULL) {
+    return NULL;
+  }
+
+  if (pictrl_spsc_init(&pipeline->queue, PICTRL_PIPELINE_QUEUE_LEN,
+                       sizeof(pictrl_pipeline_msg)) == NULL) {
+    pictrl_log_error("Could not allocate pipeline queue\n");
+    free(pipeline);
+    return NULL;
+  }
+  if (sem_init(&pipeline->wakeup, 0, 0) < 0) {
+    pictrl_log_error("Could not create pipeline semaphore: %s\n",
+                     strerror(errno));
+    pictrl_spsc_destroy(&pipeline->queue);
+    free(pipeline);
+    return NULL;
+  }
+  if (sem_init(&pipeline->room, 0, 0) < 0) {
+    pictrl_log_error("Could not create pipeline semaphore: %s\n",
+                     strerror(errno));
+    sem_destroy(&pipeline->wakeup);
+    pictrl_spsc_destroy(&pipeline->queue);
+    free(pipeline);
+    return NULL;
+  }
+  pipeline->backend = backend;
+  atomic_init(&pipeline->emitter_asleep, false);
+  atomic_init(&pipeline->submitter_waiting, false);
+  atomic_init(&pipeline->running, true);
+  atomic_init(&pipeline->max_depth, 0);
+  atomic_init(&pipeline->submitted, 0);
+  atomic_init(&pipeline->stalls, 0);
+  atomic_init(&pipeline->dropped, 0);
+  atomic_init(&pipeline->emitted, 0);
+  atomic_init(&pipeline->idle_waits, 0);
+
+  const int ret =
+      pthread_create(&pipeline->emitter, NULL, &emitter_main, pipeline);
+  if (ret != 0) {
+    pictrl_log_error("Could not start emitter thread: %s\n", strerror(ret));
+    sem_destroy(&pipeline->room);
+    sem_destroy(&pipeline->wakeup);
+    pictrl_spsc_destroy(&pipeline->queue);
+    free(pipeline);
+    return NULL;
+  }
+  pin_emitter(pipeline->emitter);
+
+  return pipeline;
+}
+
+// Stops the emitter once it has emitted everything already submitted. Does NOT
+// free the backend
+void pictrl_pipeline_free(pictrl_pipeline *pipeline) {
+  if (pipeline == NULL) {
+    return;
+  }
+
+  atomic_store(&pipeline->running, false);
+  sem_post(&pipeline->wakeup);
+  pthread_join(pipeline->emitter, NULL);
+
+  sem_destroy(&pipeline->room);
+  sem_destroy(&pipeline->wakeup);
+  pictrl_spsc_destroy(&pipeline->queue);
+  free(pipeline);
+}
+
+// Sleeps until the emitter releases a slot, for at most
+// PICTRL_PIPELINE_STALL_USEC. Returns the claimed slot, or NULL if the emitter
+// didn't make room in time
+static pictrl_pipeline_msg *wait_for_room(pictrl_pipeline *pipeline) {
+  atomic_store(&pipeline->submitter_waiting, true);
+  // Pairs with the fence in `emitter_main()`
+  atomic_thread_fence(memory_order_seq_cst);
+  pictrl_pipeline_msg *slot = pictrl_spsc_claim(&pipeline->queue);
+  bool woken = false;
+  if (slot == NULL) {
+    woken = sem_wait_usec(&pipeline->room, PICTRL_PIPELINE_STALL_USEC) == 0;
+    if (woken) {
+      slot = pictrl_spsc_claim(&pipeline->queue);
+    }
+  }
+
+  // If the emitter took the flag but we never waited on its post (we found room
+  // on our own, or gave up first), eat that post now so it can't cut the next
+  // stall short. It's already been made, or is about to be
+  if (!atomic_exchange(&pipeline->submitter_waiting, false) && !woken) {
+    while (sem_wait(&pipeline->room) < 0 && errno == EINTR) {
+    }
+  }
+  return slot;
+}
+
+// Dropping a click or key could leave a button or key held down on the host
+// (i.e. a lost mouseup), and dropping text loses what was typed. Motion is fine
+// to lose, the next move makes up for it
+static bool droppable(uint8_t cmd) {
+  switch (cmd) {
+    case PI_CTRL_MOUSE_CLICK:
+    case PI_CTRL_TEXT:
+    case PI_CTRL_KEYSYM:
+    case PI_CTRL_BATCH:  // Could have any of the above in it
+      return false;
+    default:
+      return true;
+  }
+}
+
+/*
+Network thread only. Copies the message into the queue and wakes the emitter if
+it's asleep.
+
+If the queue is full, we sleep until the emitter makes room and count it as a
+stall, but only for up to PICTRL_PIPELINE_STALL_USEC: past that, motion is
+dropped (and counted) rather than keep `lws_service()` from getting to the
+sockets. Clicks, keys, text and batches are never dropped (see `droppable()`),
+so those keep waiting for as long as the emitter takes. Stalls mean the backend
+can't keep up with the client, so PICTRL_PIPELINE_QUEUE_LEN can only paper over
+bursts. Returns -1 if the message was dropped.
+*/
+int pictrl_pipeline_submit(pictrl_pipeline *pipeline,
+                           const RawPiCtrlMessage *msg) {
+  pictrl_pipeline_msg *slot = pictrl_spsc_claim(&pipeline->queue);
+  if (slot == NULL) {
+    atomic_fetch_add_explicit(&pipeline->stalls, 1, memory_order_relaxed);
+    slot = wait_for_room(pipeline);
+    if (slot == NULL && !droppable(msg->header.cmd)) {
+      pictrl_log_warn("Emitter is stuck, holding up the network thread until "
+                      "it takes cmd %d\n",
+                      msg->header.cmd);
+      while ((slot = wait_for_room(pipeline)) == NULL) {
+      }
+    }
+    if (slot == NULL) {
+      const uint64_t dropped = atomic_fetch_add_explicit(
+          &pipeline->dropped, 1, memory_order_relaxed);
+      pictrl_log_warn("Emitter is stuck, dropped message %llu (cmd %d)\n",
+                      (unsigned long long)dropped + 1, msg->header.cmd);
+      return -1;
+    }
+  }
+
+  slot->header = msg->header;
+  memcpy(slot->payload, msg->payload, msg->header.payload_size);
+  pictrl_spsc_publish(&pipeline->queue);
+
+  atomic_fetch_add_explicit(&pipeline->submitted, 1, memory_order_relaxed);
+  const size_t depth = pictrl_spsc_size(&pipeline->queue);
+  if (depth > atomic_load_explicit(&pipeline->max_depth,
+                                   memory_order_relaxed)) {
+    atomic_store_explicit(&pipeline->max_depth, depth, memory_order_relaxed);
+  }
+
+  // Pairs with the fence in `emitter_sleep()`: either the emitter sees what we
+  // just published, or we see that it's asleep
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_exchange(&pipeline->emitter_asleep, false)) {
+    sem_post(&pipeline->wakeup);
+  }
+  return 0;
+}
+
+void pictrl_pipeline_get_stats(pictrl_pipeline *pipeline,
+                               pictrl_pipeline_stats *stats) {
+  stats->depth = pictrl_spsc_size(&pipeline->queue);
+  stats->max_depth =
+      atomic_load_explicit(&pipeline->max_depth, memory_order_relaxed);
+  stats->submitted =
+      atomic_load_explicit(&pipeline->submitted, memory_order_relaxed);
+  stats->emitted =
+      atomic_load_explicit(&pipeline->emitted, memory_order_relaxed);
+  stats->stalls = atomic_load_explicit(&pipeline->stalls, memory_order_relaxed);
+  stats->dropped =
+      atomic_load_explicit(&pipeline->dropped, memory_order_relaxed);
+  stats->idle_waits =
+      atomic_load_explicit(&pipeline->idle_waits, memory_order_relaxed);
+}
@@ -0,0 +1,68 @@
+#ifndef _PICTRL_PIPELINE_H
+#define _PICTRL_PIPELINE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "backend/picontrol_backend.h"
+#include "data_structures/spsc_queue.h"
+#include "model/protocol.h"
+
+/*
+Pipeline mode: the network thread only decodes messages into a lock-free queue,
+and a dedicated (pinned) emitter thread drains that queue into the backend. A
+slow backend (uinput write()s, xdo's keystroke delays) then only holds up the
+emitter, never `lws_service()`.
+
+The backend must only be touched by the emitter thread once the pipeline owns
+it.
+*/
+
+// What gets queued. The payload is copied out of lws' buffer, since that's
+// reused as soon as the receive callback returns
+typedef struct {
+  RawPictrlHeader header;
+  uint8_t payload[UINT8_MAX];
+} pictrl_pipeline_msg;
+
+typedef struct {
+  size_t depth;         // Messages currently waiting
+  size_t max_depth;     // High-water mark of `depth`
+  uint64_t submitted;   // Messages accepted from the network thread
+  uint64_t emitted;     // Messages handed to the backend
+  uint64_t stalls;      // Submits that found the queue full and had to wait
+  uint64_t dropped;     // Stalled motion that ran past the stall limit
+  uint64_t idle_waits;  // Times the emitter ran dry and went to sleep
+} pictrl_pipeline_stats;
+
+typedef struct {
+  pictrl_spsc_queue_t queue;
+  pictrl_backend *backend;
+
+  pthread_t emitter;
+  sem_t wakeup;
+  atomic_bool emitter_asleep;
+  sem_t room;  // Posted when the emitter frees a slot for a stalled submit
+  atomic_bool submitter_waiting;
+  atomic_bool running;
+
+  // Written by only one thread each, read by whoever wants stats
+  _Atomic size_t max_depth;
+  _Atomic uint64_t submitted;
+  _Atomic uint64_t stalls;
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t emitted;
+  _Atomic uint64_t idle_waits;
+} pictrl_pipeline;
+
+pictrl_pipeline *pictrl_pipeline_new(pictrl_backend *backend);
+void pictrl_pipeline_free(pictrl_pipeline *pipeline);
+int pictrl_pipeline_submit(pictrl_pipeline *pipeline,
+                           const RawPiCtrlMessage *msg);
+void pictrl_pipeline_get_stats(pictrl_pipeline *pipeline,
+                               pictrl_pipeline_stats *stats);
+
+#endif
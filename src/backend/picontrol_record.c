@@ -0,0 +1,92 @@
+#include "backend/picontrol_record.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+
+static void *record_new() {
+  pictrl_record_t *record = malloc(sizeof(*record));
+  if (record == NULL) {
+    return NULL;
+  }
+
+  const char *path = getenv("PICTRL_RECORD_PATH");
+  if (path == NULL) {
+    path = PICTRL_RECORD_PATH;
+  }
+  if (pictrl_journal_open(&record->journal, path,
+                          PICTRL_RECORD_INITIAL_EVENTS) == NULL) {
+    free(record);
+    return NULL;
+  }
+  if (pictrl_uinput_backend_init_journal(&record->uinput, &record->journal) <
+      0) {
+    pictrl_journal_close(&record->journal);
+    free(record);
+    return NULL;
+  }
+
+  pictrl_log_info("Recording events to %s\n", path);
+  return record;
+}
+
+static void record_free(void *impl) {
+  pictrl_record_t *record = impl;
+  // Let pacing finish, so the journal has everything a device would have gotten
+  picontrol_uinput_drain(&record->uinput);
+  pictrl_uinput_backend_destroy(&record->uinput);
+
+  pictrl_log_info("Recorded %" PRIu64 " events\n",
+                  record->journal.header->num_records);
+  pictrl_journal_close(&record->journal);
+  free(record);
+}
+
+static void record_move_mouse_rel(void *impl, PiCtrlMouseCoord coords) {
+  picontrol_uinput_move_mouse_rel(&((pictrl_record_t *)impl)->uinput, coords);
+}
+
+static void record_move_mouse_abs(void *impl, PiCtrlMouseAbs pos) {
+  picontrol_uinput_move_mouse_abs(&((pictrl_record_t *)impl)->uinput, pos);
+}
+
+static void record_scroll(void *impl, PiCtrlMouseScroll scroll) {
+  picontrol_uinput_scroll(&((pictrl_record_t *)impl)->uinput, scroll);
+}
+
+static void record_click_mouse(void *impl, PiCtrlMouseBtnStatus status) {
+  picontrol_uinput_click_mouse(&((pictrl_record_t *)impl)->uinput, status);
+}
+
+static void record_type_text(void *impl, const uint8_t *text, size_t len) {
+  picontrol_uinput_type_text(&((pictrl_record_t *)impl)->uinput, text, len);
+}
+
+static void record_type_keysym(void *impl, const char *keysym, size_t len) {
+  picontrol_uinput_type_keysym(&((pictrl_record_t *)impl)->uinput, keysym,
+                               len);
+}
+
+static int64_t record_service(void *impl) {
+  return picontrol_uinput_service(&((pictrl_record_t *)impl)->uinput);
+}
+
+static void record_message_received(void *impl, uint64_t recv_usec) {
+  pictrl_journal_set_received(&((pictrl_record_t *)impl)->journal, recv_usec);
+}
+
+const pictrl_backend_ops pictrl_record_backend_ops = {
+    .name = "record",
+    .new = &record_new,
+    .free = &record_free,
+    .move_mouse_rel = &record_move_mouse_rel,
+    .move_mouse_abs = &record_move_mouse_abs,
+    .scroll = &record_scroll,
+    .click_mouse = &record_click_mouse,
+    .type_text = &record_type_text,
+    .type_keysym = &record_type_keysym,
+    .service = &record_service,
+    .message_received = &record_message_received,
+};
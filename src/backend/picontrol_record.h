@@ -0,0 +1,25 @@
+#ifndef _PICTRL_RECORD_H
+#define _PICTRL_RECORD_H
+
+#include "backend/picontrol_backend_ops.h"
+#include "backend/picontrol_journal.h"
+#include "backend/picontrol_uinput.h"
+
+/*
+Backend that builds events exactly like the uinput backend does, but journals
+them (see `pictrl_journal`) instead of writing them to a device. Meant for
+regression testing: record the same session with two builds and diff what they
+emitted (`bin/tools/dump_journal`), or look at how long each event was held on
+to, all without /dev/uinput.
+
+The journal goes to PICTRL_RECORD_PATH (or the PICTRL_RECORD_PATH environment
+variable), and is overwritten each time the backend starts.
+*/
+typedef struct {
+  pictrl_uinput_t uinput;
+  pictrl_journal journal;
+} pictrl_record_t;
+
+extern const pictrl_backend_ops pictrl_record_backend_ops;
+
+#endif
@@ -2,14 +2,18 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <linux/input-event-codes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
+#include "backend/picontrol_keysym.h"
 #include "logging/log_utils.h"
 #include "model/protocol.h"
+#include "serialize/utf8.h"
 #include "util.h"
 
 // `errmsg` currently MUST take exactly 1 param: the string of the error
@@ -23,7 +27,12 @@
 static const pictrl_key_range valid_key_ranges[] = {
     // https://git.kernel.org/pub/scm/linux/kernel/git/torvalds/linux.git/tree/include/uapi/linux/input-event-codes.h
     {.lower_bound = KEY_ESC, .upper_bound = KEY_KPDOT},
-    {.lower_bound = KEY_F11, .upper_bound = KEY_F12}};
+    {.lower_bound = KEY_F11, .upper_bound = KEY_F12},
+    // Right hand modifiers, arrows, home/end etc. (for keysyms)
+    {.lower_bound = KEY_KPENTER, .upper_bound = KEY_DELETE},
+    {.lower_bound = KEY_MUTE, .upper_bound = KEY_VOLUMEUP},
+    {.lower_bound = KEY_LEFTMETA, .upper_bound = KEY_COMPOSE},
+    {.lower_bound = KEY_NEXTSONG, .upper_bound = KEY_STOPCD}};
 
 /*
 Index ("key") = ascii char
@@ -171,24 +180,95 @@ pictrl_uinput_t *pictrl_uinput_backend_new() {
   return malloc(sizeof(pictrl_uinput_t));
 }
 
+// Everything but the devices
+static int init_common(pictrl_uinput_t *uinput) {
+  uinput->fd = -1;
+  uinput->tablet_fd = -1;
+  uinput->journal = NULL;
+  if (pictrl_pacer_init(&uinput->pacer, PICTRL_KEY_QUEUE_EVENTS,
+                        PICTRL_KEY_REPORT_INTERVAL_USEC,
+                        PICTRL_KEY_BURST_REPORTS,
+                        PICTRL_UINPUT_MAX_BURST_EVENTS) == NULL) {
+    pictrl_log_error("Could not allocate key queue\n");
+    return -1;
+  }
+  pictrl_keysym_cache_init(&uinput->keysym_cache);
+  uinput->wheel_remainder = (PiCtrlMouseScroll){0};
+  uinput->pointer_on_tablet = false;
+  uinput->tablet_buttons = 0;
+  return 0;
+}
+
 int pictrl_uinput_backend_init(pictrl_uinput_t *uinput) {
+  if (init_common(uinput) < 0) {
+    return -1;
+  }
+
   int fd = picontrol_create_virtual_keyboard();
   if (fd < 0) {
     pictrl_log_error("Could not create virtual keyboard\n");
-    uinput->fd = -1;
+    pictrl_pacer_destroy(&uinput->pacer);
     return -1;
   }
   pictrl_log_debug("Created virtual keyboard\n");
   uinput->fd = fd;
+
+  // Not being able to position the mouse absolutely isn't the end of the world
+#if PICTRL_ABS_POINTER
+  uinput->tablet_fd = picontrol_create_virtual_tablet();
+  if (uinput->tablet_fd < 0) {
+    pictrl_log_warn("Could not create virtual tablet, ignoring absolute "
+                    "mouse positions\n");
+  } else {
+    pictrl_log_debug("Created virtual tablet\n");
+  }
+#endif
+  return 0;
+}
+
+/*
+Same as `pictrl_uinput_backend_init()`, but no devices get created: everything
+that would have been written to them is appended to `journal` instead (see the
+"record" backend). Pacing, caching and all the rest work exactly the same, so
+the journal ends up with the same events, at the same times.
+*/
+int pictrl_uinput_backend_init_journal(pictrl_uinput_t *uinput,
+                                       pictrl_journal *journal) {
+  if (init_common(uinput) < 0) {
+    return -1;
+  }
+  uinput->journal = journal;
   return 0;
 }
 
 int pictrl_uinput_backend_destroy(pictrl_uinput_t *uinput) {
-  if (uinput->fd < 0) {
+  if (uinput->fd < 0 && uinput->journal == NULL) {
     pictrl_log_warn("Virtual keyboard was not open...\n");
     return -1;
   }
 
+  if (!pictrl_pacer_empty(&uinput->pacer)) {
+    pictrl_log_warn("Dropping %zu input events that were still queued\n",
+                    pictrl_pacer_size(&uinput->pacer));
+  }
+  pictrl_pacer_destroy(&uinput->pacer);
+
+  const pictrl_keysym_cache_stats *stats = &uinput->keysym_cache.stats;
+  pictrl_log_info("Keysym cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+                  " evictions\n",
+                  stats->hits, stats->misses, stats->evictions);
+
+  if (uinput->journal != NULL) {
+    uinput->journal = NULL;  // Whoever handed it to us closes it
+    return 0;
+  }
+
+  if (uinput->tablet_fd >= 0 &&
+      picontrol_destroy_virtual_keyboard(uinput->tablet_fd) == 0) {
+    pictrl_log_debug("Destroyed virtual tablet\n");
+  }
+  uinput->tablet_fd = -1;
+
   int ret = picontrol_destroy_virtual_keyboard(uinput->fd);
   if (ret < 0) {
     return -1;
@@ -200,11 +280,224 @@ int pictrl_uinput_backend_destroy(pictrl_uinput_t *uinput) {
 
 void pictrl_uinput_backend_free(pictrl_uinput_t *uinput) { free(uinput); }
 
+static inline bool is_syn_report(const struct input_event *ie) {
+  return ie->type == EV_SYN && ie->code == SYN_REPORT;
+}
+
+// Where the next write() should stop: as far as a burst allows, cut back to the
+// end of the last whole report in it if there is one
+static size_t burst_end(const pictrl_uinput_frame *frame) {
+  const size_t max_burst_end =
+      frame->num_written + PICTRL_UINPUT_MAX_BURST_EVENTS;
+  if (max_burst_end >= frame->num_events) {
+    return frame->num_events;
+  }
+
+  for (size_t end = max_burst_end; end > frame->num_written; end--) {
+    if (is_syn_report(&frame->events[end - 1])) {
+      return end;
+    }
+  }
+  return max_burst_end;
+}
+
+/*
+Writes every event in the frame that the device hasn't accepted yet, and resets
+the frame once they've all gone through. Returns the number of events written
+by this call.
+
+uinput only ever accepts whole events, so a short write means the kernel
+rejected the event after the last one it took. In that case we return -1 with
+errno set, and leave `frame->num_written` pointing at the first unwritten event:
+calling this again retries from there instead of re-sending the whole report.
+*/
+ssize_t pictrl_uinput_frame_flush(int fd, pictrl_uinput_frame *frame) {
+  const size_t ie_sz = sizeof(frame->events[0]);
+  const size_t already_written = frame->num_written;
+
+  while (frame->num_written < frame->num_events) {
+    const size_t num_to_write = burst_end(frame) - frame->num_written;
+    const ssize_t written =
+        write(fd, &frame->events[frame->num_written], num_to_write * ie_sz);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+
+    frame->num_written += (size_t)written / ie_sz;
+    if ((size_t)written < num_to_write * ie_sz) {
+      // Nothing written and no error, or a torn event. Either way, we can't
+      // make progress
+      if (written == 0 || (size_t)written % ie_sz != 0) {
+        errno = EIO;
+        return -1;
+      }
+    }
+  }
+
+  const ssize_t num_flushed = (ssize_t)(frame->num_written - already_written);
+  frame->num_events = 0;
+  frame->num_written = 0;
+  return num_flushed;
+}
+
+// Writes the frame to `device`, or appends it to the journal if we're recording
+static bool flush_frame(pictrl_uinput_t *uinput, pictrl_journal_device device,
+                        pictrl_uinput_frame *frame) {
+  if (uinput->journal == NULL) {
+    const int fd =
+        (device == PICTRL_JOURNAL_TABLET) ? uinput->tablet_fd : uinput->fd;
+    return pictrl_uinput_frame_flush(fd, frame) >= 0;
+  }
+
+  if (!pictrl_journal_append(uinput->journal, device,
+                             &frame->events[frame->num_written],
+                             frame->num_events - frame->num_written,
+                             uinput->journal->recv_usec, pictrl_now_usec())) {
+    errno = ENOSPC;
+    return false;
+  }
+  frame->num_events = 0;
+  frame->num_written = 0;
+  return true;
+}
+
+/*
+When recording, paced events come out long after their message came in (and
+likely after others did too), so they carry their receive time in `time` until
+then. uinput ignores it anyways.
+*/
+static void stamp_queued(pictrl_uinput_t *uinput, size_t num_events) {
+  pictrl_key_pacer *pacer = &uinput->pacer;
+  const uint64_t recv_usec = uinput->journal->recv_usec;
+  const struct timeval recv_time = {
+      .tv_sec = recv_usec / PICTRL_USEC_PER_SEC,
+      .tv_usec = recv_usec % PICTRL_USEC_PER_SEC};
+  for (size_t i = pacer->tail - num_events; i != pacer->tail; i++) {
+    pacer->events[i & pacer->mask].time = recv_time;
+  }
+}
+
+// pictrl_pacer_writer that records released events instead of writing them
+static ssize_t journal_writev(void *ctx, const struct iovec *iov,
+                              int iov_count) {
+  const uint64_t now = pictrl_now_usec();
+  ssize_t written = 0;
+  for (int i = 0; i < iov_count; i++) {
+    const struct input_event *events = iov[i].iov_base;
+    for (size_t j = 0; j < iov[i].iov_len / sizeof(*events); j++) {
+      const uint64_t recv_usec =
+          (uint64_t)events[j].time.tv_sec * PICTRL_USEC_PER_SEC +
+          events[j].time.tv_usec;
+      if (!pictrl_journal_append(ctx, PICTRL_JOURNAL_KEYBOARD, &events[j], 1,
+                                 recv_usec, now)) {
+        errno = ENOSPC;
+        return (written > 0) ? written : -1;
+      }
+      written += sizeof(*events);
+    }
+  }
+  return written;
+}
+
+// Queues the frame behind whatever is already being paced out. Sets errno to
+// ENOBUFS if there's no room for it
+static bool push_frame(pictrl_uinput_t *uinput, pictrl_uinput_frame *frame) {
+  const size_t num_events = frame->num_events;
+  frame->num_events = 0;
+  if (!pictrl_pacer_push(&uinput->pacer, frame->events, num_events)) {
+    return false;
+  }
+  if (uinput->journal != NULL) {
+    stamp_queued(uinput, num_events);
+  }
+  return true;
+}
+
+/*
+Writes the frame straight to the device, unless there's paced output (i.e.
+text) still waiting: then it has to queue up behind it, or a click could land in
+the middle of what's being typed.
+*/
+static bool emit_frame(pictrl_uinput_t *uinput, pictrl_uinput_frame *frame) {
+  if (pictrl_pacer_empty(&uinput->pacer)) {
+    return flush_frame(uinput, PICTRL_JOURNAL_KEYBOARD, frame);
+  }
+
+  return push_frame(uinput, frame);
+}
+
+// Frames that always go through the pacer, even if nothing is waiting
+static bool queue_frame(pictrl_uinput_t *uinput, pictrl_uinput_frame *frame) {
+  const bool queued = push_frame(uinput, frame);
+  const int push_errno = errno;
+  picontrol_uinput_service(uinput);
+  errno = push_errno;
+  return queued;
+}
+
+/*
+Releases any paced output that's due. Returns how many microseconds until this
+should be called again, or -1 if there's nothing waiting.
+*/
+int64_t picontrol_uinput_service(pictrl_uinput_t *uinput) {
+  if (uinput->journal != NULL) {
+    return pictrl_pacer_release_to(&uinput->pacer, &journal_writev,
+                                   uinput->journal, pictrl_now_usec());
+  }
+  return pictrl_pacer_release(&uinput->pacer, uinput->fd, pictrl_now_usec());
+}
+
+// Blocks until everything queued has been released. Only meant for callers
+// without an event loop (i.e. tests)
+void picontrol_uinput_drain(pictrl_uinput_t *uinput) {
+  int64_t wait_usec;
+  while ((wait_usec = picontrol_uinput_service(uinput)) >= 0) {
+    usleep(wait_usec);
+  }
+}
+
+// When recording, act like we have a tablet whenever we would have made one
+static bool has_tablet(const pictrl_uinput_t *uinput) {
+  return (uinput->journal != NULL) ? PICTRL_ABS_POINTER
+                                   : uinput->tablet_fd >= 0;
+}
+
+/*
+Whether a click on `btn` should go to the tablet rather than the mouse. The two
+are separate devices, and nothing keeps events on one in order with events on
+the other: "move here, then tap" could get handled as a tap where the pointer
+used to be. So clicks go to whichever device last moved the pointer, and
+releases go to whichever device the button was pressed on (otherwise it would
+stay held down on the other one).
+*/
+static bool click_on_tablet(pictrl_uinput_t *uinput,
+                            PiCtrlMouseBtnStatus status) {
+  const uint8_t btn_bit = 1 << status.btn;
+  if (status.click == PI_CTRL_MOUSE_UP) {
+    const bool on_tablet = uinput->tablet_buttons & btn_bit;
+    uinput->tablet_buttons &= ~btn_bit;
+    return on_tablet;
+  }
+  if (uinput->pointer_on_tablet) {
+    uinput->tablet_buttons |= btn_bit;
+    return true;
+  }
+  return false;
+}
+
+/*
+Clicks on the tablet go straight out, the same as the moves they follow: the
+pacer only feeds the keyboard/mouse device, so they can't queue up behind text
+that's still being typed.
+*/
 void picontrol_uinput_click_mouse(pictrl_uinput_t *uinput,
                                   PiCtrlMouseBtnStatus status) {
-  struct input_event ie;
-  struct timeval cur_time;
-  gettimeofday(&cur_time, NULL);
+  struct input_event events[2];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
 
   int kernel_btn;
   switch (status.btn) {
@@ -224,68 +517,241 @@ void picontrol_uinput_click_mouse(pictrl_uinput_t *uinput,
   switch (status.click) {
     case PI_CTRL_MOUSE_DOWN:
       pictrl_log_debug("MOUSE DOWN\n");
-      picontrol_emit(&ie, uinput->fd, EV_KEY, kernel_btn, PICTRL_KEY_DOWN,
-                     &cur_time);
-      picontrol_emit(&ie, uinput->fd, EV_SYN, SYN_REPORT, 0, &cur_time);
+      pictrl_uinput_frame_append(&frame, EV_KEY, kernel_btn, PICTRL_KEY_DOWN);
       break;
     case PI_CTRL_MOUSE_UP:
       pictrl_log_debug("MOUSE UP\n");
-      picontrol_emit(&ie, uinput->fd, EV_KEY, kernel_btn, PICTRL_KEY_UP,
-                     &cur_time);
-      picontrol_emit(&ie, uinput->fd, EV_SYN, SYN_REPORT, 0, &cur_time);
+      pictrl_uinput_frame_append(&frame, EV_KEY, kernel_btn, PICTRL_KEY_UP);
       break;
     default:
       pictrl_log_error("Invalid mouse click status: %d\n", status.click);
+      return;
+  }
+  pictrl_uinput_frame_syn(&frame);
+
+  const bool emitted = click_on_tablet(uinput, status)
+                           ? flush_frame(uinput, PICTRL_JOURNAL_TABLET, &frame)
+                           : emit_frame(uinput, &frame);
+  if (!emitted) {
+    pictrl_log_error("Could not click mouse: %s\n", strerror(errno));
   }
 }
 
 void picontrol_uinput_move_mouse_rel(pictrl_uinput_t *uinput,
                                      PiCtrlMouseCoord coords) {
-  struct input_event ie;
-  struct timeval cur_time;
-  gettimeofday(&cur_time, NULL);
+  struct input_event events[3];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+
+  pictrl_uinput_frame_append(&frame, EV_REL, REL_X, coords.x);
+  pictrl_uinput_frame_append(&frame, EV_REL, REL_Y, coords.y);
+  pictrl_uinput_frame_syn(&frame);
+  uinput->pointer_on_tablet = false;
 
-  picontrol_emit(&ie, uinput->fd, EV_REL, REL_X, coords.x, &cur_time);
-  picontrol_emit(&ie, uinput->fd, EV_REL, REL_Y, coords.y, &cur_time);
-  picontrol_emit(&ie, uinput->fd, EV_SYN, SYN_REPORT, 0, &cur_time);
+  if (!emit_frame(uinput, &frame)) {
+    pictrl_log_error("Could not move mouse: %s\n", strerror(errno));
+  }
 }
 
-bool picontrol_uinput_type_char(pictrl_uinput_t *uinput, char c) {
-  // TODO: Error handling on `picontrol_emit` calls
-  struct input_event ie;
-  struct timeval cur_time;
-  const size_t ie_sz = sizeof(ie);
-  gettimeofday(&cur_time, NULL);
-  bool ret = true;
+/*
+Moves the mouse to `pos` (normalized to the whole screen) using the tablet.
+These go straight out, even with keystrokes still being paced, since the pacer
+only feeds the other device. Clicks after this go to the tablet too, so they
+land where it put the pointer (see `click_on_tablet()`).
+*/
+void picontrol_uinput_move_mouse_abs(pictrl_uinput_t *uinput,
+                                     PiCtrlMouseAbs pos) {
+  if (!has_tablet(uinput)) {
+    return;
+  }
+
+  struct input_event events[3];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+
+  pictrl_uinput_frame_append(&frame, EV_ABS, ABS_X, pos.x);
+  pictrl_uinput_frame_append(&frame, EV_ABS, ABS_Y, pos.y);
+  pictrl_uinput_frame_syn(&frame);
+  uinput->pointer_on_tablet = true;
+
+  if (!flush_frame(uinput, PICTRL_JOURNAL_TABLET, &frame)) {
+    pictrl_log_error("Could not move mouse: %s\n", strerror(errno));
+  }
+}
+
+// Whole notches in `*remainder + amount`, leaving what's left over in
+// `*remainder` (rounds towards 0, so it works both ways)
+static int take_notches(int *remainder, int amount) {
+  *remainder += amount;
+  const int notches = *remainder / PICTRL_SCROLL_UNITS_PER_NOTCH;
+  *remainder -= notches * PICTRL_SCROLL_UNITS_PER_NOTCH;
+  return notches;
+}
+
+/*
+Scrolls by `scroll` (in 1/120ths of a notch) in a single report. Apps that
+understand high resolution scrolling (most of them, these days) get the
+REL_*_HI_RES events, and everything else gets the legacy REL_WHEEL/REL_HWHEEL
+ones, which only move once the high resolution ones add up to a whole notch,
+same as a real high resolution mouse.
+*/
+void picontrol_uinput_scroll(pictrl_uinput_t *uinput,
+                             PiCtrlMouseScroll scroll) {
+  struct input_event events[5];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+
+  if (scroll.vertical != 0) {
+    pictrl_uinput_frame_append(&frame, EV_REL, REL_WHEEL_HI_RES,
+                               scroll.vertical);
+    const int notches =
+        take_notches(&uinput->wheel_remainder.vertical, scroll.vertical);
+    if (notches != 0) {
+      pictrl_uinput_frame_append(&frame, EV_REL, REL_WHEEL, notches);
+    }
+  }
+  if (scroll.horizontal != 0) {
+    pictrl_uinput_frame_append(&frame, EV_REL, REL_HWHEEL_HI_RES,
+                               scroll.horizontal);
+    const int notches =
+        take_notches(&uinput->wheel_remainder.horizontal, scroll.horizontal);
+    if (notches != 0) {
+      pictrl_uinput_frame_append(&frame, EV_REL, REL_HWHEEL, notches);
+    }
+  }
+  if (frame.num_events == 0) {
+    return;
+  }
+  pictrl_uinput_frame_syn(&frame);
+
+  if (!emit_frame(uinput, &frame)) {
+    pictrl_log_error("Could not scroll: %s\n", strerror(errno));
+  }
+}
 
+static void append_combo(pictrl_uinput_frame *frame,
+                         const pictrl_key_combo *combo) {
   // Key down
-  for (size_t i = 0; i < pictrl_ascii_to_event_codes[(size_t)c].num_keys; i++) {
-    ret &= picontrol_emit(&ie, uinput->fd, EV_KEY,
-                          pictrl_ascii_to_event_codes[(size_t)c].keys[i],
-                          PICTRL_KEY_DOWN, &cur_time) == ie_sz;
-    cur_time.tv_usec += PICTRL_KEY_DELAY_USEC;
-  }
-  ret &= picontrol_emit(&ie, uinput->fd, EV_SYN, SYN_REPORT, 0, &cur_time) ==
-         ie_sz;
-  if (!ret) {
-    return false;
+  for (size_t i = 0; i < combo->num_keys; i++) {
+    pictrl_uinput_frame_append(frame, EV_KEY, combo->keys[i], PICTRL_KEY_DOWN);
   }
+  pictrl_uinput_frame_syn(frame);
 
   // Key up
-  for (size_t i = 0; i < pictrl_ascii_to_event_codes[(size_t)c].num_keys; i++) {
-    ret &= picontrol_emit(&ie, uinput->fd, EV_KEY,
-                          pictrl_ascii_to_event_codes[(size_t)c].keys[i],
-                          PICTRL_KEY_UP, &cur_time) == ie_sz;
-    cur_time.tv_usec += PICTRL_KEY_DELAY_USEC;
+  for (size_t i = 0; i < combo->num_keys; i++) {
+    pictrl_uinput_frame_append(frame, EV_KEY, combo->keys[i], PICTRL_KEY_UP);
+  }
+  pictrl_uinput_frame_syn(frame);
+}
+
+bool picontrol_uinput_type_char(pictrl_uinput_t *uinput, char c) {
+  struct input_event events[PICTRL_UINPUT_CHAR_MAX_EVENTS];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+
+  append_combo(&frame, &pictrl_ascii_to_event_codes[(size_t)c]);
+  return queue_frame(uinput, &frame);
+}
+
+// Leaves out what the text was, it could well be a password
+static void log_text_dropped(size_t len, size_t chars_typed) {
+  pictrl_log_error("Could not type text: %s. Only typing the first %zu "
+                   "characters of %zu bytes\n",
+                   strerror(errno), chars_typed, len);
+}
+
+/*
+Types `len` bytes of UTF-8 text. Every character's key events go into one array
+that's handed to the pacer in one go, which then releases it to the device as
+fast as PICTRL_KEY_REPORT_INTERVAL_USEC allows (see
+`picontrol_uinput_service()`) without ever blocking here.
+
+We can only type what's in `pictrl_ascii_to_event_codes`, anything else (i.e.
+non-ASCII characters) is skipped with a warning. Returns the number of
+characters queued to be typed: if the pacer runs out of room, whatever didn't
+fit is dropped (and logged), so the text comes out cut short rather than with
+characters missing from the middle.
+*/
+size_t picontrol_uinput_type_text(pictrl_uinput_t *uinput, const uint8_t *text,
+                                  size_t len) {
+  // Big enough for a max size PI_CTRL_TEXT payload in a single pass. Longer
+  // strings (i.e. `picontrol_uinput_print_str()`) get queued as they go
+  struct input_event events[UINT8_MAX * PICTRL_UINPUT_CHAR_MAX_EVENTS];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+
+  size_t chars_typed = 0;
+  size_t chars_pending = 0;  // Appended, but not queued yet
+  size_t offset = 0;
+  while (offset < len) {
+    uint32_t code_point;
+    offset += pictrl_utf8_decode(text + offset, len - offset, &code_point);
+
+    if (code_point >= PICTRL_SIZE(pictrl_ascii_to_event_codes) ||
+        pictrl_ascii_to_event_codes[code_point].num_keys == 0) {
+      pictrl_log_warn("Can't type U+%04X, skipping\n", code_point);
+      continue;
+    }
+
+    if (pictrl_uinput_frame_space(&frame) < PICTRL_UINPUT_CHAR_MAX_EVENTS) {
+      if (!queue_frame(uinput, &frame)) {
+        log_text_dropped(len, chars_typed);
+        return chars_typed;
+      }
+      chars_typed += chars_pending;
+      chars_pending = 0;
+    }
+    append_combo(&frame, &pictrl_ascii_to_event_codes[code_point]);
+    chars_pending++;
   }
-  ret &= picontrol_emit(&ie, uinput->fd, EV_SYN, SYN_REPORT, 0, &cur_time) ==
-         ie_sz;
 
-  return ret;
+  if (!queue_frame(uinput, &frame)) {
+    log_text_dropped(len, chars_typed);
+    return chars_typed;
+  }
+  return chars_typed + chars_pending;
 }
 
-void picontrol_uinput_type_keysym(pictrl_uinput_t *uinput, char *keysym) {
-  pictrl_log_stub("FIGURE OUT HOW TO TYPE KEYSYMS\n");
+_Static_assert(PICTRL_KEYSYM_CACHE_MAX_EVENTS >= PICTRL_UINPUT_FRAME_MAX_EVENTS,
+               "Keysym cache entries can't hold a whole combo");
+
+/*
+Presses and releases a `len` byte keysym combo like "ctrl+alt+Delete" (see
+`pictrl_keysym_parse_combo()`) as a single frame: every key down in one report,
+then every key up in the next.
+
+Clients send the same few shortcuts over and over, so the resulting events get
+cached by the raw payload, and a repeat goes straight out without parsing.
+uinput ignores the timestamps we write, so cached events are as good as new.
+*/
+bool picontrol_uinput_type_keysym(pictrl_uinput_t *uinput, const char *keysym,
+                                  size_t len) {
+  pictrl_uinput_frame frame;
+  const pictrl_keysym_cache_entry *cached = pictrl_keysym_cache_get(
+      &uinput->keysym_cache, (const uint8_t *)keysym, len);
+  struct input_event events[PICTRL_UINPUT_FRAME_MAX_EVENTS];
+  if (cached != NULL) {
+    pictrl_uinput_frame_init(&frame, (struct input_event *)cached->events,
+                             cached->num_events);
+    frame.num_events = cached->num_events;
+  } else {
+    pictrl_key_combo combo;
+    if (!pictrl_keysym_parse_combo(keysym, len, &combo)) {
+      return false;
+    }
+
+    pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+    append_combo(&frame, &combo);
+    pictrl_keysym_cache_put(&uinput->keysym_cache, (const uint8_t *)keysym,
+                            len, frame.events, frame.num_events);
+  }
+
+  // Flushing only reads the events, so it's fine to hand it the cached ones
+  if (!emit_frame(uinput, &frame)) {
+    pictrl_log_error("Could not type keysym: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
 }
 
 int picontrol_create_virtual_keyboard() {
@@ -313,9 +779,13 @@ int picontrol_create_virtual_keyboard() {
                       buttons[i]);
   }
 
-  // Enable mousewheel
-  IOCTL_AND_LOG_ERR("Could not enable mousewheel: %s\n", fd, UI_SET_RELBIT,
-                    REL_WHEEL);
+  // Enable mousewheel, both legacy (whole notches) and high resolution
+  const int wheels[] = {REL_WHEEL, REL_HWHEEL, REL_WHEEL_HI_RES,
+                        REL_HWHEEL_HI_RES};
+  for (size_t i = 0; i < PICTRL_SIZE(wheels); i++) {
+    IOCTL_AND_LOG_ERR("Could not enable mousewheel: %s\n", fd, UI_SET_RELBIT,
+                      wheels[i]);
+  }
 
   // Enable mouse movement
   IOCTL_AND_LOG_ERR("Could not enable mouse: %s\n", fd, UI_SET_EVBIT, EV_REL);
@@ -331,7 +801,7 @@ int picontrol_create_virtual_keyboard() {
               .vendor = 0x1337,
               .product = 0x0420,
           },
-      .name = "PiControl Virtual Keyboard"};
+      .name = PICTRL_UINPUT_KEYBOARD_NAME};
   // Set up and create device
   IOCTL_AND_LOG_ERR("Could not set up virtual keyboard: %s\n", fd, UI_DEV_SETUP,
                     &usetup);
@@ -340,6 +810,60 @@ int picontrol_create_virtual_keyboard() {
   return fd;
 }
 
+/*
+An absolute pointing device, like the tablet VMs give their guests: the client
+says where on the screen the pointer should be (i.e. where the finger is on the
+phone's touchpad) instead of how far to move it, so there's nothing to clamp or
+round, and nothing drifts if a message gets merged or lost.
+
+It needs buttons to count as a pointer (rather than a joystick), and uses them
+for clicks that follow an absolute move.
+
+Destroy it with `picontrol_destroy_virtual_keyboard()`, like the keyboard.
+*/
+int picontrol_create_virtual_tablet() {
+  int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+  if (fd < 0) {
+    pictrl_log_error("Could not open /dev/uinput: %s\n", strerror(errno));
+    return -1;
+  }
+
+  IOCTL_AND_LOG_ERR("Could not enable key events: %s\n", fd, UI_SET_EVBIT,
+                    EV_KEY);
+  IOCTL_AND_LOG_ERR("Could not enable left click: %s\n", fd, UI_SET_KEYBIT,
+                    BTN_LEFT);
+  IOCTL_AND_LOG_ERR("Could not enable right click: %s\n", fd, UI_SET_KEYBIT,
+                    BTN_RIGHT);
+
+  IOCTL_AND_LOG_ERR("Could not enable absolute position: %s\n", fd,
+                    UI_SET_EVBIT, EV_ABS);
+  const int axes[] = {ABS_X, ABS_Y};
+  for (size_t i = 0; i < PICTRL_SIZE(axes); i++) {
+    const struct uinput_abs_setup abs_setup = {
+        .code = axes[i],
+        .absinfo = {.minimum = 0, .maximum = PICTRL_MOUSE_ABS_MAX}};
+    IOCTL_AND_LOG_ERR("Could not set up absolute axis: %s\n", fd,
+                      UI_ABS_SETUP, &abs_setup);
+  }
+
+  static const struct uinput_setup usetup = {
+      .id =
+          {
+              .bustype = BUS_USB,
+              .vendor = 0x1337,
+              .product = 0x0421,
+          },
+      .name = PICTRL_UINPUT_TABLET_NAME};
+  IOCTL_AND_LOG_ERR("Could not set up virtual tablet: %s\n", fd, UI_DEV_SETUP,
+                    &usetup);
+  if (ioctl(fd, UI_DEV_CREATE) < 0) {
+    pictrl_log_error("Could not create virtual tablet: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
 int picontrol_destroy_virtual_keyboard(int fd) {
   int destroy_ret = ioctl(fd, UI_DEV_DESTROY);
   if (destroy_ret < 0) {
@@ -355,15 +879,85 @@ int picontrol_destroy_virtual_keyboard(int fd) {
   return (destroy_ret >= 0 && close_ret == 0) ? 0 : -1;
 }
 
+// Blocks until the whole string has been typed (see `picontrol_uinput_drain()`)
 size_t picontrol_uinput_print_str(pictrl_uinput_t *uinput, const char *str) {
-  char *p = (char *)str;
+  const uint8_t *text = (const uint8_t *)str;
+  const size_t len = strlen(str);
   size_t chars_written = 0;
-  while (*p) {
-    size_t written = picontrol_uinput_type_char(uinput, *p++) ? 1 : 0;
-    chars_written += written;
-    if (written == 0) {
-      break;
+
+  // Go a payload's worth at a time so the key queue can't overflow, without
+  // splitting a UTF-8 sequence in half
+  size_t offset = 0;
+  while (offset < len) {
+    size_t chunk_len = (len - offset < UINT8_MAX) ? len - offset : UINT8_MAX;
+    while (offset + chunk_len < len &&
+           (text[offset + chunk_len] & 0xC0) == 0x80) {
+      chunk_len--;
     }
+
+    chars_written +=
+        picontrol_uinput_type_text(uinput, text + offset, chunk_len);
+    picontrol_uinput_drain(uinput);
+    offset += chunk_len;
   }
   return chars_written;
 }
+
+// pictrl_backend_ops
+static void *uinput_new() {
+  pictrl_uinput_t *uinput = pictrl_uinput_backend_new();
+  if (uinput == NULL) {
+    return NULL;
+  }
+  if (pictrl_uinput_backend_init(uinput) < 0) {
+    pictrl_uinput_backend_free(uinput);
+    return NULL;
+  }
+  return uinput;
+}
+
+static void uinput_free(void *impl) {
+  pictrl_uinput_backend_destroy(impl);
+  pictrl_uinput_backend_free(impl);
+}
+
+static void uinput_move_mouse_rel(void *impl, PiCtrlMouseCoord coords) {
+  picontrol_uinput_move_mouse_rel(impl, coords);
+}
+
+static void uinput_move_mouse_abs(void *impl, PiCtrlMouseAbs pos) {
+  picontrol_uinput_move_mouse_abs(impl, pos);
+}
+
+static void uinput_scroll(void *impl, PiCtrlMouseScroll scroll) {
+  picontrol_uinput_scroll(impl, scroll);
+}
+
+static void uinput_click_mouse(void *impl, PiCtrlMouseBtnStatus status) {
+  picontrol_uinput_click_mouse(impl, status);
+}
+
+static void uinput_type_text(void *impl, const uint8_t *text, size_t len) {
+  picontrol_uinput_type_text(impl, text, len);
+}
+
+static void uinput_type_keysym(void *impl, const char *keysym, size_t len) {
+  picontrol_uinput_type_keysym(impl, keysym, len);
+}
+
+static int64_t uinput_service(void *impl) {
+  return picontrol_uinput_service(impl);
+}
+
+const pictrl_backend_ops pictrl_uinput_backend_ops = {
+    .name = "uinput",
+    .new = &uinput_new,
+    .free = &uinput_free,
+    .move_mouse_rel = &uinput_move_mouse_rel,
+    .move_mouse_abs = &uinput_move_mouse_abs,
+    .scroll = &uinput_scroll,
+    .click_mouse = &uinput_click_mouse,
+    .type_text = &uinput_type_text,
+    .type_keysym = &uinput_type_keysym,
+    .service = &uinput_service,
+};
@@ -4,13 +4,23 @@
 #include <linux/uinput.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <unistd.h>
 
+#include "backend/picontrol_backend_ops.h"
+#include "backend/picontrol_journal.h"
+#include "backend/picontrol_key_pacer.h"
+#include "backend/picontrol_keysym_cache.h"
 #include "model/mouse.h"
 #include "model/protocol.h"
 #include "picontrol_config.h"
 
+// What the virtual devices are called (i.e. in evtest, or EVIOCGNAME)
+#define PICTRL_UINPUT_KEYBOARD_NAME "PiControl Virtual Keyboard"
+#define PICTRL_UINPUT_TABLET_NAME "PiControl Virtual Tablet"
+
 #define PICTRL_NOOP_KEY_COMB() \
   {                            \
     .num_keys = 0, .keys = {}  \
@@ -24,7 +34,25 @@
     }                                                                   \
   }
 
-#define PICTRL_KEY_DELAY_USEC 200000  // 200ms
+// Events needed for a single typed character or key combo: every key down, a
+// SYN_REPORT, every key up, and another SYN_REPORT
+#define PICTRL_UINPUT_COMBO_EVENTS(num_keys) (2 * (num_keys) + 2)
+
+// Room for any single report we build (a key combo being the biggest)
+#define PICTRL_UINPUT_FRAME_MAX_EVENTS \
+  PICTRL_UINPUT_COMBO_EVENTS(PICTRL_MAX_SIMUL_KEYS)
+
+// Every printable ASCII character takes at most 2 keys (i.e. shift + key)
+#define PICTRL_UINPUT_CHAR_MAX_EVENTS PICTRL_UINPUT_COMBO_EVENTS(2)
+
+/*
+Most events handed to the kernel in one write(). evdev gives each reader of the
+device a buffer of only ~128 events for a device like ours, and anything past
+that is dropped (SYN_DROPPED) if the reader (i.e. the compositor) hasn't caught
+up. Flushes are cut into bursts of at most this many, ending on a report
+boundary.
+*/
+#define PICTRL_UINPUT_MAX_BURST_EVENTS 64
 
 typedef struct {
   // INCLUSIVE ranges (both ends)
@@ -51,21 +79,107 @@ static inline ssize_t picontrol_emit(struct input_event *ie, int fd, int type,
   return write(fd, ie, sizeof(*ie));
 }
 
+/*
+A batch of events that gets written to the device in one go. Build a report
+with `pictrl_uinput_frame_append()` (ending in `pictrl_uinput_frame_syn()`),
+then hand the whole thing to the kernel with `pictrl_uinput_frame_flush()`,
+which costs a single write() instead of one per event (or one per
+PICTRL_UINPUT_MAX_BURST_EVENTS for big frames).
+
+The events themselves are meant to live on the stack, i.e.
+
+  struct input_event events[PICTRL_UINPUT_FRAME_MAX_EVENTS];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+  pictrl_uinput_frame_append(&frame, EV_REL, REL_X, 5);
+  pictrl_uinput_frame_syn(&frame);
+  pictrl_uinput_frame_flush(fd, &frame);
+*/
+typedef struct {
+  size_t num_events;
+  size_t num_written;  // Events the device already accepted (partial flush)
+  size_t capacity;
+  struct timeval time;
+  struct input_event *events;
+} pictrl_uinput_frame;
+
+static inline void pictrl_uinput_frame_init(pictrl_uinput_frame *frame,
+                                            struct input_event *events,
+                                            size_t capacity) {
+  frame->num_events = 0;
+  frame->num_written = 0;
+  frame->capacity = capacity;
+  frame->events = events;
+  gettimeofday(&frame->time, NULL);
+}
+
+static inline size_t pictrl_uinput_frame_space(
+    const pictrl_uinput_frame *frame) {
+  return frame->capacity - frame->num_events;
+}
+
+static inline bool pictrl_uinput_frame_full(const pictrl_uinput_frame *frame) {
+  return pictrl_uinput_frame_space(frame) == 0;
+}
+
+// Returns false (and appends nothing) if the frame is already full
+static inline bool pictrl_uinput_frame_append(pictrl_uinput_frame *frame,
+                                              int type, int code, int value) {
+  if (pictrl_uinput_frame_full(frame)) {
+    return false;
+  }
+
+  struct input_event *ie = &frame->events[frame->num_events++];
+  ie->time = frame->time;
+  ie->type = type;
+  ie->code = code;
+  ie->value = value;
+  return true;
+}
+
+static inline bool pictrl_uinput_frame_syn(pictrl_uinput_frame *frame) {
+  return pictrl_uinput_frame_append(frame, EV_SYN, SYN_REPORT, 0);
+}
+
+ssize_t pictrl_uinput_frame_flush(int fd, pictrl_uinput_frame *frame);
+
 typedef struct {
   int fd;
+  int tablet_fd;  // -1 if there's no tablet (see PICTRL_ABS_POINTER)
+  pictrl_key_pacer pacer;  // Output waiting to be released (see `_service()`)
+  pictrl_keysym_cache keysym_cache;
+  PiCtrlMouseScroll wheel_remainder;  // Not a whole notch yet (legacy wheel)
+  // Whether the pointer was last put somewhere by the tablet, in which case
+  // that's where clicks go (see `picontrol_uinput_click_mouse()`)
+  bool pointer_on_tablet;
+  uint8_t tablet_buttons;  // Held down on the tablet, 1 << PiCtrlMouseBtn
+  pictrl_journal *journal;  // Not NULL: record here instead of the devices
 } pictrl_uinput_t;
 
 pictrl_uinput_t *pictrl_uinput_backend_new();
 int picontrol_create_virtual_keyboard();
 int picontrol_destroy_virtual_keyboard(int fd);
+int picontrol_create_virtual_tablet();
 bool picontrol_uinput_type_char(pictrl_uinput_t *uinput, char c);
+size_t picontrol_uinput_type_text(pictrl_uinput_t *uinput, const uint8_t *text,
+                                  size_t len);
 size_t picontrol_uinput_print_str(pictrl_uinput_t *uinput, const char *str);
 void picontrol_uinput_click_mouse(pictrl_uinput_t *uinput,
                                   PiCtrlMouseBtnStatus status);
 void picontrol_uinput_move_mouse_rel(pictrl_uinput_t *uinput,
                                      PiCtrlMouseCoord coords);
-void picontrol_uinput_type_keysym(pictrl_uinput_t *uinput, char *keysym);
+void picontrol_uinput_scroll(pictrl_uinput_t *uinput, PiCtrlMouseScroll scroll);
+void picontrol_uinput_move_mouse_abs(pictrl_uinput_t *uinput,
+                                     PiCtrlMouseAbs pos);
+bool picontrol_uinput_type_keysym(pictrl_uinput_t *uinput, const char *keysym,
+                                  size_t len);
+int64_t picontrol_uinput_service(pictrl_uinput_t *uinput);
+void picontrol_uinput_drain(pictrl_uinput_t *uinput);
 int pictrl_uinput_backend_init(pictrl_uinput_t *uinput);
+int pictrl_uinput_backend_init_journal(pictrl_uinput_t *uinput,
+                                       pictrl_journal *journal);
 int pictrl_uinput_backend_destroy(pictrl_uinput_t *uinput);
 void pictrl_uinput_backend_free(pictrl_uinput_t *uinput);
+
+extern const pictrl_backend_ops pictrl_uinput_backend_ops;
 #endif
@@ -1,11 +1,77 @@
 #include "backend/picontrol_xdo.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <xdo.h>
 
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+
 xdo_t *pictrl_xdo_backend_new() {
   const char *display = getenv("DISPLAY");
   return xdo_new(display);
 }
 
 void pictrl_xdo_backend_free(xdo_t *xdo) { xdo_free(xdo); }
+
+// pictrl_backend_ops
+static void *xdo_backend_new() { return pictrl_xdo_backend_new(); }
+
+static void xdo_backend_free(void *impl) { pictrl_xdo_backend_free(impl); }
+
+static void xdo_backend_move_mouse_rel(void *impl, PiCtrlMouseCoord coords) {
+  pictrl_log_debug("Moving mouse (%d, %d) relative units using xdo.\n\n",
+                   coords.x, coords.y);
+  if (xdo_move_mouse_relative(impl, coords.x, coords.y) != 0) {
+    pictrl_log_warn("Mouse was unable to be moved (%d, %d) relative units.\n",
+                    coords.x, coords.y);
+  }
+}
+
+static void xdo_backend_move_mouse_abs(void *impl, PiCtrlMouseAbs pos) {
+  unsigned int width, height;
+  if (xdo_get_viewport_dimensions(impl, &width, &height, 0) != 0) {
+    pictrl_log_warn("Could not get screen size to move the mouse to\n");
+    return;
+  }
+  const int x = (int)((uint64_t)pos.x * (width - 1) / PICTRL_MOUSE_ABS_MAX);
+  const int y = (int)((uint64_t)pos.y * (height - 1) / PICTRL_MOUSE_ABS_MAX);
+  if (xdo_move_mouse(impl, x, y, 0) != 0) {
+    pictrl_log_warn("Mouse was unable to be moved to (%d, %d).\n", x, y);
+  }
+}
+
+static void xdo_backend_type_text(void *impl, const uint8_t *text,
+                                  size_t len) {
+  // `xdo_enter_text_window` expects a null-terminated string, there are more
+  // efficient approaches but this works
+  static char str[MAX_BUF];
+  memcpy(str, text, len);
+  str[len] = 0;
+
+  xdo_enter_text_window(
+      impl, CURRENTWINDOW, str,
+      XDO_KEYSTROKE_DELAY);  // TODO: what if sizeof(char) != sizeof(uint8_t)?
+}
+
+static void xdo_backend_type_keysym(void *impl, const char *keysym,
+                                    size_t len) {
+  // `xdo_send_keysequence_window` expects a null-terminated string, there are
+  // more efficient approaches but this works
+  static char str[MAX_BUF];
+  memcpy(str, keysym, len);
+  str[len] = 0;
+
+  xdo_send_keysequence_window(impl, CURRENTWINDOW, str, XDO_KEYSTROKE_DELAY);
+}
+
+// TODO: Clicking and scrolling
+const pictrl_backend_ops pictrl_xdo_backend_ops = {
+    .name = "xdo",
+    .new = &xdo_backend_new,
+    .free = &xdo_backend_free,
+    .move_mouse_rel = &xdo_backend_move_mouse_rel,
+    .move_mouse_abs = &xdo_backend_move_mouse_abs,
+    .type_text = &xdo_backend_type_text,
+    .type_keysym = &xdo_backend_type_keysym,
+};
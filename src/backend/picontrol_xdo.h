@@ -3,7 +3,7 @@
 
 #include <xdo.h>
 
-#include "backend/picontrol_backend.h"
+#include "backend/picontrol_backend_ops.h"
 
 // Delay between xdo keystrokes in microseconds
 #define XDO_KEYSTROKE_DELAY (useconds_t)10000
@@ -11,4 +11,6 @@
 xdo_t *pictrl_xdo_backend_new();
 void pictrl_xdo_backend_free(xdo_t *backend);
 
+extern const pictrl_backend_ops pictrl_xdo_backend_ops;
+
 #endif
@@ -0,0 +1,106 @@
+#include "data_structures/histogram.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+void pictrl_histogram_init(pictrl_histogram *hist) {
+  memset(hist, 0, sizeof(*hist));
+  hist->min = UINT64_MAX;
+}
+
+/*
+Values below PICTRL_HISTOGRAM_SUB_BUCKETS get a bucket each. Past that, a value
+whose highest set bit is `msb` is shifted down until only its top
+PICTRL_HISTOGRAM_SUB_BITS + 1 bits are left, and those pick the bucket within
+that power of 2. Buckets line up end to end, so the index only ever grows with
+the value.
+*/
+static size_t bucket_index(uint64_t value) {
+  if (value < PICTRL_HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  if (value >> PICTRL_HISTOGRAM_MAX_BITS) {
+    return PICTRL_HISTOGRAM_BUCKETS - 1;
+  }
+
+  const int msb = 63 - __builtin_clzll(value);
+  const int shift = msb - PICTRL_HISTOGRAM_SUB_BITS;
+  const size_t top = value >> shift;  // [SUB_BUCKETS, 2 * SUB_BUCKETS)
+  return (shift + 1) * PICTRL_HISTOGRAM_SUB_BUCKETS +
+         (top - PICTRL_HISTOGRAM_SUB_BUCKETS);
+}
+
+// Highest value that lands in bucket `index`
+static uint64_t bucket_high(size_t index) {
+  if (index == PICTRL_HISTOGRAM_BUCKETS - 1) {
+    return UINT64_MAX;  // Everything too big for the rest
+  }
+  if (index < 2 * PICTRL_HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+  const int shift = index / PICTRL_HISTOGRAM_SUB_BUCKETS - 1;
+  const uint64_t top =
+      index % PICTRL_HISTOGRAM_SUB_BUCKETS + PICTRL_HISTOGRAM_SUB_BUCKETS;
+  return ((top + 1) << shift) - 1;
+}
+
+void pictrl_histogram_record(pictrl_histogram *hist, uint64_t value) {
+  hist->counts[bucket_index(value)]++;
+  hist->total++;
+  hist->sum += value;
+  if (value < hist->min) {
+    hist->min = value;
+  }
+  if (value > hist->max) {
+    hist->max = value;
+  }
+}
+
+void pictrl_histogram_merge(pictrl_histogram *dst,
+                            const pictrl_histogram *src) {
+  for (size_t i = 0; i < PICTRL_HISTOGRAM_BUCKETS; i++) {
+    dst->counts[i] += src->counts[i];
+  }
+  dst->total += src->total;
+  dst->sum += src->sum;
+  if (src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+}
+
+/*
+Smallest value that at least `percentile`% (0-100) of the samples are at or
+below, to within a bucket (rounded up, but never past the largest sample).
+Returns 0 if nothing has been recorded.
+*/
+uint64_t pictrl_histogram_percentile(const pictrl_histogram *hist,
+                                     double percentile) {
+  if (hist->total == 0) {
+    return 0;
+  }
+
+  const double exact_rank = percentile / 100 * hist->total;
+  uint64_t rank = (uint64_t)exact_rank;
+  if (rank < exact_rank) {
+    rank++;  // Round up
+  }
+  if (rank == 0) {
+    rank = 1;
+  } else if (rank > hist->total) {
+    rank = hist->total;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < PICTRL_HISTOGRAM_BUCKETS; i++) {
+    seen += hist->counts[i];
+    if (seen >= rank) {
+      const uint64_t high = bucket_high(i);
+      return (high < hist->max) ? high : hist->max;
+    }
+  }
+  return hist->max;
+}
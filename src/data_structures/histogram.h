@@ -0,0 +1,45 @@
+#ifndef _PICTRL_HISTOGRAM_H
+#define _PICTRL_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Each power of 2 is split into 2^PICTRL_HISTOGRAM_SUB_BITS buckets, so any
+// recorded value is off by at most ~3%
+#define PICTRL_HISTOGRAM_SUB_BITS 5
+#define PICTRL_HISTOGRAM_SUB_BUCKETS (1 << PICTRL_HISTOGRAM_SUB_BITS)
+
+// Values from 2^PICTRL_HISTOGRAM_MAX_BITS up all land in the last bucket
+#define PICTRL_HISTOGRAM_MAX_BITS 40
+#define PICTRL_HISTOGRAM_BUCKETS                                   \
+  ((PICTRL_HISTOGRAM_MAX_BITS - PICTRL_HISTOGRAM_SUB_BITS + 1) * \
+   PICTRL_HISTOGRAM_SUB_BUCKETS)
+
+/*
+Log-linear histogram of (i.e. latency) samples, for percentiles without keeping
+every sample around. Values below PICTRL_HISTOGRAM_SUB_BUCKETS are exact, and
+everything above is bucketed with constant relative precision, the same way
+HdrHistogram does it.
+
+Fixed size and allocation free, so recording is cheap enough for a hot path.
+The unit is up to whoever records into it.
+*/
+typedef struct {
+  uint64_t counts[PICTRL_HISTOGRAM_BUCKETS];
+  uint64_t total;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+} pictrl_histogram;
+
+// Prototypes
+void pictrl_histogram_init(pictrl_histogram *hist);
+void pictrl_histogram_record(pictrl_histogram *hist, uint64_t value);
+void pictrl_histogram_merge(pictrl_histogram *dst, const pictrl_histogram *src);
+uint64_t pictrl_histogram_percentile(const pictrl_histogram *hist,
+                                     double percentile);
+
+// Static "methods"
+static inline uint64_t pictrl_histogram_mean(const pictrl_histogram *hist) {
+  return (hist->total == 0) ? 0 : hist->sum / hist->total;
+}
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // memfd_create()
 #include "data_structures/ring_buffer.h"
 
 #include <errno.h>
@@ -5,6 +6,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "logging/log_utils.h"
@@ -22,37 +25,148 @@ pictrl_rb_t *pictrl_rb_init(pictrl_rb_t *rb, size_t capacity) {
   rb->capacity = capacity;
   rb->data_start = 0;
   rb->num_items = 0;
+  rb->mask = 0;
+  rb->head = 0;
+  rb->tail = 0;
+  rb->mirrored = false;
 
   return rb;
 }
 
+/*
+Like `pictrl_rb_init()`, but `capacity` has to be a power of 2 (and at least 2),
+which lets every index be a mask instead of a modulo. Returns NULL if it isn't.
+
+Code that pokes at `data_start`/`num_items` directly won't work with these, use
+`pictrl_rb_start()`/`pictrl_rb_size()` instead.
+*/
+pictrl_rb_t *pictrl_rb_init_pow2(pictrl_rb_t *rb, size_t capacity) {
+  if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+    return NULL;
+  }
+  if (pictrl_rb_init(rb, capacity) == NULL) {
+    return NULL;
+  }
+  rb->mask = capacity - 1;
+  return rb;
+}
+
+/*
+Like `pictrl_rb_init_pow2()`, but the buffer is a memfd mapped twice back to
+back, so any `pictrl_rb_size()` bytes from `pictrl_rb_data_start_address()` (or
+free bytes after the data) are contiguous. Whatever parses the data can look
+straight at it, wrapped or not, and copies in and out are a single memcpy() (or
+iovec).
+
+`capacity` has to be a power of 2 and a multiple of the page size. Returns NULL
+if it isn't, or if the mappings fail (with errno set).
+*/
+pictrl_rb_t *pictrl_rb_init_mirrored(pictrl_rb_t *rb, size_t capacity) {
+  const long page_size = sysconf(_SC_PAGESIZE);
+  if (capacity < 2 || (capacity & (capacity - 1)) != 0 || page_size <= 0 ||
+      capacity % (size_t)page_size != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  const int fd = memfd_create("pictrl_rb", MFD_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, (off_t)capacity) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  // Reserve room for both copies first, so nothing else can end up in between
+  uint8_t *buf = mmap(NULL, 2 * capacity, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  for (size_t copy = 0; copy < 2; copy++) {
+    if (mmap(buf + copy * capacity, capacity, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      const int mmap_errno = errno;
+      munmap(buf, 2 * capacity);
+      close(fd);
+      errno = mmap_errno;
+      return NULL;
+    }
+  }
+  close(fd);  // The mappings keep it alive
+
+  rb->buffer = buf;
+  rb->capacity = capacity;
+  rb->data_start = 0;
+  rb->num_items = 0;
+  rb->mask = capacity - 1;
+  rb->head = 0;
+  rb->tail = 0;
+  rb->mirrored = true;
+  return rb;
+}
+
 void pictrl_rb_destroy(pictrl_rb_t *rb) {
   if (rb == NULL) {
     return;
   }
-  free(rb->buffer);
+  if (rb->mirrored) {
+    munmap(rb->buffer, 2 * rb->capacity);
+  } else {
+    free(rb->buffer);
+  }
 
   rb->buffer = NULL;
   rb->capacity = 0;
   rb->data_start = 0;
   rb->num_items = 0;
+  rb->mask = 0;
+  rb->head = 0;
+  rb->tail = 0;
+  rb->mirrored = false;
+}
+
+static inline size_t min_size(size_t a, size_t b) { return (a < b) ? a : b; }
+
+// Index of the first free byte in the buffer (the one after the data)
+static inline size_t rb_end(const pictrl_rb_t *rb) {
+  if (pictrl_rb_is_pow2(rb)) {
+    return rb->head & rb->mask;
+  }
+  return (rb->data_start + rb->num_items) % rb->capacity;
 }
 
 /*
-For all failures*, we return right after setting errno, or right after an
-unsuccessful read() call, where errno is set. Therefore, if this call fails, you
-should be able to retrieve errno afterwards.
+Points `iov` at the `num` bytes starting at index `start` in the buffer, which
+take 2 entries if they wrap around its end (never, for mirrored ring buffers).
+Returns how many entries it used.
+*/
+static int rb_iov(pictrl_rb_t *rb, size_t start, size_t num,
+                  struct iovec iov[2]) {
+  const size_t num_bytes_first_pass =
+      min_size(num, pictrl_rb_contiguous(rb, start));
+  iov[0] = (struct iovec){.iov_base = rb->buffer + start,
+                          .iov_len = num_bytes_first_pass};
+  if (num_bytes_first_pass == num) {
+    return 1;
+  }
+  iov[1] = (struct iovec){.iov_base = rb->buffer,
+                          .iov_len = num - num_bytes_first_pass};
+  return 2;
+}
 
-*When you're writing enough data that we wrap around the ring buffer's internal
-buffer, we have to do 2 separate read() calls. If the second one fails, we still
-return how many bytes we wrote from the first read(), and do not error. Since no
-data will have been written on the 2nd read(), if the error persists, you should
-see it in the next call to pictrl_rb_write() for the remaining `num -
-bytes_read` bytes.
+/*
+Reads up to `num` bytes from `fd` into the free space, in a single readv() even
+when that space wraps around the end of the buffer. Returns how many bytes it
+read, which is all the ring buffer's bookkeeping moves forward by.
 
+Fails with -1 and errno set by readv(), or with ENOBUFS if the ring buffer is
+full. Returns 0 if `num` is 0, or at EOF.
 */
 ssize_t pictrl_rb_write(int fd, size_t num, pictrl_rb_t *rb) {
-  const size_t available_bytes = rb->capacity - rb->num_items;
+  const size_t available_bytes = rb->capacity - pictrl_rb_size(rb);
   if (num == 0) {
     return 0;
   }
@@ -61,113 +175,46 @@ ssize_t pictrl_rb_write(int fd, size_t num, pictrl_rb_t *rb) {
     return -1;
   }
 
-  const size_t num_bytes_to_write =
-      (num > available_bytes)
-          ? available_bytes
-          : num;  // if not enough space, write as much as we can
-  const size_t write_offset_start =
-      (rb->data_start + rb->num_items) %
-      rb->capacity;  // next slot after data_end. offset from buffer
-  const size_t write_offset_end =
-      (write_offset_start + num_bytes_to_write - 1) %
-      rb->capacity;  // end of data that is to be written. offset from buffer
-
-  const bool wrapped = write_offset_end < write_offset_start;
-  ssize_t bytes_read = 0;
-  if (wrapped) {
-    // Write from the write offset to the end
-    const size_t num_bytes_first_pass = rb->capacity - write_offset_start;
-    const ssize_t first_pass =
-        read(fd, rb->buffer + write_offset_start, num_bytes_first_pass);
-    if (first_pass <= 0) {
-      return first_pass;
-    }
-    bytes_read += first_pass;
-
-    // Then from the beginning to write_end
-    if ((size_t)first_pass == num_bytes_first_pass) {
-      const ssize_t second_pass =
-          read(fd, rb->buffer, num_bytes_to_write - num_bytes_first_pass);
-      if (second_pass ==
-          -1) {  // If it is, what should we do? We already wrote some bytes...
-        return -1;
-      }
-      bytes_read += second_pass;
-    }
-  } else {
-    const ssize_t only_pass =
-        read(fd, rb->buffer + write_offset_start, num_bytes_to_write);
-    if (only_pass <= 0) {
-      return only_pass;
-    }
-    bytes_read += only_pass;
+  // If not enough space, write as much as we can
+  struct iovec iov[2];
+  const int iov_count = rb_iov(rb, rb_end(rb), min_size(num, available_bytes),
+                               iov);
+  const ssize_t bytes_read = readv(fd, iov, iov_count);
+  if (bytes_read <= 0) {
+    return bytes_read;
   }
 
-  rb->num_items += (size_t)bytes_read;
+  if (pictrl_rb_is_pow2(rb)) {
+    rb->head += (size_t)bytes_read;
+  } else {
+    rb->num_items += (size_t)bytes_read;
+  }
   return bytes_read;
 }
 
 /*
-For all failures*, we return right after setting errno, or right after an
-unsuccessful write() call, where errno is set. Therefore, if this call fails,
-you should be able to retrieve errno afterwards.
-
-*When you're reading enough data that we wrap around the ring buffer's internal
-buffer, we have to do 2 separate write() calls. If the second one fails, we
-still return how many bytes we read from the first write(), and do not error.
-Since no data will have been read on the 2nd write(), if the error persists, you
-should see it in the next call to pictrl_rb_read() for the remaining `num -
-bytes_written` bytes.
+Writes up to `num` bytes of data out to `fd`, in a single writev() even when the
+data wraps around the end of the buffer. With PICTRL_READ_CONSUME, whatever got
+written is then dropped from the ring buffer; PICTRL_READ_PEEK leaves it all.
 
+Fails with -1 and errno set by writev(), having consumed nothing. Returns 0 if
+`num` is 0 or the ring buffer is empty.
 */
 ssize_t pictrl_rb_read(int fd, size_t num, pictrl_rb_t *rb,
                        pictrl_read_flag flag) {
-  if (num == 0 || rb->num_items == 0) {
+  const size_t num_items = pictrl_rb_size(rb);
+  if (num == 0 || num_items == 0) {
     return 0;
   }
 
   // If not enough data, read as much as we can
-  const size_t num_bytes_to_read = (num > rb->num_items) ? rb->num_items : num;
-  const size_t data_offset_end =
-      (rb->data_start + rb->num_items - 1) % rb->capacity;
-
-  ssize_t bytes_written = 0;
-  const bool wrapped = data_offset_end < rb->data_start;
-  if (wrapped) {
-    // Write 'til the end
-    const size_t num_bytes_first_pass = rb->capacity - rb->data_start;
-    const ssize_t first_pass =
-        write(fd, pictrl_rb_data_start_address(rb), num_bytes_first_pass);
-    if (first_pass == -1) {
-      return -1;
-    }
-    bytes_written += first_pass;
-
-    // Then resume from the beginning to attempt to write the rest, if
-    // first_pass' write finished fully
-    if ((size_t)first_pass == num_bytes_first_pass) {
-      const ssize_t second_pass =
-          write(fd, rb->buffer, num - num_bytes_first_pass);
-      if (second_pass != -1) {
-        bytes_written += second_pass;
-      }
-    }
-  } else {
-    const ssize_t only_pass =
-        write(fd, pictrl_rb_data_start_address(rb), num_bytes_to_read);
-    if (only_pass == -1) {
-      return -1;
-    }
-    bytes_written += only_pass;
+  struct iovec iov[2];
+  const int iov_count = rb_iov(rb, pictrl_rb_start(rb),
+                               min_size(num, num_items), iov);
+  const ssize_t bytes_written = writev(fd, iov, iov_count);
+  if (bytes_written > 0 && flag == PICTRL_READ_CONSUME) {
+    pictrl_rb_consume(rb, (size_t)bytes_written);
   }
-
-  if (flag == PICTRL_READ_CONSUME) {
-    const size_t new_data_offset_start =
-        (rb->data_start + (size_t)bytes_written) % rb->capacity;
-    rb->num_items -= (size_t)bytes_written;
-    rb->data_start = new_data_offset_start;
-  }
-
   return bytes_written;
 }
 
@@ -175,32 +222,71 @@ void pictrl_rb_clear(pictrl_rb_t *rb) {
   memset(rb->buffer, 0, rb->capacity * sizeof(uint8_t));
   rb->num_items = 0;
   rb->data_start = 0;
+  rb->head = 0;
+  rb->tail = 0;
 }
 
 void pictrl_rb_copy(pictrl_rb_t *rb, void *dest) {
-  if (!pictrl_rb_data_wrapped(rb)) {
-    memcpy(dest, pictrl_rb_data_start_address(rb),
-           rb->num_items * sizeof(uint8_t));
-    return;
+  pictrl_rb_peek(rb, dest, pictrl_rb_size(rb));
+}
+
+// Copies out up to `num` bytes from the start of the data, without consuming
+// them. Returns how many it copied
+size_t pictrl_rb_peek(pictrl_rb_t *rb, void *dest, size_t num) {
+  const size_t start = pictrl_rb_start(rb);
+  const size_t num_bytes = min_size(num, pictrl_rb_size(rb));
+  const size_t num_bytes_first_pass =
+      min_size(num_bytes, pictrl_rb_contiguous(rb, start));
+  memcpy(dest, rb->buffer + start, num_bytes_first_pass);
+  memcpy((uint8_t *)dest + num_bytes_first_pass, rb->buffer,
+         num_bytes - num_bytes_first_pass);
+  return num_bytes;
+}
+
+// Copies up to `num` bytes from `src` to the end of the data. Returns how many
+// there was room for
+size_t pictrl_rb_append(pictrl_rb_t *rb, const void *src, size_t num) {
+  const size_t end = rb_end(rb);
+  const size_t num_bytes = min_size(num, rb->capacity - pictrl_rb_size(rb));
+  const size_t num_bytes_first_pass =
+      min_size(num_bytes, pictrl_rb_contiguous(rb, end));
+  memcpy(rb->buffer + end, src, num_bytes_first_pass);
+  memcpy(rb->buffer, (const uint8_t *)src + num_bytes_first_pass,
+         num_bytes - num_bytes_first_pass);
+
+  if (pictrl_rb_is_pow2(rb)) {
+    rb->head += num_bytes;
+  } else {
+    rb->num_items += num_bytes;
   }
+  return num_bytes;
+}
 
-  const size_t num_bytes_first_pass = rb->capacity - rb->data_start;
-  memcpy(dest, pictrl_rb_data_start_address(rb),
-         num_bytes_first_pass * sizeof(uint8_t));
-  memcpy(dest + num_bytes_first_pass, rb->buffer,
-         (rb->num_items - num_bytes_first_pass) * sizeof(uint8_t));
+// Drops up to `num` bytes from the start of the data. Returns how many it
+// dropped
+size_t pictrl_rb_consume(pictrl_rb_t *rb, size_t num) {
+  const size_t num_bytes = min_size(num, pictrl_rb_size(rb));
+  if (pictrl_rb_is_pow2(rb)) {
+    rb->tail += num_bytes;
+  } else {
+    rb->data_start = (rb->data_start + num_bytes) % rb->capacity;
+    rb->num_items -= num_bytes;
+  }
+  return num_bytes;
 }
 
-// Using `pictrl_rb_read`
+// Works in every mode, going by `pictrl_rb_start()` and `pictrl_rb_size()`
 void print_ring_buffer(pictrl_rb_t *rb) {
   pictrl_log(
       "\n------------------------------\n"
-      "Capacity:     %zu\n"
+      "Capacity:     %zu%s\n"
       "Buffer start: %p\n"
       "Data start:   %zu\n"
       "Num items:    %zu\n"
       "Buffer:       ",
-      rb->capacity, rb->buffer, rb->data_start, rb->num_items);
+      rb->capacity,
+      rb->mirrored ? " (mirrored)" : (pictrl_rb_is_pow2(rb) ? " (pow2)" : ""),
+      rb->buffer, pictrl_rb_start(rb), pictrl_rb_size(rb));
 
   print_rb_in_order(rb);
   pictrl_log("RAW buffer:   ");
@@ -208,19 +294,24 @@ void print_ring_buffer(pictrl_rb_t *rb) {
   pictrl_log("\n");
 }
 
+// Just the data, oldest first
 void print_rb_in_order(pictrl_rb_t *rb) {
-  const size_t n_first_pass = rb->capacity - rb->data_start;
+  const size_t start = pictrl_rb_start(rb);
+  const size_t size = pictrl_rb_size(rb);
+  if (size == 0) {
+    pictrl_log("[]\n");
+    return;
+  }
 
   pictrl_log("[");
-  for (size_t cur = 0; cur < n_first_pass; cur++) {
-    pictrl_log("%u, ", rb->buffer[rb->data_start + cur]);
+  for (size_t cur = 0; cur < size - 1; cur++) {
+    pictrl_log("%u, ", rb->buffer[(start + cur) % rb->capacity]);
   }
-  for (size_t cur = 0; cur < rb->data_start - 1; cur++) {
-    pictrl_log("%u, ", rb->buffer[cur]);
-  }
-  pictrl_log("%u]\n", rb->buffer[rb->data_start - 1]);
+  pictrl_log("%u]\n", rb->buffer[(start + size - 1) % rb->capacity]);
 }
-void print_raw_buf(pictrl_rb_t *rb) { print_buf(rb->buffer, rb->num_items); }
+
+// The whole internal buffer, data or not, from index 0
+void print_raw_buf(pictrl_rb_t *rb) { print_buf(rb->buffer, rb->capacity); }
 
 void print_buf(void *data, size_t n) {
   if (n == 0) {
@@ -7,12 +7,32 @@
 #include <unistd.h>
 
 // Types
+
+// Single-threaded: nothing in here is atomic or locked. Anything shared
+// between threads goes through pictrl_spsc_rb_t (see spsc_ring_buffer.h)
 typedef struct pictrl_rb_t {
   uint8_t *buffer;
   size_t capacity;
 
   size_t data_start;  // index of start of the data section
-  size_t num_items;   // TODO: make atomic?
+  size_t num_items;
+
+  /*
+  Power of 2 mode (see `pictrl_rb_init_pow2()`) keeps track of the data with
+  these instead of the 2 above: `head` and `tail` only ever go up, and get
+  wrapped into the buffer with `& mask` rather than `% capacity` (a division
+  every access, which is slow on the Pi's cores).
+  */
+  size_t mask;  // capacity - 1, or 0 for any other capacity
+  size_t head;  // Bytes ever written
+  size_t tail;  // Bytes ever consumed
+
+  /*
+  Mirrored mode (see `pictrl_rb_init_mirrored()`, always power of 2 too) maps
+  the same pages twice in a row, so `buffer[capacity + i]` is `buffer[i]` and
+  the data never wraps as far as anything reading or writing it can tell.
+  */
+  bool mirrored;
 } pictrl_rb_t;
 
 typedef enum pictrl_read_flag {
@@ -22,11 +42,16 @@ typedef enum pictrl_read_flag {
 
 // Prototypes
 pictrl_rb_t *pictrl_rb_init(pictrl_rb_t *, size_t);
+pictrl_rb_t *pictrl_rb_init_pow2(pictrl_rb_t *, size_t);
+pictrl_rb_t *pictrl_rb_init_mirrored(pictrl_rb_t *, size_t);
 void pictrl_rb_destroy(pictrl_rb_t *);
 ssize_t pictrl_rb_read(int, size_t, pictrl_rb_t *, pictrl_read_flag);
 ssize_t pictrl_rb_write(int, size_t, pictrl_rb_t *);
 void pictrl_rb_clear(pictrl_rb_t *);
 void pictrl_rb_copy(pictrl_rb_t *rb, void *dest);
+size_t pictrl_rb_peek(pictrl_rb_t *rb, void *dest, size_t num);
+size_t pictrl_rb_append(pictrl_rb_t *rb, const void *src, size_t num);
+size_t pictrl_rb_consume(pictrl_rb_t *rb, size_t num);
 
 void print_ring_buffer(pictrl_rb_t *);
 void print_rb_in_order(pictrl_rb_t *);
@@ -34,17 +59,33 @@ void print_raw_buf(pictrl_rb_t *);
 void print_buf(void *, size_t);
 
 // Static "methods"
+static inline bool pictrl_rb_is_pow2(const pictrl_rb_t *rb) {
+  return rb->mask != 0;
+}
+
+// Bytes in the ring buffer, in either mode
+static inline size_t pictrl_rb_size(const pictrl_rb_t *rb) {
+  return pictrl_rb_is_pow2(rb) ? rb->head - rb->tail : rb->num_items;
+}
+
+// Index (in the internal buffer) of the first byte, in either mode
+static inline size_t pictrl_rb_start(const pictrl_rb_t *rb) {
+  return pictrl_rb_is_pow2(rb) ? rb->tail & rb->mask : rb->data_start;
+}
+
+// Bytes you can get to in a row from `&rb->buffer[idx]`, for any index into it
+static inline size_t pictrl_rb_contiguous(const pictrl_rb_t *rb, size_t idx) {
+  return rb->mirrored ? rb->capacity : rb->capacity - idx;
+}
+
 static inline bool pictrl_rb_data_wrapped(pictrl_rb_t *rb) {
-  const size_t data_end_idx = rb->data_start + rb->num_items;
+  const size_t data_end_idx = pictrl_rb_start(rb) + pictrl_rb_size(rb);
   return data_end_idx > rb->capacity;
 }
 
 /*
  * Indices wrap around modulo rb->num_items to make sure we only have access to
  what we're allowed
- * Should probably call the read lock that isn't implemented yet before calling
- this, it's not done here because: A.) I haven't gotten around to the r/w locks
-   B.) that you can get multiple items if desired
  *
  * i.e., with the following setup, get(3) would normally return the value at
  absolute index 1 in the raw buffer, but it returns 0, since we only have 3
@@ -53,14 +94,21 @@ static inline bool pictrl_rb_data_wrapped(pictrl_rb_t *rb) {
  *  |2--01|
  *      ^
  *      |_ data_start (val == idx)
+ *
+ * In power of 2 mode, `idx` only wraps around the internal buffer (with a mask,
+ * no division), not the data, so it has to be less than the number of items
 */
 static inline uint8_t pictrl_rb_get(pictrl_rb_t *rb, size_t idx) {
+  if (pictrl_rb_is_pow2(rb)) {
+    return rb->buffer[(rb->tail + idx) & rb->mask];
+  }
   const size_t target_abs_idx =
       (rb->data_start + (idx % rb->num_items)) % rb->capacity;
   return rb->buffer[target_abs_idx];
 }
 
+// In mirrored mode, all `pictrl_rb_size()` bytes from here on are contiguous
 static inline uint8_t *pictrl_rb_data_start_address(pictrl_rb_t *rb) {
-  return &rb->buffer[rb->data_start];
+  return &rb->buffer[pictrl_rb_start(rb)];
 }
 #endif
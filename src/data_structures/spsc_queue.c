@@ -0,0 +1,80 @@
+#include "data_structures/spsc_queue.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Capacity has to be a power of 2 so indices can be masked instead of modded
+pictrl_spsc_queue_t *pictrl_spsc_init(pictrl_spsc_queue_t *q, size_t capacity,
+                                      size_t slot_size) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0 || slot_size == 0) {
+    return NULL;
+  }
+
+  uint8_t *slots = calloc(capacity, slot_size);
+  if (slots == NULL) {
+    return NULL;
+  }
+  q->slots = slots;
+  q->slot_size = slot_size;
+  q->capacity = capacity;
+  q->mask = capacity - 1;
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+
+  return q;
+}
+
+void pictrl_spsc_destroy(pictrl_spsc_queue_t *q) {
+  if (q == NULL) {
+    return;
+  }
+  free(q->slots);
+
+  q->slots = NULL;
+  q->slot_size = 0;
+  q->capacity = 0;
+  q->mask = 0;
+  atomic_store(&q->head, 0);
+  atomic_store(&q->tail, 0);
+}
+
+/*
+Returns the next free slot, or NULL if the queue is full. The slot isn't visible
+to the consumer until it's published, and claiming again before publishing hands
+back the same slot.
+*/
+void *pictrl_spsc_claim(pictrl_spsc_queue_t *q) {
+  // Only we write `tail`, so relaxed is fine. `head` has to be acquired so we
+  // don't overwrite a slot the consumer is still reading
+  const size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  const size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (tail - head == q->capacity) {
+    return NULL;
+  }
+  return q->slots + (tail & q->mask) * q->slot_size;
+}
+
+void pictrl_spsc_publish(pictrl_spsc_queue_t *q) {
+  const size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  // seq_cst rather than release, so callers can pair it with a "consumer is
+  // asleep" flag without the store getting reordered past their flag check
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_seq_cst);
+}
+
+// Returns the oldest published slot, or NULL if the queue is empty
+void *pictrl_spsc_front(pictrl_spsc_queue_t *q) {
+  const size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  const size_t tail = atomic_load_explicit(&q->tail, memory_order_seq_cst);
+  if (head == tail) {
+    return NULL;
+  }
+  return q->slots + (head & q->mask) * q->slot_size;
+}
+
+void pictrl_spsc_release(pictrl_spsc_queue_t *q) {
+  const size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,59 @@
+#ifndef _PICTRL_SPSC_QUEUE_H
+#define _PICTRL_SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"  // PICTRL_CACHE_LINE
+
+/*
+Fixed-size, lock-free single-producer/single-consumer queue of equally sized
+slots.
+
+Slots are handed out in place, so nothing gets copied in or out of the queue:
+ * Producer: `pictrl_spsc_claim()` a slot, fill it, `pictrl_spsc_publish()` it
+ * Consumer: `pictrl_spsc_front()` the oldest slot, use it,
+   `pictrl_spsc_release()` it
+
+`head` and `tail` are free-running counters (they only ever increase, and get
+masked down to a slot index), each on its own cache line so the two threads
+don't keep stealing the same line from each other.
+*/
+typedef struct pictrl_spsc_queue_t {
+  _Alignas(PICTRL_CACHE_LINE) _Atomic size_t head;  // Next slot to consume
+  _Alignas(PICTRL_CACHE_LINE) _Atomic size_t tail;  // Next slot to produce
+
+  _Alignas(PICTRL_CACHE_LINE) uint8_t *slots;
+  size_t slot_size;
+  size_t capacity;  // Power of 2
+  size_t mask;
+} pictrl_spsc_queue_t;
+
+// Prototypes
+pictrl_spsc_queue_t *pictrl_spsc_init(pictrl_spsc_queue_t *q, size_t capacity,
+                                      size_t slot_size);
+void pictrl_spsc_destroy(pictrl_spsc_queue_t *q);
+
+// Producer side
+void *pictrl_spsc_claim(pictrl_spsc_queue_t *q);
+void pictrl_spsc_publish(pictrl_spsc_queue_t *q);
+
+// Consumer side
+void *pictrl_spsc_front(pictrl_spsc_queue_t *q);
+void pictrl_spsc_release(pictrl_spsc_queue_t *q);
+
+// Static "methods"
+
+// Only a snapshot when called while the other side is running
+static inline size_t pictrl_spsc_size(pictrl_spsc_queue_t *q) {
+  const size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  const size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  return tail - head;
+}
+
+static inline bool pictrl_spsc_empty(pictrl_spsc_queue_t *q) {
+  return pictrl_spsc_size(q) == 0;
+}
+#endif
@@ -0,0 +1,101 @@
+#include "data_structures/spsc_ring_buffer.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_structures/ring_buffer.h"
+
+// Capacity has to be a power of 2 so indices can be masked instead of modded
+pictrl_spsc_rb_t *pictrl_spsc_rb_init(pictrl_spsc_rb_t *rb, size_t capacity) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    return NULL;
+  }
+
+  uint8_t *buffer = calloc(capacity, sizeof(uint8_t));
+  if (buffer == NULL) {
+    return NULL;
+  }
+  rb->buffer = buffer;
+  rb->capacity = capacity;
+  rb->mask = capacity - 1;
+  atomic_init(&rb->head, 0);
+  atomic_init(&rb->tail, 0);
+  rb->cached_head = 0;
+  rb->cached_tail = 0;
+
+  return rb;
+}
+
+void pictrl_spsc_rb_destroy(pictrl_spsc_rb_t *rb) {
+  if (rb == NULL) {
+    return;
+  }
+  free(rb->buffer);
+
+  rb->buffer = NULL;
+  rb->capacity = 0;
+  rb->mask = 0;
+  atomic_store(&rb->head, 0);
+  atomic_store(&rb->tail, 0);
+  rb->cached_head = 0;
+  rb->cached_tail = 0;
+}
+
+static inline size_t min_size(size_t a, size_t b) { return (a < b) ? a : b; }
+
+/*
+Copies as much of `src` as fits (up to `num` bytes) in, and makes it visible to
+the consumer all at once. Returns how many bytes that was, 0 if it's full.
+*/
+size_t pictrl_spsc_rb_write(pictrl_spsc_rb_t *rb, const void *src,
+                            size_t num) {
+  const size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+  if (rb->capacity - (head - rb->cached_tail) < num) {
+    // `tail` has to be acquired so we don't overwrite bytes still being read
+    rb->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+  }
+  num = min_size(num, rb->capacity - (head - rb->cached_tail));
+  if (num == 0) {
+    return 0;
+  }
+
+  const size_t start = head & rb->mask;
+  const size_t num_first_pass = min_size(num, rb->capacity - start);
+  memcpy(rb->buffer + start, src, num_first_pass);
+  memcpy(rb->buffer, (const uint8_t *)src + num_first_pass,
+         num - num_first_pass);
+
+  atomic_store_explicit(&rb->head, head + num, memory_order_release);
+  return num;
+}
+
+/*
+Copies up to `num` bytes out into `dest`, oldest first, consuming them unless
+`flag` is PICTRL_READ_PEEK. Returns how many bytes that was, 0 if it's empty.
+*/
+size_t pictrl_spsc_rb_read(pictrl_spsc_rb_t *rb, void *dest, size_t num,
+                           pictrl_read_flag flag) {
+  const size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+  if (rb->cached_head - tail < num) {
+    rb->cached_head = atomic_load_explicit(&rb->head, memory_order_acquire);
+  }
+  num = min_size(num, rb->cached_head - tail);
+  if (num == 0) {
+    return 0;
+  }
+
+  const size_t start = tail & rb->mask;
+  const size_t num_first_pass = min_size(num, rb->capacity - start);
+  memcpy(dest, rb->buffer + start, num_first_pass);
+  memcpy((uint8_t *)dest + num_first_pass, rb->buffer, num - num_first_pass);
+
+  if (flag == PICTRL_READ_CONSUME) {
+    // Released so the producer doesn't reuse the space before we're done
+    atomic_store_explicit(&rb->tail, tail + num, memory_order_release);
+  }
+  return num;
+}
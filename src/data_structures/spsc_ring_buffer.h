@@ -0,0 +1,89 @@
+#ifndef _PICTRL_SPSC_RING_BUFFER_H
+#define _PICTRL_SPSC_RING_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "data_structures/ring_buffer.h"  // pictrl_read_flag
+#include "util.h"                         // PICTRL_CACHE_LINE
+
+/*
+Byte ring buffer (like a power of 2 `pictrl_rb_t`) that one thread can write to
+while another reads from it, without locks: i.e. the network thread handing
+bytes to a backend's writer thread.
+
+Exactly one thread may call the producer functions, and exactly one (other)
+thread the consumer ones. Nothing blocks: writes take what fits and reads give
+back what's there, so the caller decides whether to spin, yield or sleep.
+
+`head` and `tail` are free-running counters (masked down to an index), each
+only ever stored by its own side, with release/acquire ordering the bytes
+between them. Each side also remembers the other's counter from the last time
+it looked, and only reloads it (taking the cache line from the other core) when
+that doesn't leave enough room/data.
+*/
+typedef struct pictrl_spsc_rb_t {
+  // Producer's cache line
+  _Alignas(PICTRL_CACHE_LINE) _Atomic size_t head;  // Bytes ever written
+  size_t cached_tail;
+
+  // Consumer's
+  _Alignas(PICTRL_CACHE_LINE) _Atomic size_t tail;  // Bytes ever consumed
+  size_t cached_head;
+
+  // Never written after init
+  _Alignas(PICTRL_CACHE_LINE) uint8_t *buffer;
+  size_t capacity;  // Power of 2
+  size_t mask;
+} pictrl_spsc_rb_t;
+
+// Prototypes
+pictrl_spsc_rb_t *pictrl_spsc_rb_init(pictrl_spsc_rb_t *rb, size_t capacity);
+void pictrl_spsc_rb_destroy(pictrl_spsc_rb_t *rb);
+
+// Producer side
+size_t pictrl_spsc_rb_write(pictrl_spsc_rb_t *rb, const void *src, size_t num);
+
+// Consumer side
+size_t pictrl_spsc_rb_read(pictrl_spsc_rb_t *rb, void *dest, size_t num,
+                           pictrl_read_flag flag);
+
+// Static "methods"
+
+// Producer side. Returns false if it's full
+static inline bool pictrl_spsc_rb_push(pictrl_spsc_rb_t *rb, uint8_t byte) {
+  const size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+  if (head - rb->cached_tail == rb->capacity) {
+    rb->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    if (head - rb->cached_tail == rb->capacity) {
+      return false;
+    }
+  }
+  rb->buffer[head & rb->mask] = byte;
+  atomic_store_explicit(&rb->head, head + 1, memory_order_release);
+  return true;
+}
+
+// Consumer side. Returns false if it's empty
+static inline bool pictrl_spsc_rb_pop(pictrl_spsc_rb_t *rb, uint8_t *byte) {
+  const size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+  if (tail == rb->cached_head) {
+    rb->cached_head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    if (tail == rb->cached_head) {
+      return false;
+    }
+  }
+  *byte = rb->buffer[tail & rb->mask];
+  atomic_store_explicit(&rb->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+// Only a snapshot when called while the other side is running
+static inline size_t pictrl_spsc_rb_size(pictrl_spsc_rb_t *rb) {
+  const size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+  const size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+  return head - tail;
+}
+#endif
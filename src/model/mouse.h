@@ -1,6 +1,8 @@
 #ifndef _PICTRL_MODEL_MOUSE_H
 #define _PICTRL_MODEL_MOUSE_H
 
+#include <stdint.h>
+
 typedef enum { PI_CTRL_MOUSE_LEFT = 0, PI_CTRL_MOUSE_RIGHT = 1 } PiCtrlMouseBtn;
 
 typedef enum {
@@ -17,4 +19,24 @@ typedef struct {
   int x, y;
 } PiCtrlMouseCoord;
 
+// High resolution relative moves are fixed point with this many fractional
+// bits (so in 1/16ths of a pixel)
+#define PICTRL_MOUSE_FRAC_BITS 4
+#define PICTRL_MOUSE_SUBPIXELS (1 << PICTRL_MOUSE_FRAC_BITS)
+
+// In 1/120ths of a wheel notch (like REL_WHEEL_HI_RES). Positive is up/right
+#define PICTRL_SCROLL_UNITS_PER_NOTCH 120
+
+typedef struct {
+  int vertical, horizontal;
+} PiCtrlMouseScroll;
+
+// Normalized to the whole screen: 0 is the left/top edge, PICTRL_MOUSE_ABS_MAX
+// is the right/bottom one
+#define PICTRL_MOUSE_ABS_MAX UINT16_MAX
+
+typedef struct {
+  uint16_t x, y;
+} PiCtrlMouseAbs;
+
 #endif
@@ -1,6 +1,8 @@
 #ifndef _PICTRL_MODEL_PROTOCOL_H
 #define _PICTRL_MODEL_PROTOCOL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
 
@@ -11,16 +13,57 @@ typedef enum {
   PI_CTRL_MOUSE_CLICK,  // Client: Say to click (mouseup or mousedown) mouse
   PI_CTRL_TEXT,         // Client: Send UTF-8 bytes to be typed
   PI_CTRL_KEYSYM,       // Client: Send keysym (combination)
+  PI_CTRL_MOUSE_SCROLL,  // Client: Send vertical, horizontal amounts to scroll
+  PI_CTRL_MOUSE_ABS,     // Client: Send x,y of absolute position to move to
+  PI_CTRL_MOUSE_MV_HIRES,  // Client: Send x,y of relative position to move
+                           //         mouse to, in fractions of a pixel
+  PI_CTRL_BATCH,  // Client: Send several of the above at once (see
+                  //         serialize/batch.h)
+  PI_CTRL_HELLO,  // Both: Say which protocol version and features we have
+                  //       (see serialize/protocol.h). v2 and up
 } PiCtrlCmd;
 
+/*
+Version 1 is everything up to PI_CTRL_BATCH, with no handshake. Clients that
+want more send a PI_CTRL_HELLO first, and get one back saying what they can
+use. v1 clients never do, and keep working as they always have.
+*/
+#define PICTRL_PROTOCOL_VERSION 2
+
+// What a PI_CTRL_HELLO can offer (bit flags)
+typedef enum {
+  PICTRL_CAP_BATCH = 1 << 0,        // PI_CTRL_BATCH
+  PICTRL_CAP_MOUSE_HIRES = 1 << 1,  // PI_CTRL_MOUSE_MV_HIRES
+  PICTRL_CAP_EXT_HEADER = 1 << 2,   // PICTRL_CMD_EXTENDED
+} PiCtrlCapability;
+
+// Set on a command when an extended header (RawPictrlExtHeader) comes between
+// the regular header and the payload. v2 and up
+#define PICTRL_CMD_EXTENDED 0x80
+
 typedef struct {
   uint8_t cmd;
   uint8_t payload_size;
 } RawPictrlHeader;
 
 typedef struct {
-  RawPictrlHeader header;
+  uint16_t seq;        // Goes up by 1 every extended message, and wraps
+  uint32_t send_usec;  // Client's (any monotonic) clock, when it sent this
+} RawPictrlExtHeader;
+
+typedef struct {
+  RawPictrlHeader header;  // Without PICTRL_CMD_EXTENDED in `cmd`
+  bool extended;           // Whether it had it, i.e. whether `ext` is set
+  RawPictrlExtHeader ext;
   uint8_t *payload;
 } RawPiCtrlMessage;
 
+typedef struct {
+  uint8_t version;
+  uint8_t caps;         // PiCtrlCapability flags
+  uint8_t max_payload;  // Biggest payload_size the sender takes
+  const char *backend;  // Server only: what's emitting the input. Not
+  size_t backend_len;   // NUL-terminated
+} PiCtrlHello;
+
 #endif
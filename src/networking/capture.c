@@ -0,0 +1,168 @@
+#include "networking/capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+#include "util.h"
+
+/*
+Creates (or truncates) the capture at `path`. The capture starts now, as far as
+the first message's delta is concerned. Returns NULL (and logs why) on failure.
+*/
+pictrl_capture *pictrl_capture_open(pictrl_capture *capture, const char *path) {
+  FILE *file = fopen(path, "wbe");
+  if (file == NULL) {
+    pictrl_log_error("Could not open capture %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  // Only hit the disk every so often, not on every message
+  setvbuf(file, NULL, _IOFBF, PICTRL_CAPTURE_BUFFER_SIZE);
+
+  pictrl_capture_header header = {.version = PICTRL_CAPTURE_VERSION};
+  memcpy(header.magic, PICTRL_CAPTURE_MAGIC, sizeof(header.magic));
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    pictrl_log_error("Could not write capture %s: %s\n", path, strerror(errno));
+    fclose(file);
+    return NULL;
+  }
+
+  capture->file = file;
+  capture->last_usec = pictrl_now_usec();
+  capture->num_messages = 0;
+  return capture;
+}
+
+/*
+Appends a `len` byte message that arrived at `recv_usec` (from
+`pictrl_now_usec()`). Gaps too long to fit (over an hour) are cut short, which
+replaying won't miss.
+*/
+bool pictrl_capture_write(pictrl_capture *capture, const void *msg, size_t len,
+                          uint64_t recv_usec) {
+  if (len > UINT16_MAX) {
+    pictrl_log_warn("Not capturing a %zu byte message\n", len);
+    return false;
+  }
+
+  const uint64_t delta = (recv_usec > capture->last_usec)
+                             ? recv_usec - capture->last_usec
+                             : 0;
+  const uint32_t delta_usec = (delta > UINT32_MAX) ? UINT32_MAX : delta;
+  const uint16_t msg_len = len;
+  capture->last_usec = recv_usec;
+
+  if (fwrite(&delta_usec, sizeof(delta_usec), 1, capture->file) != 1 ||
+      fwrite(&msg_len, sizeof(msg_len), 1, capture->file) != 1 ||
+      fwrite(msg, 1, len, capture->file) != len) {
+    pictrl_log_error("Could not write to capture: %s\n", strerror(errno));
+    return false;
+  }
+  capture->num_messages++;
+  return true;
+}
+
+void pictrl_capture_close(pictrl_capture *capture) {
+  if (capture->file == NULL) {
+    return;
+  }
+  if (fclose(capture->file) != 0) {
+    pictrl_log_error("Could not finish writing capture: %s\n",
+                     strerror(errno));
+  }
+  capture->file = NULL;
+}
+
+/*
+Maps the capture at `path` to read it back with `pictrl_capture_next()`. Returns
+NULL (and logs why) if it's not a capture we can read.
+*/
+pictrl_capture_reader *pictrl_capture_reader_open(pictrl_capture_reader *reader,
+                                                  const char *path) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    pictrl_log_error("Could not open capture %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < sizeof(pictrl_capture_header)) {
+    pictrl_log_error("%s is too small to be a capture\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  const size_t size = st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    pictrl_log_error("Could not map capture %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  const pictrl_capture_header *header = map;
+  if (memcmp(header->magic, PICTRL_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != PICTRL_CAPTURE_VERSION) {
+    pictrl_log_error("%s is not a capture we can read\n", path);
+    munmap(map, size);
+    return NULL;
+  }
+
+  reader->data = map;
+  reader->size = size;
+  pictrl_capture_reader_rewind(reader);
+  return reader;
+}
+
+/*
+Reads the next message into `msg`, returning false once there are no more. A
+record cut short (i.e. the server was killed mid-write) counts as the end.
+*/
+bool pictrl_capture_next(pictrl_capture_reader *reader,
+                         pictrl_capture_message *msg) {
+  if (reader->size - reader->offset < PICTRL_CAPTURE_RECORD_HEADER_SIZE) {
+    return false;
+  }
+
+  uint32_t delta_usec;
+  uint16_t msg_len;
+  const uint8_t *record = reader->data + reader->offset;
+  memcpy(&delta_usec, record, sizeof(delta_usec));
+  memcpy(&msg_len, record + sizeof(delta_usec), sizeof(msg_len));
+  if (reader->size - reader->offset - PICTRL_CAPTURE_RECORD_HEADER_SIZE <
+      msg_len) {
+    return false;
+  }
+
+  reader->offset_usec += delta_usec;
+  reader->offset += PICTRL_CAPTURE_RECORD_HEADER_SIZE + msg_len;
+  msg->offset_usec = reader->offset_usec;
+  msg->data = record + PICTRL_CAPTURE_RECORD_HEADER_SIZE;
+  msg->len = msg_len;
+  return true;
+}
+
+// Back to the first message (i.e. to replay it in a loop)
+void pictrl_capture_reader_rewind(pictrl_capture_reader *reader) {
+  reader->offset = sizeof(pictrl_capture_header);
+  reader->offset_usec = 0;
+}
+
+void pictrl_capture_reader_close(pictrl_capture_reader *reader) {
+  if (reader->data == NULL) {
+    return;
+  }
+  munmap((void *)reader->data, reader->size);
+  reader->data = NULL;
+  reader->size = 0;
+}
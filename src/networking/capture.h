@@ -0,0 +1,67 @@
+#ifndef _PICTRL_CAPTURE_H
+#define _PICTRL_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PICTRL_CAPTURE_MAGIC "PICTRLC1"
+#define PICTRL_CAPTURE_VERSION 1
+
+/*
+Capture file layout: this header, followed by one record per PiControl message
+the server received, in the order they came in:
+
+  | DELTA_USEC (4 bytes) | LEN (2 bytes) | MESSAGE (LEN bytes) |
+
+DELTA_USEC is how long after the previous message (or the start of the
+capture) this one arrived, and MESSAGE is exactly what the client sent for it
+(header, any extended header, and payload, see `parse_to_pictrl_msg()`).
+Records are whole messages no matter how they were split up or packed into
+websocket frames, so each one can be sent back as a frame of its own. The last
+bit of a message to arrive is when it counts as arrived. Integers are in host
+byte order, and unaligned.
+*/
+typedef struct {
+  char magic[8];  // PICTRL_CAPTURE_MAGIC, not null terminated
+  uint32_t version;
+  uint32_t reserved;
+} pictrl_capture_header;
+
+#define PICTRL_CAPTURE_RECORD_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint16_t))
+
+// Writing, as messages come in (buffered, so it's not a write() per message)
+typedef struct {
+  FILE *file;
+  uint64_t last_usec;  // When the previous message arrived
+  uint64_t num_messages;
+} pictrl_capture;
+
+// Reading back a whole capture at once (i.e. to replay it)
+typedef struct {
+  const uint8_t *data;  // Mapped file
+  size_t size;
+  size_t offset;         // Next record
+  uint64_t offset_usec;  // Arrival of the last record read, since the start
+} pictrl_capture_reader;
+
+typedef struct {
+  uint64_t offset_usec;  // When it arrived, relative to the start of capture
+  const uint8_t *data;   // Points into the mapped file
+  size_t len;
+} pictrl_capture_message;
+
+// Prototypes
+pictrl_capture *pictrl_capture_open(pictrl_capture *capture, const char *path);
+bool pictrl_capture_write(pictrl_capture *capture, const void *msg, size_t len,
+                          uint64_t recv_usec);
+void pictrl_capture_close(pictrl_capture *capture);
+
+pictrl_capture_reader *pictrl_capture_reader_open(pictrl_capture_reader *reader,
+                                                  const char *path);
+bool pictrl_capture_next(pictrl_capture_reader *reader,
+                         pictrl_capture_message *msg);
+void pictrl_capture_reader_rewind(pictrl_capture_reader *reader);
+void pictrl_capture_reader_close(pictrl_capture_reader *reader);
+#endif
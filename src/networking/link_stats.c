@@ -0,0 +1,74 @@
+#include "networking/link_stats.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "data_structures/histogram.h"
+#include "model/protocol.h"
+
+void pictrl_link_stats_init(pictrl_link_stats *stats) {
+  *stats = (pictrl_link_stats){0};
+  pictrl_histogram_init(&stats->all.delay_usec);
+  for (size_t cmd = 0; cmd < PICTRL_LINK_NUM_CMDS; cmd++) {
+    pictrl_histogram_init(&stats->by_cmd[cmd].delay_usec);
+  }
+}
+
+// Sequence numbers wrap, so anything up to half way round counts as ahead
+static void record_seq(pictrl_link_stats *stats, uint16_t seq) {
+  const int16_t ahead = (int16_t)(uint16_t)(seq - stats->next_seq);
+  if (ahead >= 0) {
+    stats->lost += (uint64_t)ahead;
+    stats->next_seq = seq + 1;
+  } else {
+    // Late, rather than lost after all (or a duplicate, which we can't tell
+    // apart without keeping track of every sequence number)
+    stats->reordered++;
+    if (stats->lost > 0) {
+      stats->lost--;
+    }
+  }
+}
+
+static void record_delay(pictrl_link_delay *delay, int32_t relative_transit,
+                         int32_t min_transit) {
+  pictrl_histogram_record(
+      &delay->delay_usec,
+      (uint64_t)((int64_t)relative_transit - min_transit));
+  if (delay->received > 0) {
+    const double change =
+        llabs((int64_t)relative_transit - delay->last_transit);
+    delay->jitter_usec += (change - delay->jitter_usec) / 16;
+  }
+  delay->last_transit = relative_transit;
+  delay->received++;
+}
+
+/*
+`send_usec` is from the client's clock and wraps every ~71 minutes, so transit
+times are only ever compared to each other (modulo 2^32), never used as is.
+*/
+void pictrl_link_stats_record(pictrl_link_stats *stats, uint8_t cmd,
+                              uint16_t seq, uint32_t send_usec,
+                              uint64_t recv_usec) {
+  const uint32_t transit = (uint32_t)recv_usec - send_usec;
+  if (!stats->started) {
+    stats->started = true;
+    stats->next_seq = seq + 1;
+    stats->base_transit = transit;
+  } else {
+    record_seq(stats, seq);
+  }
+  stats->received++;
+
+  const int32_t relative_transit = (int32_t)(transit - stats->base_transit);
+  if (stats->received == 1 || relative_transit < stats->min_transit) {
+    stats->min_transit = relative_transit;
+  }
+  record_delay(&stats->all, relative_transit, stats->min_transit);
+  if (cmd < PICTRL_LINK_NUM_CMDS) {
+    record_delay(&stats->by_cmd[cmd], relative_transit, stats->min_transit);
+  }
+}
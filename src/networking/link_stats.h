@@ -0,0 +1,57 @@
+#ifndef _PICTRL_LINK_STATS_H
+#define _PICTRL_LINK_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "data_structures/histogram.h"
+#include "model/protocol.h"
+
+// How much longer than the fastest message some messages took, and how much
+// that varies (see pictrl_link_stats)
+typedef struct {
+  uint64_t received;
+  pictrl_histogram delay_usec;
+  double jitter_usec;
+  int32_t last_transit;  // Previous one, relative to `base_transit`
+} pictrl_link_delay;
+
+// Commands that get delay of their own (the rest only count towards `all`)
+#define PICTRL_LINK_NUM_CMDS (PI_CTRL_HELLO + 1)
+
+/*
+What a connection's extended headers (sequence numbers and client send times,
+see RawPictrlExtHeader) say about the network between us and the client.
+
+The client's clock has nothing to do with ours, so one-way delay can't be
+measured outright. Instead, `delay_usec` is how much longer each message took
+than the fastest one so far, which is the queueing and retransmission delay
+that users feel as lag. `jitter_usec` is the RFC 3550 interarrival jitter
+estimate: how much that delay varies from one message to the next (smoothed
+over ~16 messages).
+
+`all` covers every message, and `by_cmd` each command on its own, so (i.e.)
+clicks stuck behind a burst of moves show up as clicks' delay. A command's
+jitter is from one message of that command to the next. Sequence numbers are
+shared by every command, so losses and reordering are only counted overall.
+*/
+typedef struct {
+  uint64_t received;   // Messages with an extended header
+  uint64_t lost;       // Sequence numbers skipped, and not seen since
+  uint64_t reordered;  // Arrived after a later one
+
+  pictrl_link_delay all;
+  pictrl_link_delay by_cmd[PICTRL_LINK_NUM_CMDS];
+
+  bool started;
+  uint16_t next_seq;
+  uint32_t base_transit;  // Receive minus send time of the first message
+  int32_t min_transit;    // Fastest one, relative to `base_transit`
+} pictrl_link_stats;
+
+// Prototypes
+void pictrl_link_stats_init(pictrl_link_stats *stats);
+void pictrl_link_stats_record(pictrl_link_stats *stats, uint8_t cmd,
+                              uint16_t seq, uint32_t send_usec,
+                              uint64_t recv_usec);
+#endif
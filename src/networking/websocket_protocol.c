@@ -2,46 +2,263 @@
 
 #include <libwebsockets.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "backend/picontrol_backend.h"
+#ifdef PICTRL_PIPELINE
+#include "backend/picontrol_pipeline.h"
+#endif
+#include "data_structures/ring_buffer.h"
 #include "model/protocol.h"
+#include "networking/capture.h"
 #include "networking/iputils.h"
+#include "networking/link_stats.h"
 #include "picontrol_config.h"
 #include "serialize/protocol.h"
+#include "util.h"
+
+// So there's always room for the rest of a message, once the ones before it
+// have been handled
+_Static_assert(PICTRL_RX_BUFFER_SIZE >= 2 * PICTRL_MAX_MSG_LEN,
+               "PICTRL_RX_BUFFER_SIZE can't hold a couple of messages");
+_Static_assert((PICTRL_RX_BUFFER_SIZE & (PICTRL_RX_BUFFER_SIZE - 1)) == 0,
+               "PICTRL_RX_BUFFER_SIZE must be a power of 2");
+
+// Everything we can do, for a PI_CTRL_HELLO
+#define SERVER_CAPS \
+  (PICTRL_CAP_BATCH | PICTRL_CAP_MOUSE_HIRES | PICTRL_CAP_EXT_HEADER)
+#define SERVER_MAX_PAYLOAD UINT8_MAX
 
 typedef struct {
   pictrl_backend *backend;
+#ifdef PICTRL_PIPELINE
+  pictrl_pipeline *pipeline;
+#else
+  struct lws_context *context;
+  lws_sorted_usec_list_t service_timer;  // Flushes held-back (coalesced) input
+#endif
+  pictrl_capture capture;  // `capture.file` is NULL if we're not capturing
+  int num_conns;  // Established, and not turned away (see MAX_CONNS)
   RawPiCtrlMessage msg;
+  uint8_t msg_scratch[PICTRL_MAX_MSG_LEN];  // For messages that wrap around
 } PiContext;
 
+#ifdef PICTRL_PIPELINE
+static void log_pipeline_stats(pictrl_pipeline *pipeline) {
+  pictrl_pipeline_stats stats;
+  pictrl_pipeline_get_stats(pipeline, &stats);
+  lwsl_user(
+      "Pipeline: depth %zu (max %zu), %llu submitted, %llu emitted, %llu "
+      "stalls (%llu dropped), %llu idle waits\n",
+      stats.depth, stats.max_depth, (unsigned long long)stats.submitted,
+      (unsigned long long)stats.emitted, (unsigned long long)stats.stalls,
+      (unsigned long long)stats.dropped, (unsigned long long)stats.idle_waits);
+}
+#endif
+
+#ifndef PICTRL_PIPELINE
+static void service_backend(lws_sorted_usec_list_t *timer) {
+  PiContext *pictx = lws_container_of(timer, PiContext, service_timer);
+  const int64_t next_usec = pictrl_backend_service(pictx->backend);
+  if (next_usec >= 0) {
+    lws_sul_schedule(pictx->context, 0, &pictx->service_timer,
+                     &service_backend, next_usec);
+  }
+}
+#endif
+
+// `pictx->msg` is always whole, see `receive()`
 static int handle_message(PiContext *pictx) {
-  // Handle command
-  switch (pictx->msg.header.cmd) {
-    case PI_CTRL_MOUSE_MV:
-      handle_mouse_move(pictx->backend, &pictx->msg);
-      break;
-    case PI_CTRL_MOUSE_CLICK:
-      handle_mouse_click(pictx->backend, &pictx->msg);
-      break;
-    case PI_CTRL_TEXT:
-      handle_text(pictx->backend, &pictx->msg);
-      break;
-    case PI_CTRL_KEYSYM:
-      handle_keysym(pictx->backend, &pictx->msg);
-      break;
-    // TODO: On disconnect command, return 0?
-    default:
-      lwsl_err("Invalid command: %d.\n", pictx->msg.header.cmd);
-      return -1;
+#ifdef PICTRL_PIPELINE
+  return pictrl_pipeline_submit(pictx->pipeline, &pictx->msg);
+#else
+  const int ret = pictrl_backend_handle_message(pictx->backend, &pictx->msg);
+  service_backend(&pictx->service_timer);
+  return ret;
+#endif
+}
+
+static inline int min_int(int a, int b) { return (a < b) ? a : b; }
+
+/*
+Settles on the lower of our protocol versions and payload limits, and the
+capabilities we both have, then asks lws to let us say so (see `send_hello()`).
+A client that says hello again (i.e. after reconfiguring) just gets a new one.
+*/
+static void handle_hello(struct lws *wsi, PiCtrlSession *session,
+                         const RawPiCtrlMessage *msg) {
+  PiCtrlHello client;
+  if (!pictrl_parse_hello(msg, &client)) {
+    return;
   }
+  session->hello = (PiCtrlHello){
+      .version = min_int(client.version, PICTRL_PROTOCOL_VERSION),
+      .caps = client.caps & SERVER_CAPS,
+      .max_payload = min_int(client.max_payload, SERVER_MAX_PAYLOAD)};
+  lwsl_user("Client speaks protocol v%d: agreed on v%d, capabilities 0x%02x, "
+            "payloads up to %d bytes\n",
+            client.version, session->hello.version, session->hello.caps,
+            session->hello.max_payload);
 
+  session->hello_pending = true;
+  lws_callback_on_writable(wsi);
+}
+
+// Tells the client what `handle_hello()` agreed on, and which backend it's
+// talking to
+static int send_hello(PiContext *pictx, struct lws *wsi,
+                      PiCtrlSession *session) {
+  uint8_t buf[LWS_PRE + sizeof(RawPictrlHeader) + UINT8_MAX];
+  PiCtrlHello hello = session->hello;
+  hello.backend = pictrl_backend_name(pictx->backend);
+  hello.backend_len = strlen(hello.backend);
+  const size_t len =
+      pictrl_build_hello(&hello, buf + LWS_PRE, sizeof(buf) - LWS_PRE);
+
+  session->hello_pending = false;
+  if (lws_write(wsi, buf + LWS_PRE, len, LWS_WRITE_BINARY) < (int)len) {
+    lwsl_err("Could not send hello\n");
+    return -1;
+  }
   return 0;
 }
 
+// Whether `msg` keeps to what `handle_hello()` agreed on (see
+// `pictrl_hello_allows()`). Only the first rejection is logged, the rest are
+// counted (and logged on close)
+static bool keeps_to_hello(PiCtrlSession *session,
+                           const RawPiCtrlMessage *msg) {
+  const PiCtrlHello *hello = &session->hello;
+  if (pictrl_hello_allows(hello, msg)) {
+    return true;
+  }
+
+  if (session->rejected++ == 0) {
+    lwsl_warn("Rejecting command %d (capabilities 0x%02x, %d byte payload), "
+              "we agreed on capabilities 0x%02x and payloads up to %d "
+              "bytes\n",
+              msg->header.cmd, pictrl_hello_caps_needed(msg),
+              msg->header.payload_size, hello->caps, hello->max_payload);
+  }
+  return false;
+}
+
+static void log_link_delay(const char *what, const pictrl_link_delay *delay) {
+  const pictrl_histogram *usec = &delay->delay_usec;
+  lwsl_user("  %s: %llu messages, delay over the fastest (us): p50 %llu, p99 "
+            "%llu, max %llu. Jitter %.0fus\n",
+            what, (unsigned long long)delay->received,
+            (unsigned long long)pictrl_histogram_percentile(usec, 50),
+            (unsigned long long)pictrl_histogram_percentile(usec, 99),
+            (unsigned long long)usec->max, delay->jitter_usec);
+}
+
+static void log_link_stats(const pictrl_link_stats *link) {
+  lwsl_user("Link: %llu messages, %llu lost, %llu reordered\n",
+            (unsigned long long)link->received,
+            (unsigned long long)link->lost,
+            (unsigned long long)link->reordered);
+  log_link_delay("All", &link->all);
+  for (int cmd = 0; cmd < PICTRL_LINK_NUM_CMDS; cmd++) {
+    if (link->by_cmd[cmd].received > 0) {
+      char what[16];
+      snprintf(what, sizeof(what), "Command %d", cmd);
+      log_link_delay(what, &link->by_cmd[cmd]);
+    }
+  }
+}
+
+/*
+Every connection feeds the same backend (and the same motion coalescing), so
+input from two clients at once would get mixed together. Anyone past MAX_CONNS
+gets told so and closed on, instead.
+*/
+static int turn_away(struct lws *wsi, int num_conns) {
+  static const char reason[] = "Another client is already connected";
+  lwsl_warn("Already have %d client(s), turning a new one away\n", num_conns);
+  lws_close_reason(wsi, LWS_CLOSE_STATUS_POLICY_VIOLATION,
+                   (unsigned char *)reason, sizeof(reason) - 1);
+  return -1;
+}
+
+// Mirrored if we can, so messages never need copying out to be parsed
+static pictrl_rb_t *rx_init(pictrl_rb_t *rx) {
+  const long page_size = sysconf(_SC_PAGESIZE);
+  const size_t capacity = (page_size > PICTRL_RX_BUFFER_SIZE)
+                              ? (size_t)page_size
+                              : PICTRL_RX_BUFFER_SIZE;
+  if (pictrl_rb_init_mirrored(rx, capacity) != NULL) {
+    return rx;
+  }
+  lwsl_warn("Could not map mirrored receive buffer, using a plain one\n");
+  return pictrl_rb_init_pow2(rx, PICTRL_RX_BUFFER_SIZE);
+}
+
+/*
+Adds a chunk of what the client sent to whatever was left over from the last
+one, and handles every message that's whole now. Clients can pack as many
+messages into a frame as they want, and they (or lws) can split one across
+frames. Returns how many messages were handled (not rejected).
+
+Hellos are ours to answer, everything else goes to the backend, unless it
+breaks what the last hello agreed on (see `keeps_to_hello()`). `recv_usec` is
+when the chunk came in, for messages with extended headers and the capture.
+Messages are captured whole, one record each, however the client split or
+packed them, and whether or not they're rejected.
+*/
+static size_t receive(PiContext *pictx, struct lws *wsi,
+                      PiCtrlSession *session, const uint8_t *in, size_t len,
+                      uint64_t recv_usec) {
+  size_t num_msgs = 0;
+  while (len > 0) {
+    const size_t appended = pictrl_rb_append(&session->rx, in, len);
+    if (appended == 0) {  // Can't happen, see the _Static_assert()s up top
+      lwsl_err("Receive buffer full, dropping %zu bytes\n", len);
+      break;
+    }
+    in += appended;
+    len -= appended;
+
+    size_t msg_len;
+    while ((msg_len = pictrl_rb_peek_msg(&session->rx, &pictx->msg,
+                                         pictx->msg_scratch)) > 0) {
+      if (pictx->capture.file != NULL) {
+        // The message is contiguous (see `pictrl_rb_peek_msg()`), and its
+        // headers come right before the payload
+        const uint8_t *raw =
+            pictx->msg.payload - (msg_len - pictx->msg.header.payload_size);
+        pictrl_capture_write(&pictx->capture, raw, msg_len, recv_usec);
+      }
+      const bool is_hello = pictx->msg.header.cmd == PI_CTRL_HELLO;
+      if (!is_hello && !keeps_to_hello(session, &pictx->msg)) {
+        pictrl_rb_consume(&session->rx, msg_len);
+        continue;
+      }
+      if (pictx->msg.extended) {
+        pictrl_link_stats_record(&session->link, pictx->msg.header.cmd,
+                                 pictx->msg.ext.seq, pictx->msg.ext.send_usec,
+                                 recv_usec);
+      }
+      if (is_hello) {
+        handle_hello(wsi, session, &pictx->msg);
+      } else {
+        handle_message(pictx);
+      }
+      pictrl_rb_consume(&session->rx, msg_len);
+      num_msgs++;
+    }
+  }
+  return num_msgs;
+}
+
 // https://github.com/warmcat/libwebsockets/blob/main/minimal-examples-lowlevel/raw/minimal-raw-audio/audio.c
 int callback_picontrol(struct lws *wsi, enum lws_callback_reasons reason,
                        void *user, void *in, size_t len) {
-  (void)user;
+  PiCtrlSession *session = (PiCtrlSession *)user;
   PiContext *pictx = (PiContext *)lws_protocol_vh_priv_get(
       lws_get_vhost(wsi), lws_get_protocol(wsi));
 
@@ -51,13 +268,32 @@ int callback_picontrol(struct lws *wsi, enum lws_callback_reasons reason,
       pictx = lws_protocol_vh_priv_zalloc(
           lws_get_vhost(wsi), lws_get_protocol(wsi), sizeof(*pictx));
       // Create backend
-      pictx->backend = pictrl_backend_new();
+      const PiCtrlServerOptions *options =
+          lws_context_user(lws_get_context(wsi));
+      pictx->backend = pictrl_backend_new(options->backend_name);
       if (pictx->backend == NULL) {
         lwsl_err("Unable to create PiControl backend!\n");
         return -1;
       }
-      lwsl_user("Using %s backend\n",
-                pictrl_backend_name(pictx->backend->type));
+      lwsl_user("Using %s backend\n", pictrl_backend_name(pictx->backend));
+#ifdef PICTRL_PIPELINE
+      // From here on, only the emitter thread touches the backend
+      pictx->pipeline = pictrl_pipeline_new(pictx->backend);
+      if (pictx->pipeline == NULL) {
+        lwsl_err("Unable to start emitter pipeline!\n");
+        return -1;
+      }
+      lwsl_user("Pipeline mode: emitting from a dedicated thread\n");
+#else
+      pictx->context = lws_get_context(wsi);
+#endif
+      if (options->capture_path != NULL) {
+        if (pictrl_capture_open(&pictx->capture, options->capture_path) ==
+            NULL) {
+          return -1;
+        }
+        lwsl_user("Capturing messages to %s\n", options->capture_path);
+      }
 
       // Get our IP
       char *ip = get_ip_address();
@@ -70,13 +306,66 @@ int callback_picontrol(struct lws *wsi, enum lws_callback_reasons reason,
     case LWS_CALLBACK_RAW_ADOPT:
       lwsl_notice("LWS_CALLBACK_RAW_ADOPT (%zu)\n", len);
       break;
-    case LWS_CALLBACK_RECEIVE:
+    case LWS_CALLBACK_ESTABLISHED:
+      if (pictx->num_conns >= MAX_CONNS) {
+        return turn_away(wsi, pictx->num_conns);
+      }
+      if (rx_init(&session->rx) == NULL) {
+        lwsl_err("Unable to allocate receive buffer!\n");
+        return -1;
+      }
+      pictrl_link_stats_init(&session->link);
+      session->counted = true;
+      pictx->num_conns++;
+      break;
+    case LWS_CALLBACK_RECEIVE: {
+      const uint64_t recv_usec = pictrl_now_usec();
       // Surely sizeof(uint8_t) == sizeof(char) always... right?
-      pictx->msg = parse_to_pictrl_msg(in, len);
-      handle_message(pictx);
+      receive(pictx, wsi, session, in, len, recv_usec);
+      break;
+    }
+    case LWS_CALLBACK_SERVER_WRITEABLE:
+      if (session->hello_pending) {
+        return send_hello(pictx, wsi, session);
+      }
+      break;
+    case LWS_CALLBACK_CLOSED:
+      if (!session->counted) {  // Turned away
+        break;
+      }
+      pictx->num_conns--;
+      if (pictrl_rb_size(&session->rx) > 0) {
+        lwsl_warn("Dropping %zu bytes of an unfinished message\n",
+                  pictrl_rb_size(&session->rx));
+      }
+      pictrl_rb_destroy(&session->rx);
+      if (session->link.received > 0) {
+        log_link_stats(&session->link);
+      }
+      if (session->rejected > 0) {
+        lwsl_warn("Rejected %llu messages that broke the hello\n",
+                  (unsigned long long)session->rejected);
+      }
+#ifdef PICTRL_PIPELINE
+      log_pipeline_stats(pictx->pipeline);
+#endif
       break;
     case LWS_CALLBACK_PROTOCOL_DESTROY:
       lwsl_notice("LWS_CALLBACK_PROTOCOL_DESTROY\n");
+#ifdef PICTRL_PIPELINE
+      if (pictx->pipeline != NULL) {
+        lwsl_user("Draining pipeline...\n");
+        log_pipeline_stats(pictx->pipeline);
+        pictrl_pipeline_free(pictx->pipeline);
+      }
+#else
+      lws_sul_cancel(&pictx->service_timer);
+#endif
+      if (pictx->capture.file != NULL) {
+        lwsl_user("Captured %llu messages\n",
+                  (unsigned long long)pictx->capture.num_messages);
+        pictrl_capture_close(&pictx->capture);
+      }
       if (pictx->backend != NULL) {
         // TODO: prob some error handling
         lwsl_user("Freeing backend...\n");
@@ -3,6 +3,32 @@
 
 #include <libwebsockets.h>
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "data_structures/ring_buffer.h"
+#include "model/protocol.h"
+#include "networking/link_stats.h"
+
+// Set from the command line, handed to the protocol as the lws context's user
+typedef struct {
+  const char *backend_name;  // NULL for the first one that works
+  const char *capture_path;  // Where to capture received messages, or NULL
+} PiCtrlServerOptions;
+
+// Per connection (lws' "per session data")
+typedef struct {
+  // What's been received, but doesn't make up a whole message yet
+  pictrl_rb_t rx;
+  // What we agreed on with a v2+ client (all 0 for v1 ones), and whether we
+  // still owe it a PI_CTRL_HELLO saying so
+  PiCtrlHello hello;
+  bool hello_pending;
+  uint64_t rejected;  // Messages that broke the hello (see `hello`)
+  pictrl_link_stats link;  // From messages with extended headers
+  bool counted;  // Against MAX_CONNS, i.e. not turned away
+} PiCtrlSession;
+
 lws_callback_function callback_picontrol;
 
 #endif
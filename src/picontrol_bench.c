@@ -0,0 +1,624 @@
+/*
+Load generator: opens N websocket connections to a server and has each one send
+a mix of mouse moves, clicks, text and keysyms at a target rate (or as fast as
+it can) for a while. Reports the throughput it actually got, how long sends
+took from when they were due until lws had taken them, and anything that went
+wrong on the way.
+
+It really does send clicks and keystrokes, so point it at a server running the
+null or record backend (`picontrol_server -b null`) unless you want them typed.
+
+The server only takes MAX_CONNS clients at once (they'd all feed the same
+backend), so more connections than that only tests that the rest get turned
+away: they show up as closed by the server. Load a single connection harder
+(`-r`, `-b`) instead.
+
+With `-x`, each connection says hello first (protocol v2) and sends every
+message (or batch) with an extended header, so the server logs link stats
+(loss, reordering, delay and jitter, per command) when it closes.
+
+Usage: picontrol_bench [-H HOST] [-p PORT] [-c CONNS] [-r RATE] [-d SECS]
+                       [-m MIX] [-l TEXT_LEN] [-b BATCH] [-x]
+*/
+#include <libwebsockets.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "data_structures/histogram.h"
+#include "model/mouse.h"
+#include "model/protocol.h"
+#include "picontrol_config.h"
+#include "serialize/protocol.h"
+#include "util.h"
+
+typedef enum {
+  BENCH_MOUSE_MV,
+  BENCH_MOUSE_CLICK,
+  BENCH_TEXT,
+  BENCH_KEYSYM,
+  BENCH_NUM_KINDS
+} bench_kind;
+
+static const char *BENCH_KIND_NAMES[BENCH_NUM_KINDS] = {"mv", "click", "text",
+                                                        "keysym"};
+
+// Cycled through by BENCH_KEYSYM messages
+static const char *BENCH_KEYSYMS[] = {"ctrl+c", "ctrl+v", "shift+Tab",
+                                      "ctrl+shift+z"};
+
+typedef struct {
+  const char *host;
+  int port;
+  int num_conns;
+  double rate;  // Messages/s per connection, 0 for flat out
+  double duration_secs;
+  unsigned int mix[BENCH_NUM_KINDS];  // Relative weights
+  unsigned int mix_total;
+  int text_len;
+  int batch;  // Messages per frame, sent as a PI_CTRL_BATCH if more than 1
+  bool extended;  // Say hello, and send extended headers
+} pictrl_bench_options;
+
+// One per connection (lws' per session data)
+typedef struct {
+  struct lws *wsi;
+  lws_sorted_usec_list_t send_timer;
+  uint64_t start_usec;
+  uint64_t due_usec;  // When the next message should go out
+  uint64_t num_sent;
+  uint32_t rng;
+  bool mouse_down;
+  size_t next_keysym;
+  bool said_hello;
+  bool refused;       // The server's hello didn't agree to what we need
+  uint16_t next_seq;  // For extended headers
+} pictrl_bench_conn;
+
+typedef struct {
+  pictrl_bench_options options;
+  struct lws_context *context;
+  lws_sorted_usec_list_t end_timer;
+  int active;  // Connections that haven't closed (or failed) yet
+  int next_conn_id;
+  bool stopping;
+
+  uint64_t start_usec;  // First connection established
+  uint64_t end_usec;
+
+  pictrl_histogram send_latency_usec;
+  uint64_t sent[BENCH_NUM_KINDS];
+  uint64_t frames_sent;
+  uint64_t bytes_sent;
+  uint64_t connect_errors;
+  uint64_t write_errors;
+  uint64_t server_closes;  // Closed on us before we were done
+  uint64_t hellos;         // Hellos back from the server (with -x)
+  uint64_t refused;        // ...that didn't agree to what we need
+  uint64_t received;       // Anything else the server said
+} pictrl_bench;
+
+static int callback_bench(struct lws *wsi, enum lws_callback_reasons reason,
+                          void *user, void *in, size_t len);
+
+static const struct lws_protocols protocols[] = {
+    {
+        .name = "picontrol-bench",
+        .callback = &callback_bench,
+        .per_session_data_size = sizeof(pictrl_bench_conn),
+        .rx_buffer_size = 0,
+    },
+    LWS_PROTOCOL_LIST_TERM};
+
+static volatile sig_atomic_t interrupted = false;
+
+static void interrupt_handler(int signum) {
+  (void)signum;
+  interrupted = true;
+}
+
+// xorshift32, plenty random for picking what to send
+static uint32_t next_random(pictrl_bench_conn *conn) {
+  uint32_t x = conn->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return conn->rng = x;
+}
+
+static bench_kind pick_kind(const pictrl_bench *bench,
+                            pictrl_bench_conn *conn) {
+  unsigned int pick = next_random(conn) % bench->options.mix_total;
+  for (int kind = 0; kind < BENCH_NUM_KINDS; kind++) {
+    if (pick < bench->options.mix[kind]) {
+      return kind;
+    }
+    pick -= bench->options.mix[kind];
+  }
+  return BENCH_MOUSE_MV;
+}
+
+// Builds a message of `kind` at `msg`, and returns its length
+static size_t build_message(const pictrl_bench *bench, pictrl_bench_conn *conn,
+                            bench_kind kind, uint8_t *msg) {
+  uint8_t *payload = msg + sizeof(RawPictrlHeader);
+  size_t payload_size = 0;
+  switch (kind) {
+    case BENCH_MOUSE_MV:
+      msg[0] = PI_CTRL_MOUSE_MV;
+      payload[0] = (uint8_t)(int8_t)(next_random(conn) % 21 - 10);
+      payload[1] = (uint8_t)(int8_t)(next_random(conn) % 21 - 10);
+      payload_size = 2;
+      break;
+    case BENCH_MOUSE_CLICK:
+      // Alternate down and up, so nothing is left held
+      conn->mouse_down = !conn->mouse_down;
+      msg[0] = PI_CTRL_MOUSE_CLICK;
+      payload[0] = (PI_CTRL_MOUSE_LEFT << 1) |
+                   (conn->mouse_down ? PI_CTRL_MOUSE_DOWN : PI_CTRL_MOUSE_UP);
+      payload_size = 1;
+      break;
+    case BENCH_TEXT:
+      msg[0] = PI_CTRL_TEXT;
+      for (int i = 0; i < bench->options.text_len; i++) {
+        payload[i] = 'a' + next_random(conn) % 26;
+      }
+      payload_size = bench->options.text_len;
+      break;
+    case BENCH_KEYSYM: {
+      const char *keysym = BENCH_KEYSYMS[conn->next_keysym++ %
+                                         PICTRL_SIZE(BENCH_KEYSYMS)];
+      msg[0] = PI_CTRL_KEYSYM;
+      payload_size = strlen(keysym);
+      memcpy(payload, keysym, payload_size);
+      break;
+    }
+    default:
+      break;
+  }
+  msg[1] = payload_size;
+  return sizeof(RawPictrlHeader) + payload_size;
+}
+
+static void request_write(lws_sorted_usec_list_t *timer) {
+  pictrl_bench_conn *conn =
+      lws_container_of(timer, pictrl_bench_conn, send_timer);
+  lws_callback_on_writable(conn->wsi);
+}
+
+// Waits for the next message to be due. Paced connections keep to a fixed
+// schedule from when they started, so falling behind shows up as latency
+static void schedule_next(pictrl_bench *bench, pictrl_bench_conn *conn) {
+  const uint64_t now = pictrl_now_usec();
+  if (bench->options.rate == 0) {
+    conn->due_usec = now;
+  } else {
+    conn->due_usec =
+        conn->start_usec +
+        (uint64_t)(conn->num_sent * PICTRL_USEC_PER_SEC / bench->options.rate);
+  }
+
+  if (conn->due_usec <= now) {
+    lws_callback_on_writable(conn->wsi);
+  } else {
+    lws_sul_schedule(bench->context, 0, &conn->send_timer, &request_write,
+                     conn->due_usec - now);
+  }
+}
+
+// The longest message `build_message()` can come up with
+static size_t max_message_len(const pictrl_bench_options *options) {
+  size_t max_payload = options->text_len;
+  for (size_t i = 0; i < PICTRL_SIZE(BENCH_KEYSYMS); i++) {
+    if (strlen(BENCH_KEYSYMS[i]) > max_payload) {
+      max_payload = strlen(BENCH_KEYSYMS[i]);
+    }
+  }
+  return sizeof(RawPictrlHeader) + max_payload;
+}
+
+// What -x needs the server to agree to
+static uint8_t needed_caps(const pictrl_bench_options *options) {
+  return PICTRL_CAP_EXT_HEADER |
+         ((options->batch > 1) ? PICTRL_CAP_BATCH : 0);
+}
+
+static int send_hello(pictrl_bench *bench, pictrl_bench_conn *conn) {
+  uint8_t buf[LWS_PRE + PICTRL_MAX_MSG_LEN];
+  const PiCtrlHello hello = {.version = PICTRL_PROTOCOL_VERSION,
+                             .caps = needed_caps(&bench->options),
+                             .max_payload = UINT8_MAX};
+  const size_t len =
+      pictrl_build_hello(&hello, buf + LWS_PRE, sizeof(buf) - LWS_PRE);
+
+  conn->said_hello = true;
+  if (lws_write(conn->wsi, buf + LWS_PRE, len, LWS_WRITE_BINARY) < (int)len) {
+    bench->write_errors++;
+    return -1;
+  }
+  // Messages were due from when we connected, so they're likely late already
+  lws_callback_on_writable(conn->wsi);
+  return 0;
+}
+
+// Checks the server's answer to `send_hello()`. It's small enough to always
+// come in one piece
+static int handle_hello(pictrl_bench *bench, pictrl_bench_conn *conn,
+                        const RawPiCtrlMessage *msg) {
+  PiCtrlHello hello;
+  if (!pictrl_parse_hello(msg, &hello)) {
+    bench->received++;
+    return 0;
+  }
+  bench->hellos++;
+  const uint8_t needed = needed_caps(&bench->options);
+  if ((hello.caps & needed) != needed) {
+    lwsl_err("Server (%.*s backend) only agreed on capabilities 0x%02x, "
+             "need 0x%02x\n",
+             (int)hello.backend_len, hello.backend, hello.caps, needed);
+    bench->refused++;
+    conn->refused = true;
+    return -1;
+  }
+  if (bench->hellos == 1) {
+    lwsl_user("Server agreed on protocol v%d, capabilities 0x%02x, %.*s "
+              "backend\n",
+              hello.version, hello.caps, (int)hello.backend_len,
+              hello.backend);
+  }
+  return 0;
+}
+
+// Slots an extended header in after `frame`'s header (moving its payload
+// along), and returns the frame's new length
+static size_t add_ext_header(pictrl_bench_conn *conn, uint8_t *frame,
+                             size_t len) {
+  uint8_t *ext = frame + sizeof(RawPictrlHeader);
+  memmove(ext + PICTRL_EXT_HEADER_SIZE, ext, len - sizeof(RawPictrlHeader));
+
+  const uint16_t seq = conn->next_seq++;
+  const uint32_t send_usec = (uint32_t)pictrl_now_usec();
+  frame[0] |= PICTRL_CMD_EXTENDED;
+  ext[0] = seq >> 8;
+  ext[1] = seq;
+  ext[2] = send_usec >> 24;
+  ext[3] = send_usec >> 16;
+  ext[4] = send_usec >> 8;
+  ext[5] = send_usec;
+  return len + PICTRL_EXT_HEADER_SIZE;
+}
+
+// Sends the next message, or with -b, the next batch of them in one frame. A
+// batch stops short if the next message might not fit
+static int send_next(pictrl_bench *bench, pictrl_bench_conn *conn) {
+  static uint8_t buf[LWS_PRE + PICTRL_MAX_MSG_LEN];
+  const int batch = bench->options.batch;
+  uint8_t *frame = buf + LWS_PRE;
+  uint8_t *msg = (batch > 1) ? frame + sizeof(RawPictrlHeader) : frame;
+  const uint8_t *msg_end = frame + sizeof(RawPictrlHeader) + UINT8_MAX;
+  const size_t max_len = max_message_len(&bench->options);
+
+  uint64_t sent[BENCH_NUM_KINDS] = {0};
+  int num_msgs = 0;
+  do {
+    const bench_kind kind = pick_kind(bench, conn);
+    msg += build_message(bench, conn, kind, msg);
+    sent[kind]++;
+    num_msgs++;
+  } while (num_msgs < batch && (size_t)(msg_end - msg) >= max_len);
+
+  size_t len = msg - frame;
+  if (batch > 1) {
+    frame[0] = PI_CTRL_BATCH;
+    frame[1] = len - sizeof(RawPictrlHeader);
+  }
+  if (bench->options.extended) {
+    len = add_ext_header(conn, frame, len);
+  }
+  if (lws_write(conn->wsi, frame, len, LWS_WRITE_BINARY) < (int)len) {
+    bench->write_errors++;
+    return -1;
+  }
+
+  pictrl_histogram_record(&bench->send_latency_usec,
+                          pictrl_now_usec() - conn->due_usec);
+  for (int kind = 0; kind < BENCH_NUM_KINDS; kind++) {
+    bench->sent[kind] += sent[kind];
+  }
+  bench->frames_sent++;
+  bench->bytes_sent += len;
+  conn->num_sent += num_msgs;
+  schedule_next(bench, conn);
+  return 0;
+}
+
+static void stop(lws_sorted_usec_list_t *timer) {
+  pictrl_bench *bench = lws_container_of(timer, pictrl_bench, end_timer);
+  if (bench->stopping) {
+    return;
+  }
+  bench->stopping = true;
+  bench->end_usec = pictrl_now_usec();
+  // Everyone closes on their next writeable callback
+  lws_callback_on_writable_all_protocol(bench->context, &protocols[0]);
+}
+
+static int callback_bench(struct lws *wsi, enum lws_callback_reasons reason,
+                          void *user, void *in, size_t len) {
+  pictrl_bench *bench = lws_context_user(lws_get_context(wsi));
+  pictrl_bench_conn *conn = user;
+
+  switch (reason) {
+    case LWS_CALLBACK_CLIENT_ESTABLISHED:
+      conn->wsi = wsi;
+      conn->start_usec = pictrl_now_usec();
+      conn->rng = 0x9E3779B9u * (uint32_t)++bench->next_conn_id;
+      if (bench->start_usec == 0) {
+        bench->start_usec = conn->start_usec;
+        lws_sul_schedule(
+            bench->context, 0, &bench->end_timer, &stop,
+            (lws_usec_t)(bench->options.duration_secs * PICTRL_USEC_PER_SEC));
+      }
+      schedule_next(bench, conn);
+      break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+      if (bench->stopping) {
+        return -1;
+      }
+      if (bench->options.extended && !conn->said_hello) {
+        return send_hello(bench, conn);
+      }
+      if (conn->due_usec <= pictrl_now_usec()) {
+        return send_next(bench, conn);
+      }
+      break;
+    case LWS_CALLBACK_CLIENT_RECEIVE: {
+      const uint8_t *bytes = in;
+      if (bench->options.extended && len >= sizeof(RawPictrlHeader) &&
+          bytes[0] == PI_CTRL_HELLO &&
+          len == sizeof(RawPictrlHeader) + bytes[1]) {
+        const RawPiCtrlMessage msg = parse_to_pictrl_msg(in, len);
+        return handle_hello(bench, conn, &msg);
+      }
+      bench->received++;
+      break;
+    }
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+      lwsl_err("Could not connect: %s\n",
+               (in != NULL) ? (const char *)in : "unknown error");
+      bench->connect_errors++;
+      bench->active--;
+      break;
+    case LWS_CALLBACK_CLIENT_CLOSED:
+      lws_sul_cancel(&conn->send_timer);
+      if (!bench->stopping && !conn->refused) {
+        bench->server_closes++;
+      }
+      bench->active--;
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+static void print_report(const pictrl_bench *bench) {
+  const pictrl_bench_options *options = &bench->options;
+  uint64_t total_sent = 0;
+  for (int kind = 0; kind < BENCH_NUM_KINDS; kind++) {
+    total_sent += bench->sent[kind];
+  }
+  const double elapsed_secs =
+      (double)(bench->end_usec - bench->start_usec) / PICTRL_USEC_PER_SEC;
+
+  printf("Connections: %d (%llu failed to connect, %llu closed by the "
+         "server)\n",
+         options->num_conns, (unsigned long long)bench->connect_errors,
+         (unsigned long long)bench->server_closes);
+  printf("Sent %llu messages (%llu bytes, %llu frames) in %.2fs: %.0f "
+         "messages/s",
+         (unsigned long long)total_sent, (unsigned long long)bench->bytes_sent,
+         (unsigned long long)bench->frames_sent, elapsed_secs,
+         (elapsed_secs > 0) ? total_sent / elapsed_secs : 0);
+  if (options->rate > 0) {
+    printf(" (target %.0f)", options->rate * options->num_conns);
+  }
+  printf("\n ");
+  for (int kind = 0; kind < BENCH_NUM_KINDS; kind++) {
+    printf(" %s %llu", BENCH_KIND_NAMES[kind],
+           (unsigned long long)bench->sent[kind]);
+  }
+  printf("\n");
+
+  const pictrl_histogram *latency = &bench->send_latency_usec;
+  if (latency->total > 0) {
+    printf("Send latency (us): mean %llu, p50 %llu, p90 %llu, p99 %llu, "
+           "p99.9 %llu, max %llu\n",
+           (unsigned long long)pictrl_histogram_mean(latency),
+           (unsigned long long)pictrl_histogram_percentile(latency, 50),
+           (unsigned long long)pictrl_histogram_percentile(latency, 90),
+           (unsigned long long)pictrl_histogram_percentile(latency, 99),
+           (unsigned long long)pictrl_histogram_percentile(latency, 99.9),
+           (unsigned long long)latency->max);
+  }
+  if (options->extended) {
+    printf("Hellos: %llu from the server, %llu without the capabilities we "
+           "need\n",
+           (unsigned long long)bench->hellos,
+           (unsigned long long)bench->refused);
+  }
+  printf("Errors: %llu failed writes, %llu unexpected messages from the "
+         "server\n",
+         (unsigned long long)bench->write_errors,
+         (unsigned long long)bench->received);
+}
+
+// "mv=90,click=4,text=4,keysym=2", leaving out kinds that shouldn't be sent
+static bool parse_mix(const char *arg, pictrl_bench_options *options) {
+  memset(options->mix, 0, sizeof(options->mix));
+  options->mix_total = 0;
+
+  char *copy = strdup(arg);
+  char *save = NULL;
+  bool ok = true;
+  for (char *item = strtok_r(copy, ",", &save); item != NULL && ok;
+       item = strtok_r(NULL, ",", &save)) {
+    char *equals = strchr(item, '=');
+    ok = false;
+    if (equals == NULL) {
+      break;
+    }
+    *equals = '\0';
+    for (int kind = 0; kind < BENCH_NUM_KINDS; kind++) {
+      if (strcmp(item, BENCH_KIND_NAMES[kind]) == 0) {
+        options->mix[kind] = strtoul(equals + 1, NULL, 10);
+        options->mix_total += options->mix[kind];
+        ok = true;
+      }
+    }
+  }
+  free(copy);
+  return ok && options->mix_total > 0;
+}
+
+static void print_usage(FILE *stream, const char *prog) {
+  fprintf(stream,
+          "Usage: %s [-H HOST] [-p PORT] [-c CONNS] [-r RATE] [-d SECS] "
+          "[-m MIX] [-l TEXT_LEN] [-b BATCH] [-x]\n"
+          "  -H HOST      Server to load (default: localhost)\n"
+          "  -p PORT      Its port (default: %d)\n"
+          "  -c CONNS     Connections to open (default: 1). The server "
+          "turns away\n"
+          "               any past its first %d\n"
+          "  -r RATE      Messages/s per connection, 0 for as fast as "
+          "possible\n"
+          "               (default: 1000)\n"
+          "  -d SECS      How long to run for (default: 10)\n"
+          "  -m MIX       Relative weights of each kind of message\n"
+          "               (default: mv=85,click=5,text=5,keysym=5)\n"
+          "  -l TEXT_LEN  Characters per text message (default: 16)\n"
+          "  -b BATCH     Messages per frame, batched if more than 1 "
+          "(default: 1)\n"
+          "  -x           Say hello (protocol v%d) and send extended headers, "
+          "for\n"
+          "               the server's link stats\n"
+          "  -h           Show this help\n"
+          "Clicks and keys are really sent: run the server with -b null\n",
+          prog, SERVER_PORT, MAX_CONNS, PICTRL_PROTOCOL_VERSION);
+}
+
+int main(int argc, char **argv) {
+  pictrl_bench bench = {
+      .options = {.host = "localhost",
+                  .port = SERVER_PORT,
+                  .num_conns = 1,
+                  .rate = 1000,
+                  .duration_secs = 10,
+                  .text_len = 16,
+                  .batch = 1}};
+  pictrl_bench_options *options = &bench.options;
+  parse_mix("mv=85,click=5,text=5,keysym=5", options);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "H:p:c:r:d:m:l:b:xh")) != -1) {
+    switch (opt) {
+      case 'H':
+        options->host = optarg;
+        break;
+      case 'p':
+        options->port = atoi(optarg);
+        break;
+      case 'c':
+        options->num_conns = atoi(optarg);
+        break;
+      case 'r':
+        options->rate = atof(optarg);
+        break;
+      case 'd':
+        options->duration_secs = atof(optarg);
+        break;
+      case 'm':
+        if (!parse_mix(optarg, options)) {
+          fprintf(stderr, "Bad mix: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'l':
+        options->text_len = atoi(optarg);
+        break;
+      case 'b':
+        options->batch = atoi(optarg);
+        break;
+      case 'x':
+        options->extended = true;
+        break;
+      case 'h':
+        print_usage(stdout, argv[0]);
+        return 0;
+      default:
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc || options->num_conns <= 0 || options->rate < 0 ||
+      options->duration_secs <= 0 || options->text_len < 1 ||
+      options->text_len > UINT8_MAX || options->batch < 1 ||
+      (options->batch > 1 && max_message_len(options) > UINT8_MAX)) {
+    print_usage(stderr, argv[0]);
+    return 1;
+  }
+  pictrl_histogram_init(&bench.send_latency_usec);
+
+  lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+  const struct lws_context_creation_info info = {
+      .port = CONTEXT_PORT_NO_LISTEN,
+      .protocols = protocols,
+      .gid = -1,
+      .uid = -1,
+      .user = &bench,
+  };
+  bench.context = lws_create_context(&info);
+  if (bench.context == NULL) {
+    lwsl_err("lws init failed\n");
+    return 1;
+  }
+
+  for (int i = 0; i < options->num_conns; i++) {
+    const struct lws_client_connect_info connect_info = {
+        .context = bench.context,
+        .address = options->host,
+        .port = options->port,
+        .path = "/",
+        .host = options->host,
+        .origin = options->host,
+    };
+    if (lws_client_connect_via_info(&connect_info) == NULL) {
+      bench.connect_errors++;
+    } else {
+      bench.active++;
+    }
+  }
+
+  signal(SIGINT, &interrupt_handler);
+  while (bench.active > 0 && lws_service(bench.context, 0) >= 0) {
+    if (interrupted) {
+      stop(&bench.end_timer);
+    }
+  }
+  if (!bench.stopping) {
+    bench.end_usec = pictrl_now_usec();  // Everyone went away on their own
+  }
+  lws_sul_cancel(&bench.end_timer);
+
+  if (bench.start_usec != 0) {
+    print_report(&bench);
+  }
+  lws_context_destroy(bench.context);
+  const uint64_t failures = bench.connect_errors + bench.server_closes +
+                            bench.write_errors + bench.refused;
+  return (failures > 0) ? 1 : 0;
+}
@@ -7,8 +7,9 @@
 #define MAX_BUF 4096
 
 /*
-Only 1 client will be connected (i.e. sending commands) to the server at once,
-but we can tell the others to get lost if there is an existing open connection.
+Only 1 client will be connected (i.e. sending commands) to the server at once:
+the others get told to get lost (and closed on) while there's an existing open
+connection.
 */
 #define MAX_CONNS 1
 
@@ -22,4 +23,79 @@ but we can tell the others to get lost if there is an existing open connection.
 // more than this... right?
 #define PICTRL_MAX_SIMUL_KEYS 10
 
+/*
+ * Relative mouse moves that arrive within this many microseconds of the last
+ * one we emitted get summed up and emitted together at the end of the frame.
+ * Clicks and key presses flush whatever motion is pending first, so ordering is
+ * kept. 0 emits every move as soon as it arrives
+ */
+#define PICTRL_MOUSE_FRAME_USEC 4000  // 4ms
+
+/*
+ * Typed text is released to the virtual keyboard at most one report (key downs
+ * or key ups, so half a character) every this many microseconds, with up to
+ * PICTRL_KEY_BURST_REPORTS going out back to back after an idle period. Lower
+ * types faster, as long as the app on the other end keeps up. 0 disables pacing
+ */
+#define PICTRL_KEY_REPORT_INTERVAL_USEC 1000  // 500 characters/second
+#define PICTRL_KEY_BURST_REPORTS 16
+
+// Most input events that can be waiting to be paced out. Must be a power of 2
+#define PICTRL_KEY_QUEUE_EVENTS 4096
+
+/*
+ * Also create a "PiControl Virtual Tablet" device, so clients can send absolute
+ * positions (PI_CTRL_MOUSE_ABS) instead of relative moves. 0 to only create the
+ * keyboard/mouse, in which case absolute positions are ignored
+ */
+#define PICTRL_ABS_POINTER 1
+
+/*
+ * Number of distinct keysym combos (i.e. "Ctrl+c") whose events are kept
+ * around, so repeats skip parsing. Must be a power of 2. Combos longer than
+ * PICTRL_KEYSYM_CACHE_KEY_MAX bytes are never cached
+ */
+#define PICTRL_KEYSYM_CACHE_ENTRIES 32
+#define PICTRL_KEYSYM_CACHE_KEY_MAX 32
+
+/*
+ * Where the record backend (`-b record`) journals events, unless the
+ * PICTRL_RECORD_PATH environment variable says otherwise, and how many events
+ * it has room for before the file has to grow (it doubles each time)
+ */
+#define PICTRL_RECORD_PATH "picontrol.journal"
+#define PICTRL_RECORD_INITIAL_EVENTS 65536
+
+// (in bytes) How much of a capture (`-c`) is buffered before it hits the disk
+#define PICTRL_CAPTURE_BUFFER_SIZE (64 * 1024)
+
+/*
+ * (in bytes) Per connection, how much received data can be waiting to be
+ * handled: partial messages waiting on the rest of them, and whatever's after
+ * them in the same frame. Must be a power of 2, and hold at least a couple of
+ * the biggest messages (it gets rounded up to a whole page)
+ */
+#define PICTRL_RX_BUFFER_SIZE 4096
+
+/*
+ * (USE_PIPELINE builds only) Number of decoded messages that can be waiting for
+ * the emitter thread. Must be a power of 2
+ */
+#define PICTRL_PIPELINE_QUEUE_LEN 256
+
+/*
+ * (USE_PIPELINE builds only) Longest the network thread waits for room in a
+ * full queue before dropping a mouse move (or scroll), so a stuck backend
+ * can't keep it from servicing sockets. Clicks, keys and text wait as long as
+ * it takes
+ */
+#define PICTRL_PIPELINE_STALL_USEC 2000  // 2ms
+
+/*
+ * (USE_PIPELINE builds only) CPU to pin the emitter thread to. -1 picks the
+ * last online CPU, leaving CPU 0 to the network thread and the rest of the
+ * system
+ */
+#define PICTRL_EMITTER_CPU -1
+
 #endif
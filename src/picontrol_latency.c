@@ -0,0 +1,502 @@
+/*
+Measures end-to-end input latency: how long from a client sending a message
+until the events it turns into show up on the server's virtual keyboard. That's
+the delay users actually feel (network, decoding, pacing, uinput and evdev
+included), as opposed to what picontrol_bench sees from the client's side.
+
+Has to run on the same machine as the server (using the uinput backend), as
+someone allowed to read /dev/input (root, or the input group). It finds the
+"PiControl Virtual Keyboard" node, grabs it (EVIOCGRAB, so none of the probes
+reach the desktop), and asks evdev to timestamp events with CLOCK_MONOTONIC
+(EVIOCSCLOCKID), the clock we take send times from.
+
+Probes go out one at a time, cycling through mouse moves, clicks, text and
+keysyms. Each one says which probe it is in what it sends: moves by how far
+they go, clicks by which way the button goes, and text/keysyms by which key
+gets pressed. The first matching event after a probe is sent is its arrival.
+
+Usage: picontrol_latency [-H HOST] [-p PORT] [-d DEVICE] [-n PROBES]
+                         [-i GAP_MS] [-t TIMEOUT_MS]
+*/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libwebsockets.h>
+#include <linux/input.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backend/picontrol_uinput.h"
+#include "data_structures/histogram.h"
+#include "logging/log_utils.h"
+#include "model/mouse.h"
+#include "model/protocol.h"
+#include "picontrol_config.h"
+#include "util.h"
+
+// How often the device is checked for events. Arrival times come from evdev's
+// timestamps, so this only limits how quickly the next probe goes out
+#define PICTRL_LATENCY_POLL_USEC 500
+
+typedef enum {
+  PROBE_MOUSE_MV,
+  PROBE_MOUSE_CLICK,
+  PROBE_TEXT,
+  PROBE_KEYSYM,
+  PROBE_NUM_KINDS
+} probe_kind;
+
+static const char *PROBE_KIND_NAMES[PROBE_NUM_KINDS] = {"mv", "click", "text",
+                                                        "keysym"};
+
+// Adjacent keys on the keyboard, so the nth one is KEY_Q + n
+static const char PROBE_TEXT_KEYS[] = "qwertyuiop";
+
+// Likewise KEY_F1 + n
+static const char *PROBE_KEYSYMS[] = {"F1", "F2", "F3", "F4", "F5",
+                                      "F6", "F7", "F8", "F9", "F10"};
+
+typedef struct {
+  unsigned short type, code;
+  int value;
+} probe_event;
+
+typedef struct {
+  const char *host;
+  int port;
+  const char *device_path;  // NULL to go looking for it
+  unsigned long probes;     // Per kind
+  uint64_t gap_usec;
+  uint64_t timeout_usec;
+
+  int evdev_fd;
+  struct lws_context *context;
+  struct lws *wsi;
+  lws_sorted_usec_list_t send_timer;
+  lws_sorted_usec_list_t poll_timer;
+
+  unsigned long num_probes;  // Sent so far, of every kind
+  bool in_flight;
+  bool ready;  // The next probe can go out as soon as it's writeable
+  probe_kind kind;
+  probe_event expected;
+  uint64_t sent_usec;
+  bool mouse_down;
+
+  pictrl_histogram latency_usec[PROBE_NUM_KINDS];
+  unsigned long lost[PROBE_NUM_KINDS];
+
+  bool done;
+  int ret;
+} pictrl_latency;
+
+static volatile sig_atomic_t interrupted = false;
+
+static void interrupt_handler(int signum) {
+  (void)signum;
+  interrupted = true;
+}
+
+static bool all_sent(const pictrl_latency *latency) {
+  return latency->num_probes >= latency->probes * PROBE_NUM_KINDS;
+}
+
+/*
+Opens `path`, or the first /dev/input/event* called `name` if it's NULL, to
+read events from. Returns -1 (and logs why) on failure.
+*/
+static int open_evdev(const char *path, const char *name) {
+  if (path != NULL) {
+    const int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      pictrl_log_error("Could not open %s: %s\n", path, strerror(errno));
+    }
+    return fd;
+  }
+
+  DIR *dir = opendir("/dev/input");
+  if (dir == NULL) {
+    pictrl_log_error("Could not list /dev/input: %s\n", strerror(errno));
+    return -1;
+  }
+  int found = -1;
+  struct dirent *entry;
+  while (found < 0 && (entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "event", strlen("event")) != 0) {
+      continue;
+    }
+    char node[sizeof("/dev/input/") + sizeof(entry->d_name)];
+    snprintf(node, sizeof(node), "/dev/input/%s", entry->d_name);
+    const int fd = open(node, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    char dev_name[256] = "";
+    if (ioctl(fd, EVIOCGNAME(sizeof(dev_name) - 1), dev_name) >= 0 &&
+        strcmp(dev_name, name) == 0) {
+      pictrl_log_info("Found \"%s\" at %s\n", name, node);
+      found = fd;
+    } else {
+      close(fd);
+    }
+  }
+  closedir(dir);
+
+  if (found < 0) {
+    pictrl_log_error("No \"%s\" in /dev/input (is the server running, with "
+                     "the uinput backend, and can we read /dev/input?)\n",
+                     name);
+  }
+  return found;
+}
+
+static void drain_evdev(int fd) {
+  struct input_event events[64];
+  while (read(fd, events, sizeof(events)) > 0) {
+  }
+}
+
+// Builds the next probe right after `buf`'s LWS_PRE bytes, remembering which
+// event will mean it arrived. Returns its length
+static size_t build_probe(pictrl_latency *latency, uint8_t *buf) {
+  uint8_t *msg = buf + LWS_PRE;
+  uint8_t *payload = msg + sizeof(RawPictrlHeader);
+  const unsigned long n = latency->num_probes / PROBE_NUM_KINDS;
+  size_t payload_size = 0;
+
+  latency->kind = latency->num_probes % PROBE_NUM_KINDS;
+  switch (latency->kind) {
+    case PROBE_MOUSE_MV: {
+      // Back and forth by the same amount, so the pointer stays put (every
+      // other pair moves a bit further, between 1 and 10 pixels)
+      const int8_t distance = (int8_t)((n / 2) % 10 + 1);
+      const int8_t dx = (n % 2 == 0) ? distance : -distance;
+      msg[0] = PI_CTRL_MOUSE_MV;
+      payload[0] = (uint8_t)dx;
+      payload[1] = 0;
+      payload_size = 2;
+      latency->expected = (probe_event){EV_REL, REL_X, dx};
+      break;
+    }
+    case PROBE_MOUSE_CLICK: {
+      latency->mouse_down = !latency->mouse_down;
+      const bool down = latency->mouse_down;
+      msg[0] = PI_CTRL_MOUSE_CLICK;
+      payload[0] = (PI_CTRL_MOUSE_LEFT << 1) |
+                   (down ? PI_CTRL_MOUSE_DOWN : PI_CTRL_MOUSE_UP);
+      payload_size = 1;
+      latency->expected = (probe_event){
+          EV_KEY, BTN_LEFT, down ? PICTRL_KEY_DOWN : PICTRL_KEY_UP};
+      break;
+    }
+    case PROBE_TEXT: {
+      const size_t key = n % strlen(PROBE_TEXT_KEYS);
+      msg[0] = PI_CTRL_TEXT;
+      payload[0] = PROBE_TEXT_KEYS[key];
+      payload_size = 1;
+      latency->expected = (probe_event){EV_KEY, KEY_Q + key, PICTRL_KEY_DOWN};
+      break;
+    }
+    case PROBE_KEYSYM: {
+      const size_t key = n % PICTRL_SIZE(PROBE_KEYSYMS);
+      msg[0] = PI_CTRL_KEYSYM;
+      payload_size = strlen(PROBE_KEYSYMS[key]);
+      memcpy(payload, PROBE_KEYSYMS[key], payload_size);
+      latency->expected = (probe_event){EV_KEY, KEY_F1 + key, PICTRL_KEY_DOWN};
+      break;
+    }
+    default:
+      break;
+  }
+  msg[1] = payload_size;
+  return sizeof(RawPictrlHeader) + payload_size;
+}
+
+static void send_when_writeable(lws_sorted_usec_list_t *timer) {
+  pictrl_latency *latency =
+      lws_container_of(timer, pictrl_latency, send_timer);
+  latency->ready = true;
+  lws_callback_on_writable(latency->wsi);
+}
+
+// The last probe arrived (or never will): wait a bit, then send the next one,
+// or close up once they've all gone out
+static void finish_probe(pictrl_latency *latency) {
+  latency->in_flight = false;
+  if (all_sent(latency) || interrupted) {
+    latency->ready = true;  // To close the connection
+    lws_callback_on_writable(latency->wsi);
+    return;
+  }
+  lws_sul_schedule(latency->context, 0, &latency->send_timer,
+                   &send_when_writeable, latency->gap_usec);
+}
+
+static bool is_expected(const pictrl_latency *latency,
+                        const struct input_event *ie) {
+  return ie->type == latency->expected.type &&
+         ie->code == latency->expected.code &&
+         ie->value == latency->expected.value;
+}
+
+static void poll_evdev(lws_sorted_usec_list_t *timer) {
+  pictrl_latency *latency =
+      lws_container_of(timer, pictrl_latency, poll_timer);
+
+  struct input_event events[64];
+  ssize_t bytes;
+  while (latency->in_flight &&
+         (bytes = read(latency->evdev_fd, events, sizeof(events))) > 0) {
+    for (size_t i = 0; i < bytes / sizeof(events[0]); i++) {
+      const uint64_t event_usec =
+          (uint64_t)events[i].input_event_sec * PICTRL_USEC_PER_SEC +
+          events[i].input_event_usec;
+      // Anything from before the probe went out is left over from the last one
+      if (event_usec >= latency->sent_usec &&
+          is_expected(latency, &events[i])) {
+        pictrl_histogram_record(&latency->latency_usec[latency->kind],
+                                event_usec - latency->sent_usec);
+        finish_probe(latency);
+        break;
+      }
+    }
+  }
+
+  if (latency->in_flight &&
+      pictrl_now_usec() - latency->sent_usec > latency->timeout_usec) {
+    latency->lost[latency->kind]++;
+    finish_probe(latency);
+  }
+  if (latency->in_flight) {
+    lws_sul_schedule(latency->context, 0, &latency->poll_timer, &poll_evdev,
+                     PICTRL_LATENCY_POLL_USEC);
+  }
+}
+
+static int send_probe(pictrl_latency *latency) {
+  static uint8_t buf[LWS_PRE + sizeof(RawPictrlHeader) + UINT8_MAX];
+  const size_t len = build_probe(latency, buf);
+
+  latency->sent_usec = pictrl_now_usec();
+  if (lws_write(latency->wsi, buf + LWS_PRE, len, LWS_WRITE_BINARY) <
+      (int)len) {
+    lwsl_err("Could not send probe %lu\n", latency->num_probes);
+    latency->ret = 1;
+    return -1;
+  }
+  latency->num_probes++;
+  latency->in_flight = true;
+  lws_sul_schedule(latency->context, 0, &latency->poll_timer, &poll_evdev,
+                   PICTRL_LATENCY_POLL_USEC);
+  return 0;
+}
+
+// Lets go of the button if the last click probe left it down, then closes
+static int release_mouse(pictrl_latency *latency) {
+  if (!latency->mouse_down) {
+    return -1;
+  }
+  static uint8_t buf[LWS_PRE + sizeof(RawPictrlHeader) + 1];
+  uint8_t *msg = buf + LWS_PRE;
+  msg[0] = PI_CTRL_MOUSE_CLICK;
+  msg[1] = 1;
+  msg[2] = (PI_CTRL_MOUSE_LEFT << 1) | PI_CTRL_MOUSE_UP;
+  if (lws_write(latency->wsi, msg, 3, LWS_WRITE_BINARY) < 3) {
+    return -1;
+  }
+  latency->mouse_down = false;
+  latency->ready = true;
+  lws_callback_on_writable(latency->wsi);
+  return 0;
+}
+
+static int callback_latency(struct lws *wsi, enum lws_callback_reasons reason,
+                            void *user, void *in, size_t len) {
+  (void)user;
+  (void)len;
+  pictrl_latency *latency = lws_context_user(lws_get_context(wsi));
+
+  switch (reason) {
+    case LWS_CALLBACK_CLIENT_ESTABLISHED:
+      lwsl_user("Connected, probing...\n");
+      drain_evdev(latency->evdev_fd);
+      lws_sul_schedule(latency->context, 0, &latency->send_timer,
+                       &send_when_writeable, latency->gap_usec);
+      break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+      if (!latency->ready || latency->in_flight) {
+        break;
+      }
+      latency->ready = false;
+      if (all_sent(latency) || interrupted) {
+        return release_mouse(latency);
+      }
+      return send_probe(latency);
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+      lwsl_err("Could not connect: %s\n",
+               (in != NULL) ? (const char *)in : "unknown error");
+      latency->ret = 1;
+      latency->done = true;
+      break;
+    case LWS_CALLBACK_CLIENT_CLOSED:
+      latency->done = true;
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+    {
+        .name = "picontrol-latency",
+        .callback = &callback_latency,
+        .per_session_data_size = 0,
+        .rx_buffer_size = 0,
+    },
+    LWS_PROTOCOL_LIST_TERM};
+
+static void print_report(const pictrl_latency *latency) {
+  printf("%-8s %8s %6s %8s %8s %8s %8s (us)\n", "", "probes", "lost", "p50",
+         "p99", "p99.9", "max");
+  for (int kind = 0; kind < PROBE_NUM_KINDS; kind++) {
+    const pictrl_histogram *hist = &latency->latency_usec[kind];
+    printf("%-8s %8llu %6lu", PROBE_KIND_NAMES[kind],
+           (unsigned long long)(hist->total + latency->lost[kind]),
+           latency->lost[kind]);
+    if (hist->total > 0) {
+      printf(" %8llu %8llu %8llu %8llu",
+             (unsigned long long)pictrl_histogram_percentile(hist, 50),
+             (unsigned long long)pictrl_histogram_percentile(hist, 99),
+             (unsigned long long)pictrl_histogram_percentile(hist, 99.9),
+             (unsigned long long)hist->max);
+    }
+    printf("\n");
+  }
+}
+
+static void print_usage(FILE *stream, const char *prog) {
+  fprintf(stream,
+          "Usage: %s [-H HOST] [-p PORT] [-d DEVICE] [-n PROBES] [-i GAP_MS] "
+          "[-t TIMEOUT_MS]\n"
+          "  -H HOST        Server to probe (default: localhost)\n"
+          "  -p PORT        Its port (default: %d)\n"
+          "  -d DEVICE      Its virtual keyboard's event node (default: look "
+          "for\n"
+          "                 \"%s\")\n"
+          "  -n PROBES      Probes of each kind to send (default: 1000)\n"
+          "  -i GAP_MS      Wait between one probe arriving and the next "
+          "(default: 10)\n"
+          "  -t TIMEOUT_MS  Count a probe as lost after this long "
+          "(default: 500)\n"
+          "  -h             Show this help\n",
+          prog, SERVER_PORT, PICTRL_UINPUT_KEYBOARD_NAME);
+}
+
+int main(int argc, char **argv) {
+  pictrl_latency latency = {.host = "localhost",
+                            .port = SERVER_PORT,
+                            .probes = 1000,
+                            .gap_usec = 10 * 1000,
+                            .timeout_usec = 500 * 1000};
+  int opt;
+  while ((opt = getopt(argc, argv, "H:p:d:n:i:t:h")) != -1) {
+    switch (opt) {
+      case 'H':
+        latency.host = optarg;
+        break;
+      case 'p':
+        latency.port = atoi(optarg);
+        break;
+      case 'd':
+        latency.device_path = optarg;
+        break;
+      case 'n':
+        latency.probes = strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        latency.gap_usec = (uint64_t)(atof(optarg) * 1000);
+        break;
+      case 't':
+        latency.timeout_usec = (uint64_t)(atof(optarg) * 1000);
+        break;
+      case 'h':
+        print_usage(stdout, argv[0]);
+        return 0;
+      default:
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc || latency.probes == 0 || latency.timeout_usec == 0) {
+    print_usage(stderr, argv[0]);
+    return 1;
+  }
+
+  latency.evdev_fd =
+      open_evdev(latency.device_path, PICTRL_UINPUT_KEYBOARD_NAME);
+  if (latency.evdev_fd < 0) {
+    return 1;
+  }
+  int clock = CLOCK_MONOTONIC;
+  if (ioctl(latency.evdev_fd, EVIOCSCLOCKID, &clock) < 0 ||
+      ioctl(latency.evdev_fd, EVIOCGRAB, 1) < 0) {
+    pictrl_log_error("Could not set up the device: %s\n", strerror(errno));
+    close(latency.evdev_fd);
+    return 1;
+  }
+  for (int kind = 0; kind < PROBE_NUM_KINDS; kind++) {
+    pictrl_histogram_init(&latency.latency_usec[kind]);
+  }
+
+  lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+  const struct lws_context_creation_info info = {
+      .port = CONTEXT_PORT_NO_LISTEN,
+      .protocols = protocols,
+      .gid = -1,
+      .uid = -1,
+      .user = &latency,
+  };
+  latency.context = lws_create_context(&info);
+  if (latency.context == NULL) {
+    lwsl_err("lws init failed\n");
+    close(latency.evdev_fd);
+    return 1;
+  }
+
+  const struct lws_client_connect_info connect_info = {
+      .context = latency.context,
+      .address = latency.host,
+      .port = latency.port,
+      .path = "/",
+      .host = latency.host,
+      .origin = latency.host,
+      .pwsi = &latency.wsi,
+  };
+  if (lws_client_connect_via_info(&connect_info) == NULL) {
+    lwsl_err("Could not connect to %s:%d\n", latency.host, latency.port);
+    latency.ret = 1;
+    latency.done = true;
+  }
+
+  signal(SIGINT, &interrupt_handler);
+  while (!latency.done && lws_service(latency.context, 0) >= 0) {
+  }
+  lws_sul_cancel(&latency.send_timer);
+  lws_sul_cancel(&latency.poll_timer);
+  if (latency.num_probes > 0) {
+    print_report(&latency);
+  }
+
+  lws_context_destroy(latency.context);
+  ioctl(latency.evdev_fd, EVIOCGRAB, 0);
+  close(latency.evdev_fd);
+  return latency.ret;
+}
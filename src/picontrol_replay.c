@@ -0,0 +1,263 @@
+/*
+Plays a capture (see `picontrol_server -c`) back to a running server over a
+websocket, the same way a client would have sent it: at the pace it was
+recorded, N times faster, or as fast as the connection takes it. Prints how
+closely it kept to the schedule, and the throughput, once it's done.
+
+Usage: picontrol_replay [-H HOST] [-p PORT] [-s SPEED | -f] [-n LOOPS] FILE
+*/
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "networking/capture.h"
+#include "picontrol_config.h"
+#include "util.h"
+
+typedef struct {
+  pictrl_capture_reader reader;
+  double speed;  // 0 sends everything as soon as it can
+  unsigned long loops;
+
+  struct lws_context *context;
+  struct lws *wsi;
+  lws_sorted_usec_list_t send_timer;
+
+  pictrl_capture_message next;  // Up next, if `have_next`
+  bool have_next;
+  unsigned long loops_done;
+  uint64_t loop_start_usec;  // When the current loop's first message was due
+
+  uint64_t start_usec;
+  uint64_t num_sent;
+  uint64_t bytes_sent;
+  uint64_t total_late_usec;
+  uint64_t max_late_usec;
+
+  bool done;
+  int ret;
+} pictrl_replay;
+
+static uint64_t due_usec(const pictrl_replay *replay) {
+  if (replay->speed == 0) {
+    return 0;
+  }
+  return replay->loop_start_usec +
+         (uint64_t)(replay->next.offset_usec / replay->speed);
+}
+
+// Moves on to the next message, starting over at the end if there are loops
+// left. Returns false once everything has been sent
+static bool advance(pictrl_replay *replay) {
+  replay->have_next = pictrl_capture_next(&replay->reader, &replay->next);
+  if (!replay->have_next && ++replay->loops_done < replay->loops) {
+    pictrl_capture_reader_rewind(&replay->reader);
+    replay->loop_start_usec = pictrl_now_usec();
+    replay->have_next = pictrl_capture_next(&replay->reader, &replay->next);
+  }
+  return replay->have_next;
+}
+
+static void request_write(lws_sorted_usec_list_t *timer) {
+  pictrl_replay *replay = lws_container_of(timer, pictrl_replay, send_timer);
+  lws_callback_on_writable(replay->wsi);
+}
+
+// Sends the message that's up next (it must be due), and waits for the one
+// after it. Returns -1 to close the connection once there's nothing left
+static int send_next(pictrl_replay *replay) {
+  static uint8_t buf[LWS_PRE + UINT16_MAX];
+  memcpy(buf + LWS_PRE, replay->next.data, replay->next.len);
+  if (lws_write(replay->wsi, buf + LWS_PRE, replay->next.len,
+                LWS_WRITE_BINARY) < (int)replay->next.len) {
+    lwsl_err("Could not send message %llu\n",
+             (unsigned long long)replay->num_sent);
+    replay->ret = 1;
+    return -1;
+  }
+
+  const uint64_t now = pictrl_now_usec();
+  const uint64_t late = (now > due_usec(replay)) ? now - due_usec(replay) : 0;
+  replay->total_late_usec += late;
+  if (late > replay->max_late_usec) {
+    replay->max_late_usec = late;
+  }
+  replay->num_sent++;
+  replay->bytes_sent += replay->next.len;
+
+  if (!advance(replay)) {
+    return -1;
+  }
+  // lws only wants one write per writeable callback, so even if the next one
+  // is already due, go around again
+  const uint64_t due = due_usec(replay);
+  if (due <= now) {
+    lws_callback_on_writable(replay->wsi);
+  } else {
+    lws_sul_schedule(replay->context, 0, &replay->send_timer, &request_write,
+                     due - now);
+  }
+  return 0;
+}
+
+static int callback_replay(struct lws *wsi, enum lws_callback_reasons reason,
+                           void *user, void *in, size_t len) {
+  (void)user;
+  (void)len;
+  pictrl_replay *replay = lws_context_user(lws_get_context(wsi));
+
+  switch (reason) {
+    case LWS_CALLBACK_CLIENT_ESTABLISHED:
+      lwsl_user("Connected, replaying...\n");
+      replay->start_usec = pictrl_now_usec();
+      replay->loop_start_usec = replay->start_usec;
+      if (!advance(replay)) {
+        lwsl_warn("Capture is empty\n");
+        return -1;
+      }
+      lws_callback_on_writable(wsi);
+      break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+      if (replay->have_next && due_usec(replay) <= pictrl_now_usec()) {
+        return send_next(replay);
+      }
+      break;
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+      lwsl_err("Could not connect: %s\n",
+               (in != NULL) ? (const char *)in : "unknown error");
+      replay->ret = 1;
+      replay->done = true;
+      break;
+    case LWS_CALLBACK_CLIENT_CLOSED:
+      replay->done = true;
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+    {
+        .name = "picontrol-replay",
+        .callback = &callback_replay,
+        .per_session_data_size = 0,
+        .rx_buffer_size = 0,
+    },
+    LWS_PROTOCOL_LIST_TERM};
+
+static void print_stats(const pictrl_replay *replay) {
+  const uint64_t elapsed_usec = pictrl_now_usec() - replay->start_usec;
+  const double elapsed_secs = (double)elapsed_usec / PICTRL_USEC_PER_SEC;
+  printf("Sent %llu messages (%llu bytes) in %.3fs: %.0f messages/s\n",
+         (unsigned long long)replay->num_sent,
+         (unsigned long long)replay->bytes_sent, elapsed_secs,
+         (elapsed_secs > 0) ? replay->num_sent / elapsed_secs : 0);
+  if (replay->speed != 0 && replay->num_sent > 0) {
+    printf("Behind schedule by %lluus on average, %lluus at most\n",
+           (unsigned long long)(replay->total_late_usec / replay->num_sent),
+           (unsigned long long)replay->max_late_usec);
+  }
+}
+
+static void print_usage(FILE *stream, const char *prog) {
+  fprintf(stream,
+          "Usage: %s [-H HOST] [-p PORT] [-s SPEED | -f] [-n LOOPS] FILE\n"
+          "  -H HOST   Server to replay to (default: localhost)\n"
+          "  -p PORT   Its port (default: %d)\n"
+          "  -s SPEED  Replay this many times faster than recorded (default: "
+          "1)\n"
+          "  -f        Replay as fast as possible\n"
+          "  -n LOOPS  Replay the whole capture this many times (default: 1)\n"
+          "  -h        Show this help\n",
+          prog, SERVER_PORT);
+}
+
+int main(int argc, char **argv) {
+  const char *host = "localhost";
+  int port = SERVER_PORT;
+  pictrl_replay replay = {.speed = 1, .loops = 1};
+  int opt;
+  while ((opt = getopt(argc, argv, "H:p:s:fn:h")) != -1) {
+    switch (opt) {
+      case 'H':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 's':
+        replay.speed = atof(optarg);
+        if (replay.speed <= 0) {
+          fprintf(stderr, "Speed has to be positive (use -f for flat out)\n");
+          return 1;
+        }
+        break;
+      case 'f':
+        replay.speed = 0;
+        break;
+      case 'n':
+        replay.loops = strtoul(optarg, NULL, 10);
+        break;
+      case 'h':
+        print_usage(stdout, argv[0]);
+        return 0;
+      default:
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1 || replay.loops == 0) {
+    print_usage(stderr, argv[0]);
+    return 1;
+  }
+
+  if (pictrl_capture_reader_open(&replay.reader, argv[optind]) == NULL) {
+    return 1;
+  }
+
+  lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+  const struct lws_context_creation_info info = {
+      .port = CONTEXT_PORT_NO_LISTEN,
+      .protocols = protocols,
+      .gid = -1,
+      .uid = -1,
+      .user = &replay,
+  };
+  replay.context = lws_create_context(&info);
+  if (replay.context == NULL) {
+    lwsl_err("lws init failed\n");
+    pictrl_capture_reader_close(&replay.reader);
+    return 1;
+  }
+
+  const struct lws_client_connect_info connect_info = {
+      .context = replay.context,
+      .address = host,
+      .port = port,
+      .path = "/",
+      .host = host,
+      .origin = host,
+      .pwsi = &replay.wsi,
+  };
+  if (lws_client_connect_via_info(&connect_info) == NULL) {
+    lwsl_err("Could not connect to %s:%d\n", host, port);
+    replay.ret = 1;
+    replay.done = true;
+  }
+
+  while (!replay.done && lws_service(replay.context, 0) >= 0) {
+  }
+  lws_sul_cancel(&replay.send_timer);
+  if (replay.num_sent > 0) {
+    print_stats(&replay);
+  }
+
+  lws_context_destroy(replay.context);
+  pictrl_capture_reader_close(&replay.reader);
+  return replay.ret;
+}
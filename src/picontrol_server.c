@@ -1,8 +1,11 @@
 #include <libwebsockets.h>
 #include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include "backend/picontrol_backend.h"
 #include "networking/websocket_protocol.h"
+#include "picontrol_config.h"
 
 static int picontrol_listen(struct lws_context *context);
 
@@ -12,13 +15,45 @@ const struct lws_protocols protocols[] = {
     {
         .name = "picontrol",
         .callback = &callback_picontrol,
-        .per_session_data_size = 0,
+        .per_session_data_size = sizeof(PiCtrlSession),
         .rx_buffer_size = 0,
         .id = 1  // First iteration of the protocol (ignored by lws)
     },
     LWS_PROTOCOL_LIST_TERM};
 
-int main() {
+static void print_usage(FILE *stream, const char *prog) {
+  fprintf(stream,
+          "Usage: %s [-b BACKEND] [-c FILE]\n"
+          "  -b BACKEND  Backend to emit input with (",
+          prog);
+  pictrl_backend_print_names(stream);
+  fprintf(stream,
+          "). By default, the first one that works\n"
+          "  -c FILE     Capture every message received to FILE, to play it\n"
+          "              back later with picontrol_replay\n"
+          "  -h          Show this help\n");
+}
+
+int main(int argc, char **argv) {
+  PiCtrlServerOptions options = {.backend_name = NULL, .capture_path = NULL};
+  int opt;
+  while ((opt = getopt(argc, argv, "b:c:h")) != -1) {
+    switch (opt) {
+      case 'b':
+        options.backend_name = optarg;
+        break;
+      case 'c':
+        options.capture_path = optarg;
+        break;
+      case 'h':
+        print_usage(stdout, argv[0]);
+        return 0;
+      default:
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+  }
+
   int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE;
   lws_set_log_level(logs, NULL);
 
@@ -28,6 +63,7 @@ int main() {
       .options = LWS_SERVER_OPTION_FALLBACK_TO_APPLY_LISTEN_ACCEPT_CONFIG,
       .gid = -1,
       .uid = -1,
+      .user = &options,
   };
   struct lws_context *ws_context = lws_create_context(&info);
   if (ws_context == NULL) {
@@ -0,0 +1,60 @@
+#ifndef _PICTRL_SERIALIZE_BATCH_H
+#define _PICTRL_SERIALIZE_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logging/log_utils.h"
+#include "model/protocol.h"
+
+// A PI_CTRL_BATCH payload is any number of whole messages (records) back to
+// back, each with its own header. Batches can't be nested, records can't be
+// hellos (those are for the server, not the backend), and records can't have
+// extended headers (the batch itself can)
+//
+// All bytes are unsigned
+// ---------------------------------------------------------------------
+// | CMD | PAYLOAD_SIZE | PAYLOAD | CMD | PAYLOAD_SIZE | PAYLOAD | ... |
+// ---------------------------------------------------------------------
+//
+// Points `record` at the record `*offset` bytes into `batch`'s payload, and
+// moves `*offset` past it. Start with `*offset` at 0. Returns false once there
+// are no records left, or if the next one would run past the end of the batch
+// (which gets logged, and ends it)
+static inline bool pictrl_batch_next(const RawPiCtrlMessage *batch,
+                                     size_t *offset,
+                                     RawPiCtrlMessage *record) {
+  const size_t batch_size = batch->header.payload_size;
+  if (*offset + sizeof(RawPictrlHeader) > batch_size) {
+    if (*offset < batch_size) {
+      pictrl_log_warn("Batch has %zu stray bytes at the end\n",
+                      batch_size - *offset);
+    }
+    return false;
+  }
+
+  const uint8_t *in = batch->payload + *offset;
+  const RawPictrlHeader header = {.cmd = in[0], .payload_size = in[1]};
+  if (header.cmd & PICTRL_CMD_EXTENDED) {
+    pictrl_log_warn("Batch records can't have extended headers\n");
+    return false;
+  }
+  if (header.cmd == PI_CTRL_HELLO) {
+    pictrl_log_warn("Batch records can't be hellos\n");
+    return false;
+  }
+  const size_t record_len = sizeof(header) + header.payload_size;
+  if (*offset + record_len > batch_size) {
+    pictrl_log_warn("Batch record (%zu bytes) runs past the end of the batch\n",
+                    record_len);
+    return false;
+  }
+
+  *record = (RawPiCtrlMessage){.header = header,
+                               .payload = batch->payload + *offset +
+                                          sizeof(header)};
+  *offset += record_len;
+  return true;
+}
+#endif
@@ -37,4 +37,53 @@ static inline PiCtrlMouseCoord pictrl_get_mouse_coords(
                                 .y = *(int8_t *)(msg->payload + 1)};
   return ret;
 }
+
+#define PICTRL_MOUSE_MV_HIRES_PAYLOAD_SIZE 4
+
+// Relative, in 1/PICTRL_MOUSE_SUBPIXELS of a pixel (12.4 fixed point), so moves
+// can be bigger than 127 pixels, or smaller than 1
+//
+// All bytes are signed, big endian
+// -----------------------------
+// | X (2 bytes) | Y (2 bytes) |
+// -----------------------------
+static inline PiCtrlMouseCoord pictrl_get_mouse_coords_hires(
+    const RawPiCtrlMessage *msg) {
+  const uint8_t *payload = msg->payload;
+  const PiCtrlMouseCoord ret = {.x = (int16_t)((payload[0] << 8) | payload[1]),
+                                .y = (int16_t)((payload[2] << 8) | payload[3])};
+  return ret;
+}
+
+#define PICTRL_MOUSE_SCROLL_PAYLOAD_SIZE 4
+
+// In 1/120ths of a notch (see PiCtrlMouseScroll), positive is up/right
+//
+// All bytes are signed, big endian
+// ---------------------------------------------
+// | VERTICAL (2 bytes) | HORIZONTAL (2 bytes) |
+// ---------------------------------------------
+static inline PiCtrlMouseScroll pictrl_get_mouse_scroll(
+    const RawPiCtrlMessage *msg) {
+  const uint8_t *payload = msg->payload;
+  const PiCtrlMouseScroll ret = {
+      .vertical = (int16_t)((payload[0] << 8) | payload[1]),
+      .horizontal = (int16_t)((payload[2] << 8) | payload[3])};
+  return ret;
+}
+
+#define PICTRL_MOUSE_ABS_PAYLOAD_SIZE 4
+
+// Normalized to the whole screen (see PiCtrlMouseAbs)
+//
+// All bytes are unsigned, big endian
+// -----------------------------
+// | X (2 bytes) | Y (2 bytes) |
+// -----------------------------
+static inline PiCtrlMouseAbs pictrl_get_mouse_abs(const RawPiCtrlMessage *msg) {
+  const uint8_t *payload = msg->payload;
+  const PiCtrlMouseAbs ret = {.x = (payload[0] << 8) | payload[1],
+                              .y = (payload[2] << 8) | payload[3]};
+  return ret;
+}
 #endif
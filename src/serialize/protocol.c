@@ -1,15 +1,143 @@
-#include "model/protocol.h"
+#include "serialize/protocol.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "data_structures/ring_buffer.h"
 #include "logging/log_utils.h"
+#include "model/protocol.h"
 
 RawPiCtrlMessage parse_to_pictrl_msg(void *in, size_t len) {
   RawPictrlHeader header = *(RawPictrlHeader *)in;
-  const size_t expected_msg_len = (sizeof(header) + header.payload_size);
+  const size_t header_len = pictrl_header_len(header.cmd);
+  const size_t expected_msg_len = header_len + header.payload_size;
   if (len != expected_msg_len) {
-    pictrl_log_error("Shit. Expected %zu bytes\n", expected_msg_len);
-    // Probably have to somehow fill out the structure as we go,
-    // then act once we have a full one.
+    // Callers frame messages first (see `pictrl_rb_peek_msg()`), so this is a
+    // bug on our end
+    pictrl_log_error("Expected %zu bytes, got %zu\n", expected_msg_len, len);
+  }
+  RawPiCtrlMessage msg = {.header = header, .payload = in + header_len};
+
+  if (header.cmd & PICTRL_CMD_EXTENDED) {
+    const uint8_t *ext = (uint8_t *)in + sizeof(header);
+    msg.header.cmd &= ~PICTRL_CMD_EXTENDED;
+    msg.extended = true;
+    msg.ext = (RawPictrlExtHeader){
+        .seq = (uint16_t)((ext[0] << 8) | ext[1]),
+        .send_usec = ((uint32_t)ext[2] << 24) | ((uint32_t)ext[3] << 16) |
+                     ((uint32_t)ext[4] << 8) | ext[5]};
   }
-  RawPiCtrlMessage msg = {.header = header, .payload = in + sizeof(header)};
   return msg;
 }
+
+// `hello->backend` points into `msg`'s payload
+bool pictrl_parse_hello(const RawPiCtrlMessage *msg, PiCtrlHello *hello) {
+  const uint8_t *payload = msg->payload;
+  if (msg->header.payload_size < PICTRL_HELLO_MIN_PAYLOAD_SIZE) {
+    pictrl_log_warn("Hello payload too small (%d bytes)\n",
+                    msg->header.payload_size);
+    return false;
+  }
+  *hello = (PiCtrlHello){
+      .version = payload[0],
+      .caps = payload[1],
+      .max_payload = payload[2],
+      .backend = (const char *)payload + PICTRL_HELLO_MIN_PAYLOAD_SIZE,
+      .backend_len =
+          msg->header.payload_size - PICTRL_HELLO_MIN_PAYLOAD_SIZE};
+  return true;
+}
+
+static uint8_t caps_for_cmd(uint8_t cmd) {
+  switch (cmd) {
+    case PI_CTRL_BATCH:
+      return PICTRL_CAP_BATCH;
+    case PI_CTRL_MOUSE_MV_HIRES:
+      return PICTRL_CAP_MOUSE_HIRES;
+    default:
+      return 0;
+  }
+}
+
+// Only looks at each record's header, leaving malformed batches for
+// `pictrl_batch_next()` to complain about when they're handled
+uint8_t pictrl_hello_caps_needed(const RawPiCtrlMessage *msg) {
+  uint8_t needs = caps_for_cmd(msg->header.cmd) |
+                  (msg->extended ? PICTRL_CAP_EXT_HEADER : 0);
+  if (msg->header.cmd == PI_CTRL_BATCH) {
+    const size_t size = msg->header.payload_size;
+    for (size_t offset = 0; offset + sizeof(RawPictrlHeader) <= size;
+         offset += sizeof(RawPictrlHeader) + msg->payload[offset + 1]) {
+      needs |= caps_for_cmd(msg->payload[offset]);
+    }
+  }
+  return needs;
+}
+
+bool pictrl_hello_allows(const PiCtrlHello *hello,
+                         const RawPiCtrlMessage *msg) {
+  if (hello->version == 0) {
+    return true;
+  }
+  return (pictrl_hello_caps_needed(msg) & ~hello->caps) == 0 &&
+         msg->header.payload_size <= hello->max_payload;
+}
+
+// Writes a whole PI_CTRL_HELLO message (header and all) to `out`, and returns
+// its length. A backend name that doesn't fit in `size` gets cut short
+size_t pictrl_build_hello(const PiCtrlHello *hello, uint8_t *out,
+                          size_t size) {
+  const size_t min_len =
+      sizeof(RawPictrlHeader) + PICTRL_HELLO_MIN_PAYLOAD_SIZE;
+  if (size < min_len) {
+    return 0;
+  }
+  size_t backend_len = hello->backend_len;
+  if (backend_len > size - min_len) {
+    backend_len = size - min_len;
+  }
+  if (backend_len > UINT8_MAX - PICTRL_HELLO_MIN_PAYLOAD_SIZE) {
+    backend_len = UINT8_MAX - PICTRL_HELLO_MIN_PAYLOAD_SIZE;
+  }
+
+  out[0] = PI_CTRL_HELLO;
+  out[1] = PICTRL_HELLO_MIN_PAYLOAD_SIZE + backend_len;
+  out[2] = hello->version;
+  out[3] = hello->caps;
+  out[4] = hello->max_payload;
+  memcpy(out + min_len, hello->backend, backend_len);
+  return min_len + backend_len;
+}
+
+size_t pictrl_rb_msg_len(pictrl_rb_t *rb) {
+  const size_t size = pictrl_rb_size(rb);
+  if (size < sizeof(RawPictrlHeader)) {
+    return 0;
+  }
+  const size_t msg_len =
+      pictrl_header_len(pictrl_rb_get(rb, offsetof(RawPictrlHeader, cmd))) +
+      pictrl_rb_get(rb, offsetof(RawPictrlHeader, payload_size));
+  return (msg_len <= size) ? msg_len : 0;
+}
+
+size_t pictrl_rb_peek_msg(pictrl_rb_t *rb, RawPiCtrlMessage *msg,
+                          uint8_t *scratch) {
+  const size_t msg_len = pictrl_rb_msg_len(rb);
+  if (msg_len == 0) {
+    return 0;
+  }
+
+  uint8_t *in = pictrl_rb_data_start_address(rb);
+  if (msg_len > pictrl_rb_contiguous(rb, pictrl_rb_start(rb))) {
+    pictrl_rb_peek(rb, scratch, msg_len);
+    in = scratch;
+  }
+  *msg = parse_to_pictrl_msg(in, msg_len);
+  return msg_len;
+}
+
+size_t pictrl_rb_consume_msg(pictrl_rb_t *rb) {
+  return pictrl_rb_consume(rb, pictrl_rb_msg_len(rb));
+}
@@ -1,12 +1,22 @@
 #ifndef _PICTRL_SERIALIZE_PROTOCOL_H
 #define _PICTRL_SERIALIZE_PROTOCOL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "data_structures/ring_buffer.h"
 #include "model/protocol.h"
 
-// Assumes that rb->data_start is pointing at the beginning of the header in the
-// ring buffer already
+// On the wire (RawPictrlExtHeader has padding)
+#define PICTRL_EXT_HEADER_SIZE 6
+
+// Both headers plus the biggest payload `payload_size` can describe
+#define PICTRL_MAX_MSG_LEN \
+  (sizeof(RawPictrlHeader) + PICTRL_EXT_HEADER_SIZE + UINT8_MAX)
+
+// Assumes that `in` is pointing at the beginning of the header (see
+// `pictrl_rb_peek_msg()` to get there from a ring buffer)
 //
 // All bytes are unsigned
 //
@@ -14,5 +24,63 @@
 // --------------------------------------------------
 // | CMD (1 byte) | PAYLOAD_SIZE (1 byte) | PAYLOAD |
 // --------------------------------------------------
+//
+// With PICTRL_CMD_EXTENDED set in CMD, the extended header comes before the
+// payload (PAYLOAD_SIZE still only counts the payload). Big endian
+// --------------------------------------------------
+// | SEQ (2 bytes) | SEND_USEC (4 bytes, wraps)     |
+// --------------------------------------------------
 RawPiCtrlMessage parse_to_pictrl_msg(void *in, size_t len);
+
+// PI_CTRL_HELLO payload, either way
+//
+// All bytes are unsigned
+// ------------------------------------------------------------------------
+// | VERSION (1 byte) | CAPS (1 byte) | MAX_PAYLOAD (1 byte) | BACKEND... |
+// ------------------------------------------------------------------------
+//
+// The client says what it supports, and the server answers with what they
+// agreed on: the lower VERSION and MAX_PAYLOAD, and the CAPS they both have.
+// From then on, the server drops (with a warning) any message that needs CAPS
+// they didn't agree on, or has a payload bigger than MAX_PAYLOAD. Clients that
+// never say hello are v1 ones, and don't get checked. BACKEND is the name of
+// the server's backend (empty from clients). Anything a newer version adds
+// goes after it, so fields we don't know about just get ignored
+#define PICTRL_HELLO_MIN_PAYLOAD_SIZE 3
+bool pictrl_parse_hello(const RawPiCtrlMessage *msg, PiCtrlHello *hello);
+size_t pictrl_build_hello(const PiCtrlHello *hello, uint8_t *out,
+                          size_t size);
+
+// The CAPS `msg` needs: its own command's, its extended header's, and those of
+// every record in it if it's a batch. `pictrl_hello_allows()` is whether what
+// `hello` agreed on covers that (and its payload size). A `hello` of all 0s,
+// i.e. a v1 client that never said one, allows anything
+uint8_t pictrl_hello_caps_needed(const RawPiCtrlMessage *msg);
+bool pictrl_hello_allows(const PiCtrlHello *hello,
+                         const RawPiCtrlMessage *msg);
+
+/*
+Messages back to back in a ring buffer of received bytes, starting at the front
+of its data. A message only counts once all of its header and payload are in.
+
+`pictrl_rb_msg_len()` is how long (header and payload) the first message is, or
+0 if it isn't all there yet. `pictrl_rb_peek_msg()` parses it into `msg`
+without consuming it, with the payload pointing straight into the ring buffer,
+unless the message wraps around its end, in which case it's copied into
+`scratch` (at least PICTRL_MAX_MSG_LEN bytes) first. Either way, `msg` is only
+good until the message is consumed, with `pictrl_rb_consume_msg()`. Both return
+the message's length, or 0 if there isn't a whole one.
+*/
+size_t pictrl_rb_msg_len(pictrl_rb_t *rb);
+size_t pictrl_rb_peek_msg(pictrl_rb_t *rb, RawPiCtrlMessage *msg,
+                          uint8_t *scratch);
+size_t pictrl_rb_consume_msg(pictrl_rb_t *rb);
+
+// Static "methods"
+
+// Bytes of header (regular and extended) in front of a payload
+static inline size_t pictrl_header_len(uint8_t cmd) {
+  return sizeof(RawPictrlHeader) +
+         ((cmd & PICTRL_CMD_EXTENDED) ? PICTRL_EXT_HEADER_SIZE : 0);
+}
 #endif
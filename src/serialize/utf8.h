@@ -0,0 +1,66 @@
+#ifndef _PICTRL_SERIALIZE_UTF8_H
+#define _PICTRL_SERIALIZE_UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PICTRL_UTF8_REPLACEMENT_CHAR 0xFFFD
+
+/*
+Decodes the code point at the start of `str` into `*code_point` and returns how
+many bytes it took up (1-4). Never returns 0 for a non-empty `str`, so callers
+can always make progress.
+
+Anything malformed (stray continuation bytes, truncated or overlong sequences,
+surrogates, > U+10FFFF) decodes to U+FFFD and consumes just the 1 offending
+byte, so one bad byte doesn't swallow the characters after it.
+*/
+static inline size_t pictrl_utf8_decode(const uint8_t *str, size_t len,
+                                        uint32_t *code_point) {
+  *code_point = PICTRL_UTF8_REPLACEMENT_CHAR;
+  if (len == 0) {
+    return 0;
+  }
+
+  const uint8_t lead = str[0];
+  if (lead < 0x80) {
+    *code_point = lead;
+    return 1;
+  }
+
+  size_t seq_len;
+  uint32_t cp;
+  uint32_t min_cp;  // Anything smaller is an overlong encoding
+  if ((lead & 0xE0) == 0xC0) {
+    seq_len = 2;
+    cp = lead & 0x1F;
+    min_cp = 0x80;
+  } else if ((lead & 0xF0) == 0xE0) {
+    seq_len = 3;
+    cp = lead & 0x0F;
+    min_cp = 0x800;
+  } else if ((lead & 0xF8) == 0xF0) {
+    seq_len = 4;
+    cp = lead & 0x07;
+    min_cp = 0x10000;
+  } else {
+    return 1;
+  }
+
+  if (len < seq_len) {
+    return 1;
+  }
+  for (size_t i = 1; i < seq_len; i++) {
+    if ((str[i] & 0xC0) != 0x80) {
+      return 1;
+    }
+    cp = (cp << 6) | (str[i] & 0x3F);
+  }
+
+  if (cp < min_cp || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+    return 1;
+  }
+  *code_point = cp;
+  return seq_len;
+}
+#endif
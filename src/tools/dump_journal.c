@@ -0,0 +1,108 @@
+/*
+Prints a journal written by the record backend (see
+`src/backend/picontrol_journal.h`), one event per line:
+
+  <recv_usec> <emit_usec> <held_usec> <device> <type> <code> <value>
+
+followed by a summary of how long events were held on to. With -e, only the
+device, type, code and value are printed (no timestamps, no summary), so the
+output of two builds can be diffed directly.
+
+Usage: dump_journal [-e] <journal>
+*/
+#include <inttypes.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "backend/picontrol_journal.h"
+#include "util.h"
+
+static const char *DEVICE_NAMES[] = {"keyboard", "tablet"};
+
+static const char *type_name(uint16_t type) {
+  switch (type) {
+    case EV_SYN:
+      return "EV_SYN";
+    case EV_KEY:
+      return "EV_KEY";
+    case EV_REL:
+      return "EV_REL";
+    case EV_ABS:
+      return "EV_ABS";
+    default:
+      return "?";
+  }
+}
+
+static const char *device_name(uint32_t device) {
+  return (device < PICTRL_SIZE(DEVICE_NAMES)) ? DEVICE_NAMES[device] : "?";
+}
+
+static void print_usage(FILE *stream, const char *prog) {
+  fprintf(stream, "Usage: %s [-e] <journal>\n", prog);
+}
+
+int main(int argc, char **argv) {
+  bool events_only = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "eh")) != -1) {
+    switch (opt) {
+      case 'e':
+        events_only = true;
+        break;
+      case 'h':
+        print_usage(stdout, argv[0]);
+        return 0;
+      default:
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage(stderr, argv[0]);
+    return 1;
+  }
+
+  size_t map_size;
+  const pictrl_journal_header *header =
+      pictrl_journal_map(argv[optind], &map_size);
+  if (header == NULL) {
+    return 1;
+  }
+
+  const pictrl_journal_record *records = pictrl_journal_records(header);
+  uint64_t total_held_usec = 0;
+  uint64_t max_held_usec = 0;
+  for (uint64_t i = 0; i < header->num_records; i++) {
+    const pictrl_journal_record *record = &records[i];
+    const struct input_event *ie = &record->event;
+    if (events_only) {
+      printf("%s %s %u %d\n", device_name(record->device), type_name(ie->type),
+             ie->code, ie->value);
+      continue;
+    }
+
+    const uint64_t held_usec = record->emit_usec - record->recv_usec;
+    total_held_usec += held_usec;
+    if (held_usec > max_held_usec) {
+      max_held_usec = held_usec;
+    }
+    printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %s %s %u %d\n",
+           record->recv_usec, record->emit_usec, held_usec,
+           device_name(record->device), type_name(ie->type), ie->code,
+           ie->value);
+  }
+
+  if (!events_only && header->num_records > 0) {
+    printf("# %" PRIu64 " events, held for %" PRIu64 "us on average, %" PRIu64
+           "us at most\n",
+           header->num_records, total_held_usec / header->num_records,
+           max_held_usec);
+  }
+
+  pictrl_journal_unmap(header, map_size);
+  return 0;
+}
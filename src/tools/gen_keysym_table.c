@@ -0,0 +1,177 @@
+/*
+Build time only: generates the perfect hash table for keysym names (see
+`src/backend/picontrol_keysym.h`) from `picontrol_keysym_names.def`, and writes
+it as a C header to the path given as the only argument.
+
+Usage: gen_keysym_table <output header>
+*/
+#define _GNU_SOURCE  // qsort_r()
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "backend/picontrol_keysym.h"
+#include "util.h"
+
+typedef struct {
+  const char *name;
+  const char *code;  // The KEY_* macro, as written in the .def file
+} keysym_def;
+
+static const keysym_def keysyms[] = {
+#define PICTRL_KEYSYM(name, code) {name, #code},
+#include "backend/picontrol_keysym_names.def"
+#undef PICTRL_KEYSYM
+};
+
+#define NUM_KEYSYMS PICTRL_SIZE(keysyms)
+
+// Give up on a bucket after trying this many displacements
+#define MAX_DISPLACEMENT (uint32_t)1000000
+
+static size_t table_size() {
+  size_t size = 1;
+  while (size < NUM_KEYSYMS) {
+    size <<= 1;
+  }
+  return size;
+}
+
+static int cmp_bucket_size(const void *a, const void *b, void *sizes) {
+  const size_t *bucket_sizes = sizes;
+  const size_t size_a = bucket_sizes[*(const size_t *)a];
+  const size_t size_b = bucket_sizes[*(const size_t *)b];
+  return (size_a < size_b) - (size_a > size_b);  // Biggest first
+}
+
+static bool has_duplicates() {
+  for (size_t i = 0; i < NUM_KEYSYMS; i++) {
+    for (size_t j = i + 1; j < NUM_KEYSYMS; j++) {
+      if (strcasecmp(keysyms[i].name, keysyms[j].name) == 0) {
+        fprintf(stderr, "Keysym \"%s\" is listed more than once\n",
+                keysyms[i].name);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <output header>\n", argv[0]);
+    return 1;
+  }
+  if (has_duplicates()) {
+    return 1;
+  }
+
+  const size_t size = table_size();
+  const size_t mask = size - 1;
+  size_t *bucket_of = calloc(NUM_KEYSYMS, sizeof(*bucket_of));
+  size_t *bucket_sizes = calloc(size, sizeof(*bucket_sizes));
+  size_t *bucket_order = calloc(size, sizeof(*bucket_order));
+  uint32_t *displacements = calloc(size, sizeof(*displacements));
+  long *slots = malloc(size * sizeof(*slots));  // Index into `keysyms`, or -1
+  size_t *bucket_slots = calloc(NUM_KEYSYMS, sizeof(*bucket_slots));
+  if (bucket_of == NULL || bucket_sizes == NULL || bucket_order == NULL ||
+      displacements == NULL || slots == NULL || bucket_slots == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    slots[i] = -1;
+    bucket_order[i] = i;
+  }
+  for (size_t i = 0; i < NUM_KEYSYMS; i++) {
+    const char *name = keysyms[i].name;
+    bucket_of[i] = pictrl_keysym_hash(name, strlen(name), 0) & mask;
+    bucket_sizes[bucket_of[i]]++;
+  }
+
+  // Place the most crowded buckets first, while there's the most room
+  qsort_r(bucket_order, size, sizeof(*bucket_order), &cmp_bucket_size,
+          bucket_sizes);
+  for (size_t b = 0; b < size && bucket_sizes[bucket_order[b]] > 0; b++) {
+    const size_t bucket = bucket_order[b];
+
+    uint32_t displacement;
+    for (displacement = 1; displacement < MAX_DISPLACEMENT; displacement++) {
+      size_t num_placed = 0;
+      bool fits = true;
+      for (size_t i = 0; i < NUM_KEYSYMS && fits; i++) {
+        if (bucket_of[i] != bucket) {
+          continue;
+        }
+        const char *name = keysyms[i].name;
+        const size_t slot =
+            pictrl_keysym_hash(name, strlen(name), displacement) & mask;
+        fits = (slots[slot] < 0);
+        for (size_t j = 0; j < num_placed && fits; j++) {
+          fits = (bucket_slots[j] != slot);
+        }
+        bucket_slots[num_placed++] = slot;
+      }
+      if (fits) {
+        break;
+      }
+    }
+    if (displacement == MAX_DISPLACEMENT) {
+      fprintf(stderr, "Could not find a perfect hash for bucket %zu\n", bucket);
+      return 1;
+    }
+
+    displacements[bucket] = displacement;
+    size_t num_placed = 0;
+    for (size_t i = 0; i < NUM_KEYSYMS; i++) {
+      if (bucket_of[i] == bucket) {
+        slots[bucket_slots[num_placed++]] = i;
+      }
+    }
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if (out == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  fprintf(out,
+          "// Generated by src/tools/gen_keysym_table.c, DO NOT EDIT\n"
+          "#ifndef _PICTRL_KEYSYM_TABLE_H\n"
+          "#define _PICTRL_KEYSYM_TABLE_H\n\n"
+          "#include <linux/input-event-codes.h>\n\n"
+          "#include \"backend/picontrol_keysym.h\"\n\n"
+          "#define PICTRL_KEYSYM_TABLE_SIZE %zu\n\n",
+          size);
+
+  fprintf(out, "static const uint32_t pictrl_keysym_displacements[] = {\n");
+  for (size_t i = 0; i < size; i++) {
+    fprintf(out, "    %u,\n", displacements[i]);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static const pictrl_keysym_entry pictrl_keysym_table[] = {\n");
+  for (size_t i = 0; i < size; i++) {
+    if (slots[i] < 0) {
+      fprintf(out, "    {NULL, 0, 0},\n");
+      continue;
+    }
+    const keysym_def *def = &keysyms[slots[i]];
+    fprintf(out, "    {\"%s\", %zu, %s},\n", def->name, strlen(def->name),
+            def->code);
+  }
+  fprintf(out, "};\n\n#endif\n");
+
+  free(bucket_of);
+  free(bucket_sizes);
+  free(bucket_order);
+  free(displacements);
+  free(slots);
+  free(bucket_slots);
+  return (fclose(out) == 0) ? 0 : 1;
+}
@@ -1,6 +1,22 @@
 #ifndef _PITEST_UTIL_H
 #define _PITEST_UTIL_H
 
+#include <stdint.h>
+#include <time.h>
+
 #define PICTRL_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
+#define PICTRL_USEC_PER_SEC 1000000
+
+// Keep data written by different threads this far apart, so they don't keep
+// stealing the same cache line from each other
+#define PICTRL_CACHE_LINE 64
+
+// Monotonic, so only meaningful relative to other calls
+static inline uint64_t pictrl_now_usec() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * PICTRL_USEC_PER_SEC + now.tv_nsec / 1000;
+}
+
 #endif
@@ -0,0 +1,424 @@
+#include "backend/picontrol_backend.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend/picontrol_journal.h"
+#include "backend/picontrol_null.h"
+#include "backend/picontrol_record.h"
+#include "logging/log_utils.h"
+#include "model/mouse.h"
+#include "model/protocol.h"
+#include "picontrol_config.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_moves_coalesce();
+static int test_click_flushes_motion();
+static int test_service_waits_for_frame_end();
+static int test_clicks_follow_the_tablet();
+static int test_subpixels_add_up();
+static int test_subpixels_both_ways();
+static int test_backend_by_name();
+static int test_default_backend();
+static int test_dispatch();
+
+#define NUM_MOVES 10
+#define JOURNAL_PATH "/tmp/picontrol_backend_test.journal"
+
+// Fixtures
+static pictrl_backend *backend;
+static pictrl_null_backend *counts;  // What `backend` has emitted so far
+
+int before_each() {
+  backend = pictrl_backend_new("null");
+  if (backend == NULL) {
+    pictrl_log_error("Could not create null backend\n");
+    return -1;
+  }
+  counts = backend->impl;
+  return 0;
+}
+
+int after_each() {
+  pictrl_backend_free(backend);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Moves within a frame come out as one",
+          .test_function = &test_moves_coalesce,
+      },
+      {
+          .test_name = "Click flushes the motion before it",
+          .test_function = &test_click_flushes_motion,
+      },
+      {
+          .test_name = "Service waits for the frame to end",
+          .test_function = &test_service_waits_for_frame_end,
+      },
+      {
+          .test_name = "Clicks follow the tablet",
+          .test_function = &test_clicks_follow_the_tablet,
+      },
+      {
+          .test_name = "Sub-pixel moves add up across frames",
+          .test_function = &test_subpixels_add_up,
+      },
+      {
+          .test_name = "Sub-pixel moves both ways don't gain or lose pixels",
+          .test_function = &test_subpixels_both_ways,
+      },
+      {
+          .test_name = "Backends are picked by name",
+          .test_function = &test_backend_by_name,
+      },
+      {
+          .test_name = "Default backend is never a silent one",
+          .test_function = &test_default_backend,
+      },
+      {
+          .test_name = "Every command gets to the backend",
+          .test_function = &test_dispatch,
+      }};
+
+  const TestSuite suite = {
+      .name = "Backend tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+static int send(PiCtrlCmd cmd, uint8_t *payload, uint8_t payload_size) {
+  RawPiCtrlMessage msg = {
+      .header = {.cmd = cmd, .payload_size = payload_size},
+      .payload = payload};
+  return pictrl_backend_handle_message(backend, &msg);
+}
+
+static void send_move(int8_t x, int8_t y) {
+  uint8_t payload[] = {(uint8_t)x, (uint8_t)y};
+  send(PI_CTRL_MOUSE_MV, payload, sizeof(payload));
+}
+
+// `x` and `y` in 1/PICTRL_MOUSE_SUBPIXELS of a pixel
+static void send_move_hires(int16_t x, int16_t y) {
+  uint8_t payload[] = {(uint16_t)x >> 8, (uint16_t)x & 0xFF, (uint16_t)y >> 8,
+                       (uint16_t)y & 0xFF};
+  send(PI_CTRL_MOUSE_MV_HIRES, payload, sizeof(payload));
+}
+
+// Lets the current motion frame run out, and has the backend flush it
+static void end_frame() {
+  usleep(PICTRL_MOUSE_FRAME_USEC);
+  pictrl_backend_service(backend);
+}
+
+static bool check_moved(uint64_t moves, int64_t dx, int64_t dy) {
+  if (counts->mouse_moves != moves || counts->mouse_dx != dx ||
+      counts->mouse_dy != dy) {
+    pictrl_log_error("Expected %" PRIu64 " moves by (%" PRId64 ", %" PRId64
+                     "), got %" PRIu64 " by (%" PRId64 ", %" PRId64 ")\n",
+                     moves, dx, dy, counts->mouse_moves, counts->mouse_dx,
+                     counts->mouse_dy);
+    return false;
+  }
+  return true;
+}
+
+static int test_moves_coalesce() {
+  // The first one after a quiet period goes straight out...
+  send_move(3, -2);
+  if (!check_moved(1, 3, -2)) {
+    return 1;
+  }
+
+  // ...and the rest of its frame is held back
+  for (int i = 1; i < NUM_MOVES; i++) {
+    send_move(3, -2);
+  }
+  if (!check_moved(1, 3, -2)) {
+    return 2;
+  }
+
+  // Then comes out summed up, in one go
+  end_frame();
+  if (!check_moved(2, 3 * NUM_MOVES, -2 * NUM_MOVES)) {
+    return 3;
+  }
+  return 0;
+}
+
+static int test_click_flushes_motion() {
+  send_move(1, 1);
+  send_move(5, 5);
+  send_move(5, 5);
+
+  uint8_t click = PI_CTRL_MOUSE_DOWN;
+  send(PI_CTRL_MOUSE_CLICK, &click, sizeof(click));
+  if (counts->clicks != 1 || !check_moved(2, 11, 11)) {
+    pictrl_log_error("Expected the held moves to go out with the click\n");
+    return 1;
+  }
+
+  // Nothing left over for the end of the frame
+  end_frame();
+  if (!check_moved(2, 11, 11)) {
+    return 2;
+  }
+  return 0;
+}
+
+static int test_service_waits_for_frame_end() {
+  if (pictrl_backend_service(backend) != -1) {
+    pictrl_log_error("Expected nothing to be waiting\n");
+    return 1;
+  }
+
+  send_move(1, 0);
+  send_move(1, 0);
+  const int64_t next_usec = pictrl_backend_service(backend);
+  if (next_usec < 0 || next_usec > PICTRL_MOUSE_FRAME_USEC) {
+    pictrl_log_error("Expected a flush within %d us, got %" PRId64 "\n",
+                     PICTRL_MOUSE_FRAME_USEC, next_usec);
+    return 2;
+  }
+  if (!check_moved(1, 1, 0)) {
+    return 3;
+  }
+
+  usleep(next_usec);
+  if (pictrl_backend_service(backend) != -1 || !check_moved(2, 2, 0)) {
+    pictrl_log_error("Expected the held move once the frame was over\n");
+    return 4;
+  }
+  return 0;
+}
+
+static void send_click(PiCtrlMouseClick click) {
+  uint8_t status = click;
+  send(PI_CTRL_MOUSE_CLICK, &status, sizeof(status));
+}
+
+// Which device the `n`th BTN_LEFT event went to, or -1 if there wasn't one
+static int btn_device(const pictrl_journal *journal, size_t n) {
+  const pictrl_journal_record *records =
+      pictrl_journal_records(journal->header);
+  for (uint64_t i = 0; i < journal->header->num_records; i++) {
+    if (records[i].event.type == EV_KEY && records[i].event.code == BTN_LEFT &&
+        n-- == 0) {
+      return records[i].device;
+    }
+  }
+  return -1;
+}
+
+static int test_clicks_follow_the_tablet() {
+  // Recorded, so we can see which device each click went to
+  setenv("PICTRL_RECORD_PATH", JOURNAL_PATH, 1);
+  pictrl_backend *recorder = pictrl_backend_new("record");
+  unlink(JOURNAL_PATH);
+  if (recorder == NULL) {
+    return 1;
+  }
+  pictrl_backend *null_backend = backend;
+  backend = recorder;
+  const pictrl_journal *journal = &((pictrl_record_t *)recorder->impl)->journal;
+
+  // Moved by the tablet, so the press has to land there too. It stays held
+  // down there even after a relative move, until it's released
+  uint8_t pos[] = {0x80, 0x00, 0x80, 0x00};
+  send(PI_CTRL_MOUSE_ABS, pos, sizeof(pos));
+  send_click(PI_CTRL_MOUSE_DOWN);
+  end_frame();
+  send_move(1, 1);
+  send_click(PI_CTRL_MOUSE_UP);
+  // Then back on the mouse
+  send_click(PI_CTRL_MOUSE_DOWN);
+
+  int ret = 0;
+  const int expected[] = {PICTRL_JOURNAL_TABLET, PICTRL_JOURNAL_TABLET,
+                          PICTRL_JOURNAL_KEYBOARD};
+  for (size_t i = 0; i < PICTRL_SIZE(expected); i++) {
+    if (btn_device(journal, i) != expected[i]) {
+      pictrl_log_error("Click %zu went to device %d, expected %d\n", i,
+                       btn_device(journal, i), expected[i]);
+      ret = 2;
+    }
+  }
+
+  pictrl_backend_free(recorder);
+  backend = null_backend;
+  return ret;
+}
+
+static int test_subpixels_add_up() {
+  // 5/16ths of a pixel at a time, each in its own frame
+  for (int i = 1; i <= 20; i++) {
+    send_move_hires(5, -5);
+    end_frame();
+
+    // Only whole pixels come out, and never more than we've been sent
+    const int sent = 5 * i;
+    if (!check_moved(counts->mouse_moves, sent / PICTRL_MOUSE_SUBPIXELS,
+                     -sent / PICTRL_MOUSE_SUBPIXELS)) {
+      pictrl_log_error("After %d moves\n", i);
+      return 1;
+    }
+    if (backend->motion.dx != sent % PICTRL_MOUSE_SUBPIXELS ||
+        backend->motion.dy != -sent % PICTRL_MOUSE_SUBPIXELS) {
+      pictrl_log_error("Expected (%d, %d)/16 left over after %d moves, got "
+                       "(%d, %d)/16\n",
+                       sent % PICTRL_MOUSE_SUBPIXELS,
+                       -sent % PICTRL_MOUSE_SUBPIXELS, i, backend->motion.dx,
+                       backend->motion.dy);
+      return 2;
+    }
+  }
+
+  // 100/16ths
+  if (!check_moved(counts->mouse_moves, 6, -6)) {
+    return 3;
+  }
+  return 0;
+}
+
+static int test_subpixels_both_ways() {
+  // Back and forth by odd amounts (and some whole pixels thrown in), each
+  // crossing 0 at some point
+  const int16_t moves[] = {23, -7, -40, 3, 18, -1, 32, -29, -15, 16, 0, -5, 7};
+  int sum = 0;
+  for (size_t i = 0; i < PICTRL_SIZE(moves); i++) {
+    if (i % 4 == 3) {
+      const int8_t pixels = moves[i];
+      send_move(pixels, -pixels);
+      sum += pixels * PICTRL_MOUSE_SUBPIXELS;
+    } else {
+      send_move_hires(moves[i], -moves[i]);
+      sum += moves[i];
+    }
+    end_frame();
+
+    // What went out plus what's held on to is exactly what came in, and what's
+    // held on to is less than a pixel
+    const pictrl_motion_accum *motion = &backend->motion;
+    if (counts->mouse_dx * PICTRL_MOUSE_SUBPIXELS + motion->dx != sum ||
+        counts->mouse_dy * PICTRL_MOUSE_SUBPIXELS + motion->dy != -sum) {
+      pictrl_log_error("Move %zu: sent %d/16, but emitted %" PRId64
+                       " pixels with %d/16 left over\n",
+                       i, sum, counts->mouse_dx, motion->dx);
+      return 1;
+    }
+    if (abs(motion->dx) >= PICTRL_MOUSE_SUBPIXELS ||
+        abs(motion->dy) >= PICTRL_MOUSE_SUBPIXELS) {
+      pictrl_log_error("Move %zu: held on to (%d, %d)/16, a whole pixel or "
+                       "more\n",
+                       i, motion->dx, motion->dy);
+      return 2;
+    }
+  }
+
+  // Going back to where we started gets us there exactly
+  send_move_hires(-sum, sum);
+  end_frame();
+  if (counts->mouse_dx != 0 || counts->mouse_dy != 0 ||
+      backend->motion.dx != 0 || backend->motion.dy != 0) {
+    pictrl_log_error("Ended up off by (%" PRId64 ", %" PRId64 ") pixels\n",
+                     counts->mouse_dx, counts->mouse_dy);
+    return 3;
+  }
+  return 0;
+}
+
+static int test_backend_by_name() {
+  if (strcmp(pictrl_backend_name(backend), "null") != 0 ||
+      backend->ops != &pictrl_null_backend_ops) {
+    pictrl_log_error("Asked for null, got %s\n", pictrl_backend_name(backend));
+    return 1;
+  }
+
+  // No falling back to something else when a name is given, whether it doesn't
+  // exist or just won't start (i.e. uinput without /dev/uinput)
+  if (pictrl_backend_new("nope") != NULL) {
+    pictrl_log_error("Got a backend that doesn't exist\n");
+    return 2;
+  }
+  pictrl_backend *uinput = pictrl_backend_new("uinput");
+  if (uinput != NULL) {
+    const bool is_uinput = strcmp(pictrl_backend_name(uinput), "uinput") == 0;
+    pictrl_backend_free(uinput);
+    if (!is_uinput) {
+      pictrl_log_error("Asked for uinput, got something else\n");
+      return 3;
+    }
+  }
+  return 0;
+}
+
+/*
+Whatever's available here (uinput needs /dev/uinput, xdo needs X) gets picked,
+but only if it actually emits input: null and record have to be asked for.
+Without any of the others, there's no backend at all rather than a silent one.
+*/
+static int test_default_backend() {
+  pictrl_backend *default_backend = pictrl_backend_new(NULL);
+  if (default_backend == NULL) {
+    pictrl_log_info("No real backend available here, nothing picked\n");
+    return 0;
+  }
+
+  const char *name = pictrl_backend_name(default_backend);
+  const bool silent =
+      strcmp(name, "null") == 0 || strcmp(name, "record") == 0;
+  pictrl_backend_free(default_backend);
+  if (silent) {
+    pictrl_log_error("Fell back to the %s backend on its own\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_dispatch() {
+  uint8_t click = PI_CTRL_MOUSE_DOWN;
+  uint8_t text[] = "hey";
+  uint8_t keysym[] = "ctrl+c";
+  uint8_t scroll[] = {0, 120, 0, 0};
+  uint8_t pos[] = {0, 0, 0xFF, 0xFF};
+  uint8_t batch[] = {PI_CTRL_MOUSE_CLICK, 1, PI_CTRL_MOUSE_DOWN,
+                     PI_CTRL_KEYSYM,      1, 'a'};
+
+  send(PI_CTRL_MOUSE_CLICK, &click, sizeof(click));
+  send(PI_CTRL_TEXT, text, strlen((char *)text));
+  send(PI_CTRL_KEYSYM, keysym, strlen((char *)keysym));
+  send(PI_CTRL_MOUSE_SCROLL, scroll, sizeof(scroll));
+  send(PI_CTRL_MOUSE_ABS, pos, sizeof(pos));
+  send(PI_CTRL_BATCH, batch, sizeof(batch));
+  end_frame();
+
+  if (counts->clicks != 2 || counts->text_bytes != 3 || counts->keysyms != 2 ||
+      counts->scrolls != 1 || counts->mouse_abs_moves != 1) {
+    pictrl_log_error("Expected 2 clicks, 3 text bytes, 2 keysyms, 1 scroll "
+                     "and 1 absolute move, got %" PRIu64 ", %" PRIu64
+                     ", %" PRIu64 ", %" PRIu64 " and %" PRIu64 "\n",
+                     counts->clicks, counts->text_bytes, counts->keysyms,
+                     counts->scrolls, counts->mouse_abs_moves);
+    return 1;
+  }
+
+  // Commands the backend doesn't know get turned away
+  if (send((PiCtrlCmd)0x7F, NULL, 0) != -1) {
+    pictrl_log_error("Accepted an unknown command\n");
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include "backend/picontrol_journal.h"
+
+#include <linux/input.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_append_and_read_back();
+static int test_grows();
+static int test_close_trims();
+static int test_rejects_garbage();
+
+// Fixtures
+static char path[] = "/tmp/picontrol_journal_test.XXXXXX";
+static pictrl_journal journal;
+
+int before_each() {
+  strcpy(path + strlen(path) - 6, "XXXXXX");
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+  journal.header = NULL;
+  return 0;
+}
+
+int after_each() {
+  pictrl_journal_close(&journal);
+  unlink(path);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Append and read back",
+          .test_function = &test_append_and_read_back,
+      },
+      {
+          .test_name = "Grows past the initial size",
+          .test_function = &test_grows,
+      },
+      {
+          .test_name = "Close trims unused space",
+          .test_function = &test_close_trims,
+      },
+      {
+          .test_name = "Rejects garbage",
+          .test_function = &test_rejects_garbage,
+      }};
+
+  const TestSuite suite = {
+      .name = "Journal tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+// `num_events` key events, with codes starting at `first_code`
+static bool append_keys(int first_code, size_t num_events, uint64_t recv_usec,
+                        uint64_t emit_usec) {
+  struct input_event events[64];
+  for (size_t i = 0; i < num_events; i++) {
+    events[i] = (struct input_event){
+        .type = EV_KEY, .code = first_code + i, .value = 1};
+  }
+  return pictrl_journal_append(&journal, PICTRL_JOURNAL_KEYBOARD, events,
+                               num_events, recv_usec, emit_usec);
+}
+
+static int test_append_and_read_back() {
+  if (pictrl_journal_open(&journal, path, 16) == NULL) {
+    return 1;
+  }
+
+  append_keys(KEY_A, 2, 100, 150);
+  const struct input_event abs = {.type = EV_ABS, .code = ABS_X, .value = 42};
+  pictrl_journal_append(&journal, PICTRL_JOURNAL_TABLET, &abs, 1, 200, 210);
+
+  // Readable while it's still being written
+  size_t map_size;
+  const pictrl_journal_header *header = pictrl_journal_map(path, &map_size);
+  if (header == NULL || header->num_records != 3) {
+    pictrl_log_error("Expected 3 records\n");
+    return 2;
+  }
+
+  const pictrl_journal_record *records = pictrl_journal_records(header);
+  const bool ok = records[0].recv_usec == 100 && records[0].emit_usec == 150 &&
+                  records[1].event.code == KEY_A + 1 &&
+                  records[2].recv_usec == 200 &&
+                  records[2].device == PICTRL_JOURNAL_TABLET &&
+                  records[2].event.type == EV_ABS &&
+                  records[2].event.value == 42;
+  pictrl_journal_unmap(header, map_size);
+  if (!ok) {
+    pictrl_log_error("Records don't match what was appended\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_grows() {
+  if (pictrl_journal_open(&journal, path, 4) == NULL) {
+    return 1;
+  }
+
+  // Many times the initial capacity, some of it in one go
+  for (int i = 0; i < 100; i++) {
+    if (!append_keys(i, 1, i, i)) {
+      pictrl_log_error("Could not append record %d\n", i);
+      return 2;
+    }
+  }
+  if (!append_keys(100, 50, 100, 100)) {
+    pictrl_log_error("Could not append a big batch\n");
+    return 3;
+  }
+
+  const pictrl_journal_record *records = pictrl_journal_records(journal.header);
+  for (int i = 0; i < 150; i++) {
+    if (records[i].event.code != i) {
+      pictrl_log_error("Record %d has code %d\n", i, records[i].event.code);
+      return 4;
+    }
+  }
+  return 0;
+}
+
+static int test_close_trims() {
+  if (pictrl_journal_open(&journal, path, 1024) == NULL) {
+    return 1;
+  }
+  append_keys(KEY_A, 3, 0, 0);
+  pictrl_journal_close(&journal);
+
+  struct stat st;
+  stat(path, &st);
+  const size_t expected =
+      sizeof(pictrl_journal_header) + 3 * sizeof(pictrl_journal_record);
+  if ((size_t)st.st_size != expected) {
+    pictrl_log_error("Expected a %zu byte file, got %zu\n", expected,
+                     (size_t)st.st_size);
+    return 2;
+  }
+
+  size_t map_size;
+  const pictrl_journal_header *header = pictrl_journal_map(path, &map_size);
+  if (header == NULL || header->num_records != 3) {
+    pictrl_log_error("Could not read back closed journal\n");
+    return 3;
+  }
+  pictrl_journal_unmap(header, map_size);
+  return 0;
+}
+
+static int test_rejects_garbage() {
+  FILE *file = fopen(path, "w");
+  fprintf(file, "definitely not a journal, but long enough to be one");
+  fclose(file);
+
+  size_t map_size;
+  if (pictrl_journal_map(path, &map_size) != NULL) {
+    pictrl_log_error("Mapped a file that isn't a journal\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,369 @@
+#define _GNU_SOURCE  // pipe2()
+#include "backend/picontrol_key_pacer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_unpaced();
+static int test_burst_then_wait();
+static int test_full_queue();
+static int test_wrap_around();
+static int test_short_write();
+static int test_would_block();
+static int test_torn_event();
+
+#define QUEUE_EVENTS (size_t)16
+#define INTERVAL_USEC (uint64_t)1000
+#define BURST_REPORTS (size_t)2
+#define START_USEC (uint64_t)1000000
+
+// Fixtures
+static pictrl_key_pacer pacer;
+static int pipe_fds[2];
+
+int before_each() {
+  if (pipe2(pipe_fds, O_NONBLOCK) < 0) {
+    pictrl_log_error("Could not create pipe\n");
+    return -1;
+  }
+  if (pictrl_pacer_init(&pacer, QUEUE_EVENTS, INTERVAL_USEC, BURST_REPORTS,
+                        QUEUE_EVENTS) == NULL) {
+    pictrl_log_error("Could not initialize pacer\n");
+    return -1;
+  }
+  return 0;
+}
+
+int after_each() {
+  pictrl_pacer_destroy(&pacer);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Unpaced release writes everything",
+          .test_function = &test_unpaced,
+      },
+      {
+          .test_name = "Burst, then one report per interval",
+          .test_function = &test_burst_then_wait,
+      },
+      {
+          .test_name = "Full queue rejects the whole push",
+          .test_function = &test_full_queue,
+      },
+      {
+          .test_name = "Wrap around keeps order",
+          .test_function = &test_wrap_around,
+      },
+      {
+          .test_name = "Short write only uses up what went out",
+          .test_function = &test_short_write,
+      },
+      {
+          .test_name = "Would block doesn't use up the rate",
+          .test_function = &test_would_block,
+      },
+      {
+          .test_name = "Partly written event gets dropped",
+          .test_function = &test_torn_event,
+      }};
+
+  const TestSuite suite = {
+      .name = "Key pacer tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+// A key press and release, tagged with `code` so we can check the order
+static bool push_report(int code) {
+  const struct input_event report[] = {
+      {.type = EV_KEY, .code = code, .value = 1},
+      {.type = EV_SYN, .code = SYN_REPORT, .value = 0},
+  };
+  return pictrl_pacer_push(&pacer, report, PICTRL_SIZE(report));
+}
+
+// Reads back whatever the pacer wrote, returns how many reports that was
+static ssize_t read_reports(int *codes, size_t max_reports) {
+  struct input_event events[QUEUE_EVENTS];
+  const ssize_t num_read = read(pipe_fds[0], events, sizeof(events));
+  if (num_read < 0) {
+    return 0;
+  }
+
+  size_t num_reports = 0;
+  for (size_t i = 0; i < (size_t)num_read / sizeof(events[0]); i++) {
+    if (events[i].type == EV_KEY && num_reports < max_reports) {
+      codes[num_reports++] = events[i].code;
+    }
+  }
+  return num_reports;
+}
+
+static int test_unpaced() {
+  pictrl_key_pacer unpaced;
+  if (pictrl_pacer_init(&unpaced, QUEUE_EVENTS, 0, 1, QUEUE_EVENTS) == NULL) {
+    return 1;
+  }
+
+  const struct input_event report[] = {
+      {.type = EV_KEY, .code = KEY_A, .value = 1},
+      {.type = EV_SYN, .code = SYN_REPORT, .value = 0},
+  };
+  for (int i = 0; i < 4; i++) {
+    pictrl_pacer_push(&unpaced, report, PICTRL_SIZE(report));
+  }
+
+  const int64_t next_usec = pictrl_pacer_release(&unpaced, pipe_fds[1], 0);
+  const bool empty = pictrl_pacer_empty(&unpaced);
+  pictrl_pacer_destroy(&unpaced);
+  if (next_usec != -1 || !empty) {
+    pictrl_log_error("Expected everything to go out at once\n");
+    return 2;
+  }
+
+  int codes[QUEUE_EVENTS];
+  const ssize_t num_reports = read_reports(codes, PICTRL_SIZE(codes));
+  if (num_reports != 4) {
+    pictrl_log_error("Expected 4 reports, got %zd\n", num_reports);
+    return 3;
+  }
+  return 0;
+}
+
+static int test_burst_then_wait() {
+  for (int i = 0; i < 4; i++) {
+    push_report(KEY_A + i);
+  }
+
+  // Idle for ages, so we get a full burst, but no more
+  int64_t next_usec = pictrl_pacer_release(&pacer, pipe_fds[1], START_USEC);
+  int codes[QUEUE_EVENTS];
+  ssize_t num_reports = read_reports(codes, PICTRL_SIZE(codes));
+  if (num_reports != (ssize_t)BURST_REPORTS) {
+    pictrl_log_error("Expected a burst of %zu reports, got %zd\n",
+                     BURST_REPORTS, num_reports);
+    return 1;
+  }
+  if (next_usec != (int64_t)INTERVAL_USEC) {
+    pictrl_log_error("Expected next report in %" PRIu64 "us, got %lld\n",
+                     INTERVAL_USEC, (long long)next_usec);
+    return 2;
+  }
+
+  // Too early, nothing goes out
+  next_usec = pictrl_pacer_release(&pacer, pipe_fds[1], START_USEC + 1);
+  if (read_reports(codes, PICTRL_SIZE(codes)) != 0 ||
+      next_usec != (int64_t)INTERVAL_USEC - 1) {
+    pictrl_log_error("Released a report before it was due\n");
+    return 3;
+  }
+
+  next_usec =
+      pictrl_pacer_release(&pacer, pipe_fds[1], START_USEC + INTERVAL_USEC);
+  num_reports = read_reports(codes, PICTRL_SIZE(codes));
+  if (num_reports != 1 || codes[0] != KEY_A + 2) {
+    pictrl_log_error("Expected exactly the 3rd report once it was due\n");
+    return 4;
+  }
+  if (next_usec != (int64_t)INTERVAL_USEC) {
+    pictrl_log_error("Expected next report in %" PRIu64 "us, got %lld\n",
+                     INTERVAL_USEC, (long long)next_usec);
+    return 5;
+  }
+  return 0;
+}
+
+static int test_full_queue() {
+  for (size_t i = 0; i < QUEUE_EVENTS / 2; i++) {
+    if (!push_report(KEY_A)) {
+      pictrl_log_error("Queue unexpectedly full at report %zu\n", i);
+      return 1;
+    }
+  }
+
+  if (push_report(KEY_B) || errno != ENOBUFS) {
+    pictrl_log_error("Pushed a report onto a full queue\n");
+    return 2;
+  }
+  if (pacer.dropped_events != 2 || pictrl_pacer_size(&pacer) != QUEUE_EVENTS) {
+    pictrl_log_error("Expected the whole report to be dropped\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_wrap_around() {
+  // Release the first few so the next pushes wrap past the end of the ring
+  uint64_t now_usec = START_USEC;
+  int next_code = KEY_A;
+  for (int i = 0; i < 3; i++) {
+    push_report(next_code++);
+  }
+  int codes[QUEUE_EVENTS];
+  while (!pictrl_pacer_empty(&pacer)) {
+    pictrl_pacer_release(&pacer, pipe_fds[1], now_usec);
+    now_usec += INTERVAL_USEC;
+  }
+  read_reports(codes, PICTRL_SIZE(codes));
+
+  const int first_wrapped = next_code;
+  for (size_t i = 0; i < QUEUE_EVENTS / 2; i++) {
+    if (!push_report(next_code++)) {
+      pictrl_log_error("Queue unexpectedly full at report %zu\n", i);
+      return 1;
+    }
+  }
+
+  // Let it all out in one go (a single writev() across the wrap)
+  now_usec += QUEUE_EVENTS * INTERVAL_USEC;
+  pacer.burst_reports = QUEUE_EVENTS;
+  pictrl_pacer_release(&pacer, pipe_fds[1], now_usec);
+  const ssize_t num_reports = read_reports(codes, PICTRL_SIZE(codes));
+  if (num_reports != (ssize_t)(QUEUE_EVENTS / 2)) {
+    pictrl_log_error("Expected %zu reports, got %zd\n", QUEUE_EVENTS / 2,
+                     num_reports);
+    return 2;
+  }
+  for (ssize_t i = 0; i < num_reports; i++) {
+    if (codes[i] != first_wrapped + i) {
+      pictrl_log_error("Report %zd out of order\n", i);
+      return 3;
+    }
+  }
+  return 0;
+}
+
+// A pictrl_pacer_writer that takes at most `max_bytes`, or fails with `error`
+typedef struct {
+  size_t max_bytes;
+  int error;
+  size_t bytes_taken;
+} LimitedWriter;
+
+static ssize_t limited_writev(void *ctx, const struct iovec *iov,
+                              int iov_count) {
+  LimitedWriter *writer = ctx;
+  if (writer->error != 0) {
+    errno = writer->error;
+    return -1;
+  }
+
+  size_t len = 0;
+  for (int i = 0; i < iov_count; i++) {
+    len += iov[i].iov_len;
+  }
+  len = (len < writer->max_bytes) ? len : writer->max_bytes;
+  writer->bytes_taken += len;
+  return (ssize_t)len;
+}
+
+static int test_short_write() {
+  for (int i = 0; i < 4; i++) {
+    push_report(KEY_A + i);
+  }
+  pacer.burst_reports = 4;
+
+  // Only 1 and a half reports fit, out of the whole burst that was due
+  LimitedWriter writer = {.max_bytes = 3 * sizeof(struct input_event)};
+  int64_t next_usec =
+      pictrl_pacer_release_to(&pacer, &limited_writev, &writer, START_USEC);
+  if (pictrl_pacer_size(&pacer) != 5) {
+    pictrl_log_error("Expected 5 events left, got %zu\n",
+                     pictrl_pacer_size(&pacer));
+    return 1;
+  }
+  if (next_usec != 0) {
+    pictrl_log_error("Expected the rest of the burst to still be due, got "
+                     "%lld\n",
+                     (long long)next_usec);
+    return 2;
+  }
+
+  // Finishing the half written report counts it, and the other 2 are still due
+  writer.max_bytes = SIZE_MAX;
+  next_usec =
+      pictrl_pacer_release_to(&pacer, &limited_writev, &writer, START_USEC);
+  if (!pictrl_pacer_empty(&pacer) || next_usec != -1) {
+    pictrl_log_error("Expected the rest of the burst to go out\n");
+    return 3;
+  }
+  if (pacer.next_release_usec != START_USEC + INTERVAL_USEC) {
+    pictrl_log_error("Expected 4 reports' worth of the rate used up\n");
+    return 4;
+  }
+  return 0;
+}
+
+static int test_would_block() {
+  push_report(KEY_A);
+  push_report(KEY_B);
+
+  LimitedWriter writer = {.error = EAGAIN};
+  const int64_t next_usec =
+      pictrl_pacer_release_to(&pacer, &limited_writev, &writer, START_USEC);
+  if (pictrl_pacer_size(&pacer) != 4 || pacer.dropped_events != 0) {
+    pictrl_log_error("Expected everything to stay queued\n");
+    return 1;
+  }
+  // Come back later rather than straight away, which would spin the caller
+  if (next_usec < (int64_t)PICTRL_PACER_MIN_RETRY_USEC) {
+    pictrl_log_error("Expected to back off, got %lld\n", (long long)next_usec);
+    return 2;
+  }
+
+  // Once the device comes back, the whole burst is still there for the taking
+  writer.error = 0;
+  writer.max_bytes = SIZE_MAX;
+  pictrl_pacer_release_to(&pacer, &limited_writev, &writer, START_USEC);
+  if (!pictrl_pacer_empty(&pacer)) {
+    pictrl_log_error("Expected a full burst once the device took it\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_torn_event() {
+  push_report(KEY_A);
+  push_report(KEY_B);
+
+  // Half of the first event makes it
+  LimitedWriter writer = {.max_bytes = sizeof(struct input_event) / 2};
+  pictrl_pacer_release_to(&pacer, &limited_writev, &writer, START_USEC);
+  if (pictrl_pacer_size(&pacer) != 3 || pacer.dropped_events != 1) {
+    pictrl_log_error("Expected the torn event to be dropped, %zu left\n",
+                     pictrl_pacer_size(&pacer));
+    return 1;
+  }
+
+  // The next release starts on an event boundary
+  writer = (LimitedWriter){.max_bytes = SIZE_MAX};
+  pacer.burst_reports = QUEUE_EVENTS;
+  pictrl_pacer_release_to(&pacer, &limited_writev, &writer,
+                          START_USEC + QUEUE_EVENTS * INTERVAL_USEC);
+  if (!pictrl_pacer_empty(&pacer) ||
+      writer.bytes_taken != 3 * sizeof(struct input_event)) {
+    pictrl_log_error("Expected the remaining 3 events, got %zu bytes\n",
+                     writer.bytes_taken);
+    return 2;
+  }
+  return 0;
+}
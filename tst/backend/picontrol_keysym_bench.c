@@ -0,0 +1,65 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "backend/picontrol_keysym.h"
+#include "backend/picontrol_uinput.h"
+#include "pitest/api.h"
+#include "pitest/api/benchmark.h"
+#include "util.h"
+
+static void bench_lookup_hit(size_t iterations);
+static void bench_lookup_miss(size_t iterations);
+static void bench_parse_combo(size_t iterations);
+
+// Cycled through, so it's not the same slot every time
+static const char *names[] = {"ctrl", "Shift", "tab", "F5", "Return", "alt",
+                              "Left", "super"};
+
+int main() {
+  const BenchmarkCase bench_cases[] = {
+      {
+          .bench_name = "Lookup (known name)",
+          .bench_function = &bench_lookup_hit,
+      },
+      {
+          .bench_name = "Lookup (unknown name)",
+          .bench_function = &bench_lookup_miss,
+      },
+      {
+          .bench_name = "Parse combo",
+          .bench_function = &bench_parse_combo,
+      }};
+
+  const BenchmarkSuite suite = {
+      .name = "Keysym benchmarks",
+      .bench_cases = bench_cases,
+      .num_benchmarks = PICTRL_SIZE(bench_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = NULL, .teardown = NULL}};
+
+  return run_benchmark_suite(&suite);
+}
+
+static void bench_lookup_hit(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) {
+    const char *name = names[i % PICTRL_SIZE(names)];
+    int code = pictrl_keysym_lookup(name, strlen(name));
+    pitest_keep(&code);
+  }
+}
+
+static void bench_lookup_miss(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) {
+    int code = pictrl_keysym_lookup("notakey", strlen("notakey"));
+    pitest_keep(&code);
+  }
+}
+
+static void bench_parse_combo(size_t iterations) {
+  static const char combo[] = "ctrl+shift+t";
+  pictrl_key_combo parsed;
+  for (size_t i = 0; i < iterations; i++) {
+    pictrl_keysym_parse_combo(combo, strlen(combo), &parsed);
+    pitest_keep(&parsed);
+  }
+}
@@ -0,0 +1,159 @@
+#include "backend/picontrol_keysym_cache.h"
+
+#include <inttypes.h>
+#include <linux/input.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_miss_then_hit();
+static int test_evicts_least_recently_used();
+static int test_churn();
+static int test_key_too_long();
+
+// Fixtures
+static pictrl_keysym_cache cache;
+
+int before_each() {
+  pictrl_keysym_cache_init(&cache);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Miss, then hit",
+          .test_function = &test_miss_then_hit,
+      },
+      {
+          .test_name = "Evicts least recently used",
+          .test_function = &test_evicts_least_recently_used,
+      },
+      {
+          .test_name = "Churn keeps the most recent entries",
+          .test_function = &test_churn,
+      },
+      {
+          .test_name = "Key too long",
+          .test_function = &test_key_too_long,
+      }};
+
+  const TestSuite suite = {
+      .name = "Keysym cache tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = NULL}};
+
+  return run_test_suite(&suite);
+}
+
+// Caches a single event tagged with `code` under `key`
+static bool put(const char *key, int code) {
+  const struct input_event event = {.type = EV_KEY, .code = code, .value = 1};
+  return pictrl_keysym_cache_put(&cache, (const uint8_t *)key, strlen(key),
+                                 &event, 1);
+}
+
+// Returns the code `key` was cached with, or -1 on a miss
+static int get(const char *key) {
+  const pictrl_keysym_cache_entry *entry =
+      pictrl_keysym_cache_get(&cache, (const uint8_t *)key, strlen(key));
+  return (entry == NULL) ? -1 : entry->events[0].code;
+}
+
+static int test_miss_then_hit() {
+  if (get("Ctrl+c") != -1) {
+    pictrl_log_error("Hit on an empty cache\n");
+    return 1;
+  }
+  put("Ctrl+c", KEY_C);
+
+  if (get("Ctrl+c") != KEY_C || get("Ctrl+c") != KEY_C) {
+    pictrl_log_error("Expected a hit after caching\n");
+    return 2;
+  }
+  // Raw bytes, so case matters
+  if (get("ctrl+c") != -1) {
+    pictrl_log_error("Hit on a different key\n");
+    return 3;
+  }
+
+  if (cache.stats.hits != 2 || cache.stats.misses != 2) {
+    pictrl_log_error("Expected 2 hits and 2 misses, got %" PRIu64
+                     " and %" PRIu64 "\n",
+                     cache.stats.hits, cache.stats.misses);
+    return 4;
+  }
+  return 0;
+}
+
+static int test_evicts_least_recently_used() {
+  char key[16];
+  for (int i = 0; i < PICTRL_KEYSYM_CACHE_ENTRIES; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    put(key, i);
+  }
+
+  // key0 is now the most recently used, so key1 should be the one to go
+  get("key0");
+  put("new", 1000);
+  if (get("key1") != -1) {
+    pictrl_log_error("key1 should have been evicted\n");
+    return 1;
+  }
+  if (get("key0") != 0 || get("new") != 1000) {
+    pictrl_log_error("Evicted the wrong entry\n");
+    return 2;
+  }
+  if (cache.stats.evictions != 1) {
+    pictrl_log_error("Expected 1 eviction, got %" PRIu64 "\n",
+                     cache.stats.evictions);
+    return 3;
+  }
+  return 0;
+}
+
+static int test_churn() {
+  // Go through the cache many times over, so every entry gets reused
+  const int num_keys = PICTRL_KEYSYM_CACHE_ENTRIES * 8;
+  char key[16];
+  for (int i = 0; i < num_keys; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    put(key, i);
+  }
+
+  for (int i = 0; i < num_keys; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    const bool should_hit = (i >= num_keys - PICTRL_KEYSYM_CACHE_ENTRIES);
+    const int code = get(key);
+    if (should_hit ? code != i : code != -1) {
+      pictrl_log_error("Unexpected %s for %s\n", should_hit ? "miss" : "hit",
+                       key);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int test_key_too_long() {
+  char key[PICTRL_KEYSYM_CACHE_KEY_MAX + 2];
+  memset(key, 'a', sizeof(key) - 1);
+  key[sizeof(key) - 1] = '\0';
+
+  if (put(key, KEY_A)) {
+    pictrl_log_error("Cached a key that's too long\n");
+    return 1;
+  }
+  if (get(key) != -1) {
+    pictrl_log_error("Hit on a key that's too long\n");
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "backend/picontrol_keysym.h"
+
+#include <ctype.h>
+#include <linux/input-event-codes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_every_name();
+static int test_case_insensitive();
+static int test_unknown_names();
+static int test_combo();
+static int test_bad_combos();
+
+typedef struct {
+  const char *name;
+  int code;
+} keysym_def;
+
+static const keysym_def keysyms[] = {
+#define PICTRL_KEYSYM(name, code) {name, code},
+#include "backend/picontrol_keysym_names.def"
+#undef PICTRL_KEYSYM
+};
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Every listed name resolves",
+          .test_function = &test_every_name,
+      },
+      {
+          .test_name = "Names are case insensitive",
+          .test_function = &test_case_insensitive,
+      },
+      {
+          .test_name = "Unknown names",
+          .test_function = &test_unknown_names,
+      },
+      {
+          .test_name = "Combo",
+          .test_function = &test_combo,
+      },
+      {
+          .test_name = "Bad combos",
+          .test_function = &test_bad_combos,
+      }};
+
+  const TestSuite suite = {
+      .name = "Keysym tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = NULL, .teardown = NULL}};
+
+  return run_test_suite(&suite);
+}
+
+static int test_every_name() {
+  for (size_t i = 0; i < PICTRL_SIZE(keysyms); i++) {
+    const int code =
+        pictrl_keysym_lookup(keysyms[i].name, strlen(keysyms[i].name));
+    if (code != keysyms[i].code) {
+      pictrl_log_error("\"%s\": expected %d, got %d\n", keysyms[i].name,
+                       keysyms[i].code, code);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int test_case_insensitive() {
+  char upper[32];
+  for (size_t i = 0; i < PICTRL_SIZE(keysyms); i++) {
+    const size_t len = strlen(keysyms[i].name);
+    for (size_t j = 0; j < len; j++) {
+      upper[j] = toupper(keysyms[i].name[j]);
+    }
+
+    if (pictrl_keysym_lookup(upper, len) != keysyms[i].code) {
+      pictrl_log_error("\"%.*s\" did not resolve\n", (int)len, upper);
+      return 1;
+    }
+  }
+
+  const char mixed[] = "Page_Down";
+  if (pictrl_keysym_lookup(mixed, strlen(mixed)) != KEY_PAGEDOWN) {
+    pictrl_log_error("\"%s\" did not resolve\n", mixed);
+    return 2;
+  }
+  return 0;
+}
+
+static int test_unknown_names() {
+  const char *unknown[] = {"", "ctr", "ctrlx", "f13", "+", "shift_", "AltGrr"};
+  for (size_t i = 0; i < PICTRL_SIZE(unknown); i++) {
+    if (pictrl_keysym_lookup(unknown[i], strlen(unknown[i])) >= 0) {
+      pictrl_log_error("\"%s\" should not have resolved\n", unknown[i]);
+      return 1;
+    }
+  }
+
+  // Only the first `len` bytes count
+  if (pictrl_keysym_lookup("tabs", 3) != KEY_TAB) {
+    pictrl_log_error("Lookup read past the given length\n");
+    return 2;
+  }
+  return 0;
+}
+
+static int test_combo() {
+  // Not null terminated, just like a payload
+  const char keysym[] = {'C', 't', 'r', 'l', '+', 'S', 'h', 'i',
+                         'f', 't', '+', 't', 'X', 'X', 'X'};
+  pictrl_key_combo combo;
+  if (!pictrl_keysym_parse_combo(keysym, 12, &combo)) {
+    pictrl_log_error("Could not parse combo\n");
+    return 1;
+  }
+
+  const int expected[] = {KEY_LEFTCTRL, KEY_LEFTSHIFT, KEY_T};
+  if (combo.num_keys != PICTRL_SIZE(expected) ||
+      memcmp(expected, combo.keys, sizeof(expected)) != 0) {
+    pictrl_log_error("Parsed the wrong keys\n");
+    return 2;
+  }
+  return 0;
+}
+
+static int test_bad_combos() {
+  const char *bad[] = {"",        "ctrl+",    "+a",
+                       "ctrl++a", "ctrl+nope", "a+b+c+d+e+f+g+h+i+j+k"};
+  pictrl_key_combo combo;
+  for (size_t i = 0; i < PICTRL_SIZE(bad); i++) {
+    if (pictrl_keysym_parse_combo(bad[i], strlen(bad[i]), &combo)) {
+      pictrl_log_error("\"%s\" should not have parsed\n", bad[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
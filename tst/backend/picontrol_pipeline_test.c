@@ -0,0 +1,331 @@
+#include "backend/picontrol_pipeline.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "backend/picontrol_backend.h"
+#include "backend/picontrol_null.h"
+#include "logging/log_utils.h"
+#include "model/mouse.h"
+#include "model/protocol.h"
+#include "picontrol_config.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_fifo();
+static int test_full_queue_drops_motion();
+static int test_clicks_wait_for_room();
+static int test_emitter_wakes_for_motion();
+static int test_free_drains();
+
+#define NUM_KEYSYMS 100
+
+// Fixtures
+static pictrl_backend *backend;
+static pictrl_null_backend *counts;  // What `backend` has emitted so far
+static pictrl_pipeline *pipeline;
+
+// The null backend, but clicks can be held up (to stand in for a stuck
+// backend), and keysyms are logged in the order they come out. Only the
+// emitter thread writes the log, so it's only safe to read once the pipeline
+// has been freed
+static pictrl_backend_ops test_ops;
+static sem_t gate;
+static atomic_bool hold_clicks;
+static uint8_t keysym_log[PICTRL_PIPELINE_QUEUE_LEN];
+static size_t num_logged;
+
+static void gated_click(void *impl, PiCtrlMouseBtnStatus status) {
+  if (atomic_load(&hold_clicks)) {
+    while (sem_wait(&gate) < 0) {
+    }
+  }
+  pictrl_null_backend_ops.click_mouse(impl, status);
+}
+
+static void logged_keysym(void *impl, const char *keysym, size_t len) {
+  if (num_logged < PICTRL_SIZE(keysym_log)) {
+    keysym_log[num_logged] = keysym[0];
+  }
+  num_logged++;
+  pictrl_null_backend_ops.type_keysym(impl, keysym, len);
+}
+
+static void open_gate() {
+  atomic_store(&hold_clicks, false);
+  sem_post(&gate);
+}
+
+static void *open_gate_later(void *usec) {
+  usleep((uintptr_t)usec);
+  open_gate();
+  return NULL;
+}
+
+int before_each() {
+  backend = pictrl_backend_new("null");
+  if (backend == NULL) {
+    pictrl_log_error("Could not create null backend\n");
+    return -1;
+  }
+  counts = backend->impl;
+  test_ops = pictrl_null_backend_ops;
+  test_ops.click_mouse = &gated_click;
+  test_ops.type_keysym = &logged_keysym;
+  backend->ops = &test_ops;
+
+  sem_init(&gate, 0, 0);
+  atomic_store(&hold_clicks, false);
+  num_logged = 0;
+
+  pipeline = pictrl_pipeline_new(backend);
+  if (pipeline == NULL) {
+    pictrl_log_error("Could not start pipeline\n");
+    return -1;
+  }
+  return 0;
+}
+
+int after_each() {
+  open_gate();
+  pictrl_pipeline_free(pipeline);  // If the test hasn't already
+  pictrl_backend_free(backend);
+  sem_destroy(&gate);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Messages come out in the order they went in",
+          .test_function = &test_fifo,
+      },
+      {
+          .test_name = "Full queue stalls, then drops motion",
+          .test_function = &test_full_queue_drops_motion,
+      },
+      {
+          .test_name = "Clicks wait for room instead of being dropped",
+          .test_function = &test_clicks_wait_for_room,
+      },
+      {
+          .test_name = "Emitter wakes up for held-back motion",
+          .test_function = &test_emitter_wakes_for_motion,
+      },
+      {
+          .test_name = "Freeing drains everything submitted",
+          .test_function = &test_free_drains,
+      }};
+
+  const TestSuite suite = {
+      .name = "Pipeline tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+static int submit(PiCtrlCmd cmd, uint8_t *payload, uint8_t payload_size) {
+  RawPiCtrlMessage msg = {
+      .header = {.cmd = cmd, .payload_size = payload_size},
+      .payload = payload};
+  return pictrl_pipeline_submit(pipeline, &msg);
+}
+
+static int submit_move(int8_t x, int8_t y) {
+  uint8_t payload[] = {(uint8_t)x, (uint8_t)y};
+  return submit(PI_CTRL_MOUSE_MV, payload, sizeof(payload));
+}
+
+static int submit_click(uint8_t state) {
+  uint8_t payload[] = {(PI_CTRL_MOUSE_LEFT << 1) | state};
+  return submit(PI_CTRL_MOUSE_CLICK, payload, sizeof(payload));
+}
+
+// One byte keysyms, so the log can tell them apart
+static int submit_keysym(uint8_t id) {
+  uint8_t payload[] = {id};
+  return submit(PI_CTRL_KEYSYM, payload, sizeof(payload));
+}
+
+static void free_pipeline() {
+  pictrl_pipeline_free(pipeline);
+  pipeline = NULL;
+}
+
+static bool check_keysym_log(size_t expected) {
+  if (num_logged != expected) {
+    pictrl_log_error("Expected %zu keysyms, got %zu\n", expected, num_logged);
+    return false;
+  }
+  for (size_t i = 0; i < expected; i++) {
+    if (keysym_log[i] != (uint8_t)i) {
+      pictrl_log_error("Keysym %zu came out as %d\n", i, keysym_log[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Holds the emitter up on a click, then fills the rest of the queue with
+// keysyms behind it
+static bool fill_queue() {
+  atomic_store(&hold_clicks, true);
+  if (submit_click(PI_CTRL_MOUSE_DOWN) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < PICTRL_PIPELINE_QUEUE_LEN - 1; i++) {
+    if (submit_keysym(i) != 0) {
+      pictrl_log_error("Queue filled up after %zu messages\n", i);
+      return false;
+    }
+  }
+
+  pictrl_pipeline_stats stats;
+  pictrl_pipeline_get_stats(pipeline, &stats);
+  if (stats.stalls != 0) {
+    pictrl_log_error("Stalled %" PRIu64 " times before the queue was full\n",
+                     stats.stalls);
+    return false;
+  }
+  return true;
+}
+
+static int test_fifo() {
+  // Arrange/Act
+  for (size_t i = 0; i < NUM_KEYSYMS; i++) {
+    if (submit_keysym(i) != 0) {
+      return 1;
+    }
+  }
+  free_pipeline();
+
+  // Assert
+  return check_keysym_log(NUM_KEYSYMS) ? 0 : 2;
+}
+
+static int test_full_queue_drops_motion() {
+  // Arrange
+  if (!fill_queue()) {
+    return 1;
+  }
+
+  // Act
+  const int ret = submit_move(1, 0);
+
+  // Assert: it waited its turn, then gave up on the move
+  pictrl_pipeline_stats stats;
+  pictrl_pipeline_get_stats(pipeline, &stats);
+  if (ret != -1 || stats.stalls != 1 || stats.dropped != 1 ||
+      stats.submitted != PICTRL_PIPELINE_QUEUE_LEN) {
+    pictrl_log_error("Submit returned %d: %" PRIu64 " stalls, %" PRIu64
+                     " dropped, %" PRIu64 " submitted\n",
+                     ret, stats.stalls, stats.dropped, stats.submitted);
+    return 2;
+  }
+
+  // Everything that did get in still comes out, and the move doesn't
+  open_gate();
+  free_pipeline();
+  if (counts->clicks != 1 || counts->mouse_moves != 0) {
+    pictrl_log_error("%" PRIu64 " clicks, %" PRIu64 " moves\n",
+                     counts->clicks, counts->mouse_moves);
+    return 3;
+  }
+  return check_keysym_log(PICTRL_PIPELINE_QUEUE_LEN - 1) ? 0 : 4;
+}
+
+static int test_clicks_wait_for_room() {
+  // Arrange: the emitter gets going again well past the stall limit
+  if (!fill_queue()) {
+    return 1;
+  }
+  pthread_t opener;
+  pthread_create(&opener, NULL, &open_gate_later,
+                 (void *)(uintptr_t)(5 * PICTRL_PIPELINE_STALL_USEC));
+
+  // Act
+  const int ret = submit_click(PI_CTRL_MOUSE_UP);
+  pthread_join(opener, NULL);
+
+  // Assert: the mouseup waited for room, so the button doesn't stay down
+  pictrl_pipeline_stats stats;
+  pictrl_pipeline_get_stats(pipeline, &stats);
+  if (ret != 0 || stats.stalls != 1 || stats.dropped != 0) {
+    pictrl_log_error("Submit returned %d: %" PRIu64 " stalls, %" PRIu64
+                     " dropped\n",
+                     ret, stats.stalls, stats.dropped);
+    return 2;
+  }
+  free_pipeline();
+  if (counts->clicks != 2) {
+    pictrl_log_error("Expected 2 clicks, got %" PRIu64 "\n", counts->clicks);
+    return 3;
+  }
+  return 0;
+}
+
+static int test_emitter_wakes_for_motion() {
+  // Arrange: the first move goes straight out, the second is held back until
+  // its frame ends
+  if (submit_move(1, 0) != 0 || submit_move(2, 0) != 0) {
+    return 1;
+  }
+
+  // Act: nothing else gets submitted, so only the emitter's own timeout can
+  // flush it
+  uint64_t moves = 0;
+  for (int i = 0; i < 10 && moves < 2; i++) {
+    usleep(PICTRL_MOUSE_FRAME_USEC);
+    moves = __atomic_load_n(&counts->mouse_moves, __ATOMIC_RELAXED);
+  }
+
+  // Assert
+  if (moves != 2) {
+    pictrl_log_error("Expected the held-back move to go out, got %" PRIu64
+                     " moves\n",
+                     moves);
+    return 2;
+  }
+  free_pipeline();
+  if (counts->mouse_dx != 3) {
+    pictrl_log_error("Moved by %" PRId64 ", expected 3\n", counts->mouse_dx);
+    return 3;
+  }
+  return 0;
+}
+
+static int test_free_drains() {
+  // Arrange: everything's stuck behind a click when we start shutting down
+  atomic_store(&hold_clicks, true);
+  if (submit_click(PI_CTRL_MOUSE_DOWN) != 0) {
+    return 1;
+  }
+  for (size_t i = 0; i < NUM_KEYSYMS; i++) {
+    if (submit_keysym(i) != 0) {
+      return 2;
+    }
+  }
+  pthread_t opener;
+  pthread_create(&opener, NULL, &open_gate_later,
+                 (void *)(uintptr_t)PICTRL_PIPELINE_STALL_USEC);
+
+  // Act
+  free_pipeline();
+  pthread_join(opener, NULL);
+
+  // Assert
+  if (counts->clicks != 1) {
+    pictrl_log_error("Expected 1 click, got %" PRIu64 "\n", counts->clicks);
+    return 3;
+  }
+  return check_keysym_log(NUM_KEYSYMS) ? 0 : 4;
+}
@@ -16,16 +16,19 @@
 #include "util.h"
 
 static int test_mv_mouse();
+static int test_mv_mouse_frame();
+static int test_scroll();
+static int test_mv_mouse_abs();
 static int test_all_ascii_chars();
 static int test_ctrl_g();
 static int test_typing();
+static int test_typing_utf8();
 
 // Fixtures
 static pictrl_uinput_t virt_keyboard;
 
 int before_all() {
-  virt_keyboard.fd = picontrol_create_virtual_keyboard();
-  if (virt_keyboard.fd < 0) {
+  if (pictrl_uinput_backend_init(&virt_keyboard) < 0) {
     pictrl_log_error(
         "Could not open file descriptor for new virtual device.\n");
     return 1;
@@ -36,8 +39,14 @@ int before_all() {
   return 0;
 }
 
+// Let whatever the test typed actually make it out
+int after_each() {
+  picontrol_uinput_drain(&virt_keyboard);
+  return 0;
+}
+
 int after_all() {
-  if (picontrol_destroy_virtual_keyboard(virt_keyboard.fd) < 0) {
+  if (pictrl_uinput_backend_destroy(&virt_keyboard) < 0) {
     pictrl_log_error("Couldn't close PiControl virtual keyboard.\n");
     return 1;
   }
@@ -53,6 +62,18 @@ int main() {
           .test_name = "Mouse movement",
           .test_function = &test_mv_mouse,
       },
+      {
+          .test_name = "Mouse movement (batched frame)",
+          .test_function = &test_mv_mouse_frame,
+      },
+      {
+          .test_name = "Smooth scrolling",
+          .test_function = &test_scroll,
+      },
+      {
+          .test_name = "Absolute mouse movement (tablet)",
+          .test_function = &test_mv_mouse_abs,
+      },
       {
           .test_name = "All ASCII characters",
           .test_function = &test_all_ascii_chars,
@@ -65,6 +86,10 @@ int main() {
           .test_name = "Normal typing (echo command)",
           .test_function = &test_typing,
       },
+      {
+          .test_name = "Whole UTF-8 string in one pass",
+          .test_function = &test_typing_utf8,
+      },
   };
 
   const TestSuite suite = {
@@ -72,7 +97,7 @@ int main() {
       .test_cases = test_cases,
       .num_tests = PICTRL_SIZE(test_cases),
       .before_after_all = {.setup = &before_all, .teardown = &after_all},
-      .before_after_each = {.setup = NULL, .teardown = NULL}};
+      .before_after_each = {.setup = NULL, .teardown = &after_each}};
 
   return run_test_suite(&suite);
 }
@@ -100,6 +125,60 @@ static int test_mv_mouse() {
   return ret ? 0 : 1;
 }
 
+static int test_mv_mouse_frame() {
+  struct input_event events[PICTRL_UINPUT_MAX_BURST_EVENTS];
+  pictrl_uinput_frame frame;
+  pictrl_uinput_frame_init(&frame, events, PICTRL_SIZE(events));
+
+  // Same movement as above, but back the other way and in as few writes as the
+  // frame allows
+  bool ret = true;
+  for (int i = 0; i < 50; i++) {
+    if (pictrl_uinput_frame_space(&frame) < 3) {
+      ret &= pictrl_uinput_frame_flush(virt_keyboard.fd, &frame) >= 0;
+    }
+    pictrl_uinput_frame_append(&frame, EV_REL, REL_X, -5);
+    pictrl_uinput_frame_append(&frame, EV_REL, REL_Y, -5);
+    pictrl_uinput_frame_syn(&frame);
+  }
+  ret &= pictrl_uinput_frame_flush(virt_keyboard.fd, &frame) >= 0;
+
+  return ret && frame.num_events == 0 ? 0 : 1;
+}
+
+static int test_scroll() {
+  // 500/120ths of a notch down: legacy clients should only see the 4 whole ones
+  for (int i = 0; i < 10; i++) {
+    const PiCtrlMouseScroll scroll = {.vertical = -50, .horizontal = 0};
+    picontrol_uinput_scroll(&virt_keyboard, scroll);
+    usleep(10000);
+  }
+
+  const int remainder = virt_keyboard.wheel_remainder.vertical;
+  if (remainder != -20) {
+    pictrl_log_error("Expected -20 left over after whole notches, got %d\n",
+                     remainder);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_mv_mouse_abs() {
+  if (virt_keyboard.tablet_fd < 0) {
+    pictrl_log_error("Virtual tablet wasn't created\n");
+    return 1;
+  }
+
+  // Diagonally across the screen, top left to bottom right
+  const uint32_t step = PICTRL_MOUSE_ABS_MAX / 64;
+  for (uint32_t i = 0; i <= PICTRL_MOUSE_ABS_MAX; i += step) {
+    const PiCtrlMouseAbs pos = {.x = i, .y = i};
+    picontrol_uinput_move_mouse_abs(&virt_keyboard, pos);
+    usleep(5000);
+  }
+  return 0;
+}
+
 static int test_ctrl_g() {
   struct input_event ie;
   struct timeval cur_time;
@@ -145,3 +224,14 @@ static int test_typing() {
              ? 0
              : 1;
 }
+
+static int test_typing_utf8() {
+  // The 2 non-ASCII characters can't be typed, and should be skipped without
+  // taking anything around them down too
+  const char str[] = "echo \"Zdr\xc3\xa1vstvuj\xc5\xa5" "e\"\n";
+  const size_t expected_chars = (sizeof(str) - 1) - 2 * 2;
+  return picontrol_uinput_type_text(&virt_keyboard, (const uint8_t *)str,
+                                    sizeof(str) - 1) == expected_chars
+             ? 0
+             : 1;
+}
@@ -0,0 +1,130 @@
+#include "data_structures/histogram.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_small_values_exact();
+static int test_relative_precision();
+static int test_percentiles();
+static int test_merge();
+
+// Fixtures
+static pictrl_histogram hist;
+
+int before_each() {
+  pictrl_histogram_init(&hist);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Small values are exact",
+          .test_function = &test_small_values_exact,
+      },
+      {
+          .test_name = "Relative precision",
+          .test_function = &test_relative_precision,
+      },
+      {
+          .test_name = "Percentiles",
+          .test_function = &test_percentiles,
+      },
+      {
+          .test_name = "Merge",
+          .test_function = &test_merge,
+      }};
+
+  const TestSuite suite = {
+      .name = "Histogram tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = NULL}};
+
+  return run_test_suite(&suite);
+}
+
+static int test_small_values_exact() {
+  for (uint64_t value = 0; value < 2 * PICTRL_HISTOGRAM_SUB_BUCKETS; value++) {
+    pictrl_histogram_init(&hist);
+    pictrl_histogram_record(&hist, value);
+    pictrl_histogram_record(&hist, 1000000);
+    if (pictrl_histogram_percentile(&hist, 50) != value) {
+      pictrl_log_error("%" PRIu64 " came back as %" PRIu64 "\n", value,
+                       pictrl_histogram_percentile(&hist, 50));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int test_relative_precision() {
+  // Every value should come back no lower, and no more than 1/SUB_BUCKETS
+  // higher
+  const uint64_t last_bucket_low =
+      (uint64_t)(2 * PICTRL_HISTOGRAM_SUB_BUCKETS - 1)
+      << (PICTRL_HISTOGRAM_MAX_BITS - PICTRL_HISTOGRAM_SUB_BITS - 1);
+  for (uint64_t value = 1; value < last_bucket_low; value = value * 3 + 1) {
+    pictrl_histogram_init(&hist);
+    pictrl_histogram_record(&hist, value);
+    pictrl_histogram_record(&hist, UINT64_MAX);
+    const uint64_t got = pictrl_histogram_percentile(&hist, 50);
+    if (got < value || got > value + value / PICTRL_HISTOGRAM_SUB_BUCKETS) {
+      pictrl_log_error("%" PRIu64 " came back as %" PRIu64 "\n", value, got);
+      return 1;
+    }
+  }
+
+  // Past the last bucket, we can only say it was big
+  pictrl_histogram_init(&hist);
+  pictrl_histogram_record(&hist, (uint64_t)1 << 50);
+  if (pictrl_histogram_percentile(&hist, 50) != (uint64_t)1 << 50) {
+    pictrl_log_error("Huge value came back smaller\n");
+    return 2;
+  }
+  return 0;
+}
+
+static int test_percentiles() {
+  for (uint64_t value = 1; value <= 1000; value++) {
+    pictrl_histogram_record(&hist, value);
+  }
+
+  const double percentiles[] = {50, 99, 99.9, 100};
+  const uint64_t expected[] = {500, 990, 999, 1000};
+  for (size_t i = 0; i < PICTRL_SIZE(percentiles); i++) {
+    const uint64_t got = pictrl_histogram_percentile(&hist, percentiles[i]);
+    if (got < expected[i] || got > expected[i] + expected[i] / 32) {
+      pictrl_log_error("p%g: expected ~%" PRIu64 ", got %" PRIu64 "\n",
+                       percentiles[i], expected[i], got);
+      return 1;
+    }
+  }
+
+  if (hist.min != 1 || hist.max != 1000 || pictrl_histogram_mean(&hist) != 500) {
+    pictrl_log_error("Wrong min/max/mean\n");
+    return 2;
+  }
+  return 0;
+}
+
+static int test_merge() {
+  pictrl_histogram other;
+  pictrl_histogram_init(&other);
+  pictrl_histogram_record(&hist, 10);
+  pictrl_histogram_record(&other, 20);
+  pictrl_histogram_record(&other, 30);
+
+  pictrl_histogram_merge(&hist, &other);
+  if (hist.total != 3 || hist.min != 10 || hist.max != 30 ||
+      pictrl_histogram_percentile(&hist, 50) != 20) {
+    pictrl_log_error("Merged histogram is off\n");
+    return 1;
+  }
+  return 0;
+}
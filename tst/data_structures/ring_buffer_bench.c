@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "data_structures/ring_buffer.h"
+#include "logging/log_utils.h"
+#include "picontrol_config.h"
+#include "pitest/api.h"
+#include "pitest/api/benchmark.h"
+#include "util.h"
+
+static void bench_write_consume(size_t iterations);
+static void bench_get(size_t iterations);
+static void bench_copy(size_t iterations);
+static void bench_write_consume_pow2(size_t iterations);
+static void bench_get_pow2(size_t iterations);
+static void bench_copy_pow2(size_t iterations);
+static void bench_write_consume_mirrored(size_t iterations);
+
+// Doesn't divide MAX_BUF, so writes keep landing on the wraparound
+#define CHUNK_SIZE 100
+
+// Fixtures
+static int zero_fd = -1;
+static int null_fd = -1;
+static pictrl_rb_t ring_buffer;       // Modulo indexing (MAX_BUF is a power
+static pictrl_rb_t pow2_ring_buffer;  // of 2, but only this one knows it)
+static pictrl_rb_t mirrored_ring_buffer;
+static uint8_t copy_dest[MAX_BUF];
+
+int before_all() {
+  zero_fd = open("/dev/zero", O_RDONLY | O_CLOEXEC);
+  null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (zero_fd < 0 || null_fd < 0) {
+    pictrl_log_error("Could not open /dev/zero or /dev/null: %s\n",
+                     strerror(errno));
+    return 1;
+  }
+  // Has to be whole pages, which can be bigger than MAX_BUF (e.g. 16K)
+  const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t mirrored_size = (page_size > MAX_BUF) ? page_size : MAX_BUF;
+  if (pictrl_rb_init(&ring_buffer, MAX_BUF) == NULL ||
+      pictrl_rb_init_pow2(&pow2_ring_buffer, MAX_BUF) == NULL ||
+      pictrl_rb_init_mirrored(&mirrored_ring_buffer, mirrored_size) == NULL) {
+    pictrl_log_error("Could not initialize ring buffers\n");
+    return 1;
+  }
+  return 0;
+}
+
+int after_all() {
+  pictrl_rb_destroy(&ring_buffer);
+  pictrl_rb_destroy(&pow2_ring_buffer);
+  pictrl_rb_destroy(&mirrored_ring_buffer);
+  close(zero_fd);
+  close(null_fd);
+  return 0;
+}
+
+// Full, with the data wrapped around the end of the buffer
+int before_each() {
+  pictrl_rb_clear(&ring_buffer);
+  ring_buffer.data_start = MAX_BUF / 2 + 1;
+  ring_buffer.num_items = MAX_BUF;
+  pictrl_rb_clear(&pow2_ring_buffer);
+  pow2_ring_buffer.tail = MAX_BUF / 2 + 1;
+  pow2_ring_buffer.head = pow2_ring_buffer.tail + MAX_BUF;
+  return 0;
+}
+
+int main() {
+  const BenchmarkCase bench_cases[] = {
+      {
+          .bench_name = "Write then consume (fd)",
+          .bench_function = &bench_write_consume,
+      },
+      {
+          .bench_name = "Get every byte",
+          .bench_function = &bench_get,
+      },
+      {
+          .bench_name = "Copy out (wrapped)",
+          .bench_function = &bench_copy,
+      },
+      {
+          .bench_name = "Write then consume (fd, power of 2)",
+          .bench_function = &bench_write_consume_pow2,
+      },
+      {
+          .bench_name = "Get every byte (power of 2)",
+          .bench_function = &bench_get_pow2,
+      },
+      {
+          .bench_name = "Copy out (wrapped, power of 2)",
+          .bench_function = &bench_copy_pow2,
+      },
+      {
+          .bench_name = "Write then consume (fd, mirrored)",
+          .bench_function = &bench_write_consume_mirrored,
+      }};
+
+  const BenchmarkSuite suite = {
+      .name = "Ring buffer benchmarks",
+      .bench_cases = bench_cases,
+      .num_benchmarks = PICTRL_SIZE(bench_cases),
+      .before_after_all = {.setup = &before_all, .teardown = &after_all},
+      .before_after_each = {.setup = &before_each, .teardown = NULL}};
+
+  return run_benchmark_suite(&suite);
+}
+
+static void write_consume(pictrl_rb_t *rb, size_t iterations) {
+  pictrl_rb_clear(rb);
+  for (size_t i = 0; i < iterations; i++) {
+    pictrl_rb_write(zero_fd, CHUNK_SIZE, rb);
+    pictrl_rb_read(null_fd, CHUNK_SIZE, rb, PICTRL_READ_CONSUME);
+  }
+}
+
+// One iteration is one byte
+static void get(pictrl_rb_t *rb, size_t iterations) {
+  const size_t size = pictrl_rb_size(rb);
+  uint8_t sum = 0;
+  for (size_t i = 0; i < iterations; i++) {
+    sum += pictrl_rb_get(rb, i & (size - 1));
+  }
+  pitest_keep(&sum);
+}
+
+static void copy(pictrl_rb_t *rb, size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) {
+    pictrl_rb_copy(rb, copy_dest);
+    pitest_keep(copy_dest);
+  }
+}
+
+static void bench_write_consume(size_t iterations) {
+  write_consume(&ring_buffer, iterations);
+}
+
+static void bench_get(size_t iterations) { get(&ring_buffer, iterations); }
+
+static void bench_copy(size_t iterations) { copy(&ring_buffer, iterations); }
+
+static void bench_write_consume_pow2(size_t iterations) {
+  write_consume(&pow2_ring_buffer, iterations);
+}
+
+static void bench_get_pow2(size_t iterations) {
+  get(&pow2_ring_buffer, iterations);
+}
+
+static void bench_copy_pow2(size_t iterations) {
+  copy(&pow2_ring_buffer, iterations);
+}
+
+static void bench_write_consume_mirrored(size_t iterations) {
+  write_consume(&mirrored_ring_buffer, iterations);
+}
@@ -19,6 +19,13 @@ static int test_simple_read_peek();
 static int test_write_more_than_free();
 static int test_simple_wraparound();
 static int test_clear_full_buffer();
+static int test_wrapped_transfer_in_one_call();
+static int test_append_wraps_around();
+static int test_pow2_rejects_other_capacities();
+static int test_pow2_wraparound();
+static int test_pow2_get_and_copy();
+static int test_mirrored_rejects_other_capacities();
+static int test_mirrored_wraparound_is_contiguous();
 
 static ssize_t rb_read_until_completion(int fd, size_t count, pictrl_rb_t *rb,
                                         pictrl_read_flag flag);
@@ -37,6 +44,8 @@ static char test_file_name[] =
 // Fixtures
 static FILE *test_file = NULL;
 static pictrl_rb_t ring_buffer;
+static pictrl_rb_t pow2_ring_buffer;
+static pictrl_rb_t mirrored_ring_buffer;
 
 int before_all() {
   // Create temp file
@@ -62,6 +71,16 @@ int before_all() {
     pictrl_log_error("Could not initialize ring buffer\n");
     return -1;
   }
+  if (pictrl_rb_init_pow2(&pow2_ring_buffer, RING_BUF_SIZE) == NULL) {
+    pictrl_log_error("Could not initialize power of 2 ring buffer\n");
+    return -1;
+  }
+  if (pictrl_rb_init_mirrored(&mirrored_ring_buffer,
+                              (size_t)sysconf(_SC_PAGESIZE)) == NULL) {
+    pictrl_log_error("Could not initialize mirrored ring buffer: %s\n",
+                     strerror(errno));
+    return -1;
+  }
   pictrl_log_debug("Initialized ring buffer to %zu bytes\n", RING_BUF_SIZE);
 
   return 0;
@@ -78,6 +97,8 @@ int before_each() {
 
   // Clear ring buffer
   pictrl_rb_clear(&ring_buffer);
+  pictrl_rb_clear(&pow2_ring_buffer);
+  pictrl_rb_clear(&mirrored_ring_buffer);
   return 0;
 }
 
@@ -102,6 +123,8 @@ int after_all() {
 
   // Destroy ring buffer
   pictrl_rb_destroy(&ring_buffer);
+  pictrl_rb_destroy(&pow2_ring_buffer);
+  pictrl_rb_destroy(&mirrored_ring_buffer);
   return ret;
 }
 
@@ -126,6 +149,34 @@ int main() {
       {
           .test_name = "Clear full buffer",
           .test_function = &test_clear_full_buffer,
+      },
+      {
+          .test_name = "Wrapped transfer in one call",
+          .test_function = &test_wrapped_transfer_in_one_call,
+      },
+      {
+          .test_name = "Append wraps around",
+          .test_function = &test_append_wraps_around,
+      },
+      {
+          .test_name = "Power of 2: rejects other capacities",
+          .test_function = &test_pow2_rejects_other_capacities,
+      },
+      {
+          .test_name = "Power of 2: wraparound",
+          .test_function = &test_pow2_wraparound,
+      },
+      {
+          .test_name = "Power of 2: get and copy",
+          .test_function = &test_pow2_get_and_copy,
+      },
+      {
+          .test_name = "Mirrored: rejects other capacities",
+          .test_function = &test_mirrored_rejects_other_capacities,
+      },
+      {
+          .test_name = "Mirrored: wraparound is contiguous",
+          .test_function = &test_mirrored_wraparound_is_contiguous,
       }};
 
   const TestSuite suite = {
@@ -343,15 +394,250 @@ int test_clear_full_buffer() {
   return 0;
 }
 
+int test_wrapped_transfer_in_one_call() {
+  // Arrange: free space (and then the data) from index 5 around to 4
+  uint8_t orig_data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  if (write_to_test_file(orig_data, RING_BUF_SIZE) < RING_BUF_SIZE) {
+    return 1;
+  }
+  rewind(test_file);
+  ring_buffer.data_start = 5;
+
+  // Act: no retries, unlike `rb_write_until_completion()`
+  const int test_fd = fileno(test_file);
+  if (pictrl_rb_write(test_fd, RING_BUF_SIZE, &ring_buffer) != RING_BUF_SIZE) {
+    pictrl_log_error("Wrapped write came up short\n");
+    return 2;
+  }
+
+  // Assert: peek the whole thing back out, then consume it
+  for (int pass = 0; pass < 2; pass++) {
+    const pictrl_read_flag flag = pass ? PICTRL_READ_CONSUME : PICTRL_READ_PEEK;
+    rewind(test_file);
+    if (ftruncate(test_fd, 0) < 0 ||
+        pictrl_rb_read(test_fd, RING_BUF_SIZE, &ring_buffer, flag) !=
+            RING_BUF_SIZE) {
+      pictrl_log_error("Wrapped read came up short\n");
+      return 3;
+    }
+    rewind(test_file);
+    uint8_t read_data[RING_BUF_SIZE] = {0};
+    if (read_from_test_file(read_data, RING_BUF_SIZE) < RING_BUF_SIZE ||
+        !array_equals(read_data, RING_BUF_SIZE, orig_data, RING_BUF_SIZE)) {
+      return 4;
+    }
+    const size_t expected_size = pass ? 0 : RING_BUF_SIZE;
+    if (ring_buffer.num_items != expected_size) {
+      pictrl_log_error("Expected %zu items, got %zu\n", expected_size,
+                       ring_buffer.num_items);
+      return 5;
+    }
+  }
+  if (ring_buffer.data_start != 5) {
+    pictrl_log_error("Expected data_start to end up back at 5, got %zu\n",
+                     ring_buffer.data_start);
+    return 6;
+  }
+  return 0;
+}
+
+int test_append_wraps_around() {
+  // Arrange: 2 bytes in, ending 1 byte before the end of the buffer
+  uint8_t orig_data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  ring_buffer.data_start = RING_BUF_SIZE - 3;
+  if (pictrl_rb_append(&ring_buffer, orig_data, 2) != 2) {
+    return 1;
+  }
+
+  // Act
+  const size_t appended =
+      pictrl_rb_append(&ring_buffer, orig_data + 2, sizeof(orig_data) - 2);
+
+  // Assert: only room for 6 more, the last 5 of which wrapped
+  if (appended != RING_BUF_SIZE - 2 ||
+      pictrl_rb_append(&ring_buffer, orig_data, 1) != 0) {
+    pictrl_log_error("Appended %zu bytes, expected %zu\n", appended,
+                     RING_BUF_SIZE - 2);
+    return 2;
+  }
+  uint8_t copied[RING_BUF_SIZE];
+  pictrl_rb_copy(&ring_buffer, copied);
+  if (!array_equals(copied, RING_BUF_SIZE, orig_data, RING_BUF_SIZE)) {
+    pictrl_log_error("Data mismatch. Received: ");
+    print_buf(copied, RING_BUF_SIZE);
+    return 3;
+  }
+  return 0;
+}
+
+static int test_pow2_rejects_other_capacities() {
+  pictrl_rb_t rb;
+  const size_t capacities[] = {0, 1, 6, 100};
+  for (size_t i = 0; i < PICTRL_SIZE(capacities); i++) {
+    if (pictrl_rb_init_pow2(&rb, capacities[i]) != NULL) {
+      pictrl_log_error("Accepted a capacity of %zu\n", capacities[i]);
+      pictrl_rb_destroy(&rb);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int test_pow2_wraparound() {
+  // Arrange
+  uint8_t orig_data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  if (write_to_test_file(orig_data, RING_BUF_SIZE) < RING_BUF_SIZE) {
+    return 1;
+  }
+  rewind(test_file);
+
+  // Act
+  pow2_ring_buffer.head = pow2_ring_buffer.tail = RING_BUF_SIZE - 1;
+  const int test_fd = fileno(test_file);
+  if (rb_write_until_completion(test_fd, RING_BUF_SIZE, &pow2_ring_buffer) !=
+      RING_BUF_SIZE) {
+    return 2;
+  }
+
+  // Assert
+  uint8_t expected_data[] = {2, 3, 4, 5, 6, 7, 8, 1};
+  if (!array_equals(pow2_ring_buffer.buffer, pow2_ring_buffer.capacity,
+                    expected_data, RING_BUF_SIZE)) {
+    pictrl_log_error("Data mismatch. Received: ");
+    print_buf(pow2_ring_buffer.buffer, RING_BUF_SIZE);
+    return 3;
+  }
+
+  // And back out, in order
+  rewind(test_file);
+  if (ftruncate(test_fd, 0) < 0 ||
+      rb_read_until_completion(test_fd, RING_BUF_SIZE, &pow2_ring_buffer,
+                               PICTRL_READ_CONSUME) != RING_BUF_SIZE) {
+    return 4;
+  }
+  rewind(test_file);
+  uint8_t read_data[RING_BUF_SIZE] = {0};
+  if (read_from_test_file(read_data, RING_BUF_SIZE) < RING_BUF_SIZE ||
+      !array_equals(read_data, RING_BUF_SIZE, orig_data, RING_BUF_SIZE)) {
+    return 5;
+  }
+  if (pictrl_rb_size(&pow2_ring_buffer) != 0) {
+    pictrl_log_error("Expected it to be empty. Size: %zu\n",
+                     pictrl_rb_size(&pow2_ring_buffer));
+    return 6;
+  }
+  return 0;
+}
+
+int test_pow2_get_and_copy() {
+  // Arrange: counters about to overflow, with data across the buffer's end
+  uint8_t orig_data[] = {10, 20, 30, 40, 50};
+  pow2_ring_buffer.tail = SIZE_MAX - 2;
+  pow2_ring_buffer.head = pow2_ring_buffer.tail + sizeof(orig_data);
+  for (size_t i = 0; i < sizeof(orig_data); i++) {
+    pow2_ring_buffer.buffer[(pow2_ring_buffer.tail + i) &
+                            pow2_ring_buffer.mask] = orig_data[i];
+  }
+
+  // Act
+  uint8_t got[sizeof(orig_data)];
+  for (size_t i = 0; i < sizeof(orig_data); i++) {
+    got[i] = pictrl_rb_get(&pow2_ring_buffer, i);
+  }
+  uint8_t copied[sizeof(orig_data)];
+  pictrl_rb_copy(&pow2_ring_buffer, copied);
+
+  // Assert
+  if (pictrl_rb_size(&pow2_ring_buffer) != sizeof(orig_data) ||
+      !pictrl_rb_data_wrapped(&pow2_ring_buffer)) {
+    pictrl_log_error("Size or wraparound is off\n");
+    return 1;
+  }
+  if (!array_equals(got, sizeof(got), orig_data, sizeof(orig_data))) {
+    return 2;
+  }
+  if (!array_equals(copied, sizeof(copied), orig_data, sizeof(orig_data))) {
+    return 3;
+  }
+  return 0;
+}
+
+static int test_mirrored_rejects_other_capacities() {
+  pictrl_rb_t rb;
+  const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t capacities[] = {0, RING_BUF_SIZE, page_size + 1, page_size * 3};
+  for (size_t i = 0; i < PICTRL_SIZE(capacities); i++) {
+    if (pictrl_rb_init_mirrored(&rb, capacities[i]) != NULL) {
+      pictrl_log_error("Accepted a capacity of %zu\n", capacities[i]);
+      pictrl_rb_destroy(&rb);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int test_mirrored_wraparound_is_contiguous() {
+  // Arrange: writes start 3 bytes from the end of the buffer
+  uint8_t orig_data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  if (write_to_test_file(orig_data, sizeof(orig_data)) < sizeof(orig_data)) {
+    return 1;
+  }
+  rewind(test_file);
+  pictrl_rb_t *rb = &mirrored_ring_buffer;
+  rb->head = rb->tail = rb->capacity - 3;
+
+  // Act: has to be all in one go, since it only gets one read()
+  const int test_fd = fileno(test_file);
+  if (pictrl_rb_write(test_fd, sizeof(orig_data), rb) !=
+      (ssize_t)sizeof(orig_data)) {
+    pictrl_log_error("Wrapped write took more than one read()\n");
+    return 2;
+  }
+
+  // Assert: in order from the start address, and aliased at the beginning
+  if (!pictrl_rb_data_wrapped(rb) ||
+      !array_equals(pictrl_rb_data_start_address(rb), sizeof(orig_data),
+                    orig_data, sizeof(orig_data))) {
+    pictrl_log_error("Data mismatch. Received: ");
+    print_buf(pictrl_rb_data_start_address(rb), sizeof(orig_data));
+    return 3;
+  }
+  if (!array_equals(rb->buffer, 5, orig_data + 3, 5)) {
+    pictrl_log_error("Second mapping doesn't alias the first\n");
+    return 4;
+  }
+
+  // And back out, in one write()
+  rewind(test_file);
+  if (ftruncate(test_fd, 0) < 0 ||
+      pictrl_rb_read(test_fd, sizeof(orig_data), rb, PICTRL_READ_CONSUME) !=
+          (ssize_t)sizeof(orig_data)) {
+    return 5;
+  }
+  rewind(test_file);
+  uint8_t read_data[sizeof(orig_data)] = {0};
+  if (read_from_test_file(read_data, sizeof(read_data)) < sizeof(read_data) ||
+      !array_equals(read_data, sizeof(read_data), orig_data,
+                    sizeof(orig_data))) {
+    return 6;
+  }
+  if (pictrl_rb_size(rb) != 0) {
+    pictrl_log_error("Expected it to be empty. Size: %zu\n",
+                     pictrl_rb_size(rb));
+    return 7;
+  }
+  return 0;
+}
+
 // These are surely not thread-safe
 static ssize_t rb_read_until_completion(int fd, size_t count, pictrl_rb_t *rb,
                                         pictrl_read_flag flag) {
-  const bool reading_more_than_avail = count > rb->num_items;
+  const bool reading_more_than_avail = count > pictrl_rb_size(rb);
 
   size_t bytes_read = 0;
   while (bytes_read < count) {
     const size_t bytes_left = count - bytes_read;
-    const bool no_data_left = rb->num_items <= bytes_left;
+    const bool no_data_left = pictrl_rb_size(rb) <= bytes_left;
     const ssize_t num_read = pictrl_rb_read(fd, bytes_left, rb, flag);
     if (num_read < 0) {
       int err = errno;
@@ -369,12 +655,13 @@ static ssize_t rb_read_until_completion(int fd, size_t count, pictrl_rb_t *rb,
 
 static ssize_t rb_write_until_completion(int fd, size_t count,
                                          pictrl_rb_t *rb) {
-  const bool inserting_more_than_avail = count > (rb->capacity - rb->num_items);
+  const bool inserting_more_than_avail =
+      count > (rb->capacity - pictrl_rb_size(rb));
 
   size_t bytes_written = 0;
   while (bytes_written < count) {
     const size_t bytes_left = count - bytes_written;
-    const bool is_rb_full = (rb->capacity - rb->num_items) <= bytes_left;
+    const bool is_rb_full = (rb->capacity - pictrl_rb_size(rb)) <= bytes_left;
 
     const ssize_t written = pictrl_rb_write(fd, bytes_left, rb);
     if (written < 0) {
@@ -0,0 +1,175 @@
+#include "data_structures/spsc_queue.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_init_rejects_non_pow2();
+static int test_fifo_order();
+static int test_full_queue();
+static int test_two_threads();
+
+#define QUEUE_LEN (size_t)8
+#define NUM_THREADED_ITEMS (uint64_t)100000
+
+// Fixtures
+static pictrl_spsc_queue_t queue;
+
+int before_each() {
+  if (pictrl_spsc_init(&queue, QUEUE_LEN, sizeof(uint64_t)) == NULL) {
+    pictrl_log_error("Could not initialize queue\n");
+    return -1;
+  }
+  return 0;
+}
+
+int after_each() {
+  pictrl_spsc_destroy(&queue);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Init rejects non power of 2 capacity",
+          .test_function = &test_init_rejects_non_pow2,
+      },
+      {
+          .test_name = "FIFO order",
+          .test_function = &test_fifo_order,
+      },
+      {
+          .test_name = "Full queue",
+          .test_function = &test_full_queue,
+      },
+      {
+          .test_name = "Producer and consumer threads",
+          .test_function = &test_two_threads,
+      }};
+
+  const TestSuite suite = {
+      .name = "SPSC queue tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+static int test_init_rejects_non_pow2() {
+  pictrl_spsc_queue_t bad_queue;
+  if (pictrl_spsc_init(&bad_queue, 6, sizeof(uint64_t)) != NULL) {
+    pictrl_log_error("Capacity of 6 should have been rejected\n");
+    pictrl_spsc_destroy(&bad_queue);
+    return 1;
+  }
+  if (pictrl_spsc_init(&bad_queue, 0, sizeof(uint64_t)) != NULL) {
+    pictrl_log_error("Capacity of 0 should have been rejected\n");
+    pictrl_spsc_destroy(&bad_queue);
+    return 2;
+  }
+  return 0;
+}
+
+static int test_fifo_order() {
+  // Go around the queue a few times so the indices wrap
+  for (uint64_t i = 0; i < QUEUE_LEN * 3; i++) {
+    uint64_t *slot = pictrl_spsc_claim(&queue);
+    if (slot == NULL) {
+      pictrl_log_error("Queue unexpectedly full at item %" PRIu64 "\n", i);
+      return 1;
+    }
+    *slot = i;
+    pictrl_spsc_publish(&queue);
+
+    const uint64_t *front = pictrl_spsc_front(&queue);
+    if (front == NULL || *front != i) {
+      pictrl_log_error("Expected item %" PRIu64 " at front of queue\n", i);
+      return 2;
+    }
+    pictrl_spsc_release(&queue);
+  }
+
+  if (!pictrl_spsc_empty(&queue) || pictrl_spsc_front(&queue) != NULL) {
+    pictrl_log_error("Expected queue to be empty\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_full_queue() {
+  for (uint64_t i = 0; i < QUEUE_LEN; i++) {
+    uint64_t *slot = pictrl_spsc_claim(&queue);
+    if (slot == NULL) {
+      pictrl_log_error("Queue unexpectedly full at item %" PRIu64 "\n", i);
+      return 1;
+    }
+    *slot = i;
+    pictrl_spsc_publish(&queue);
+  }
+
+  if (pictrl_spsc_claim(&queue) != NULL) {
+    pictrl_log_error("Claimed a slot from a full queue\n");
+    return 2;
+  }
+  if (pictrl_spsc_size(&queue) != QUEUE_LEN) {
+    pictrl_log_error("Expected size %zu, got %zu\n", QUEUE_LEN,
+                     pictrl_spsc_size(&queue));
+    return 3;
+  }
+
+  // Freeing up one slot should make exactly one claimable
+  pictrl_spsc_release(&queue);
+  if (pictrl_spsc_claim(&queue) == NULL) {
+    pictrl_log_error("Could not claim slot after releasing one\n");
+    return 4;
+  }
+  return 0;
+}
+
+static void *produce(void *arg) {
+  (void)arg;
+  for (uint64_t i = 0; i < NUM_THREADED_ITEMS; i++) {
+    uint64_t *slot;
+    while ((slot = pictrl_spsc_claim(&queue)) == NULL) {
+      sched_yield();  // In case we're sharing a core with the consumer
+    }
+    *slot = i;
+    pictrl_spsc_publish(&queue);
+  }
+  return NULL;
+}
+
+static int test_two_threads() {
+  pthread_t producer;
+  if (pthread_create(&producer, NULL, &produce, NULL) != 0) {
+    pictrl_log_error("Could not start producer thread\n");
+    return 1;
+  }
+
+  int ret = 0;
+  for (uint64_t expected = 0; expected < NUM_THREADED_ITEMS; expected++) {
+    const uint64_t *front;
+    while ((front = pictrl_spsc_front(&queue)) == NULL) {
+      sched_yield();
+    }
+    if (*front != expected && ret == 0) {
+      pictrl_log_error("Expected %" PRIu64 ", got %" PRIu64 "\n", expected,
+                       *front);
+      ret = 2;
+    }
+    pictrl_spsc_release(&queue);
+  }
+
+  pthread_join(producer, NULL);
+  return ret;
+}
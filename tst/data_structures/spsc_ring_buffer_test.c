@@ -0,0 +1,273 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np()
+#include "data_structures/spsc_ring_buffer.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+#include "pitest/api/assertions.h"
+#include "util.h"
+
+static int test_init_rejects_non_pow2();
+static int test_bytes_wrap_around();
+static int test_bulk_partial();
+static int test_peek();
+static int test_stress_two_cores();
+
+#define RING_BUF_SIZE (size_t)8
+// Small enough that both sides keep running into a full/empty buffer
+#define STRESS_RING_BUF_SIZE (size_t)64
+#define STRESS_BYTES ((size_t)1 << 22)
+
+// Fixtures
+static pictrl_spsc_rb_t ring_buffer;
+
+int before_each() {
+  if (pictrl_spsc_rb_init(&ring_buffer, RING_BUF_SIZE) == NULL) {
+    pictrl_log_error("Could not initialize ring buffer\n");
+    return -1;
+  }
+  return 0;
+}
+
+int after_each() {
+  pictrl_spsc_rb_destroy(&ring_buffer);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Init rejects non power of 2 capacity",
+          .test_function = &test_init_rejects_non_pow2,
+      },
+      {
+          .test_name = "Bytes wrap around",
+          .test_function = &test_bytes_wrap_around,
+      },
+      {
+          .test_name = "Bulk write takes what fits",
+          .test_function = &test_bulk_partial,
+      },
+      {
+          .test_name = "Peek leaves data in place",
+          .test_function = &test_peek,
+      },
+      {
+          .test_name = "Producer and consumer on different cores",
+          .test_function = &test_stress_two_cores,
+      }};
+
+  const TestSuite suite = {
+      .name = "SPSC ring buffer tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+static int test_init_rejects_non_pow2() {
+  pictrl_spsc_rb_t bad_rb;
+  if (pictrl_spsc_rb_init(&bad_rb, 6) != NULL) {
+    pictrl_log_error("Capacity of 6 should have been rejected\n");
+    pictrl_spsc_rb_destroy(&bad_rb);
+    return 1;
+  }
+  if (pictrl_spsc_rb_init(&bad_rb, 0) != NULL) {
+    pictrl_log_error("Capacity of 0 should have been rejected\n");
+    pictrl_spsc_rb_destroy(&bad_rb);
+    return 2;
+  }
+  return 0;
+}
+
+static int test_bytes_wrap_around() {
+  // Go around a few times, a couple of bytes behind
+  uint8_t next_pop = 0;
+  for (uint8_t i = 0; i < RING_BUF_SIZE * 3; i++) {
+    if (!pictrl_spsc_rb_push(&ring_buffer, i)) {
+      pictrl_log_error("Unexpectedly full at byte %u\n", i);
+      return 1;
+    }
+    uint8_t byte;
+    if (i >= 2 && (!pictrl_spsc_rb_pop(&ring_buffer, &byte) ||
+                   byte != next_pop++)) {
+      pictrl_log_error("Expected byte %u\n", next_pop - 1);
+      return 2;
+    }
+  }
+
+  for (uint8_t byte; pictrl_spsc_rb_pop(&ring_buffer, &byte); next_pop++) {
+    if (byte != next_pop) {
+      pictrl_log_error("Expected byte %u, got %u\n", next_pop, byte);
+      return 3;
+    }
+  }
+  if (next_pop != RING_BUF_SIZE * 3 ||
+      pictrl_spsc_rb_size(&ring_buffer) != 0) {
+    pictrl_log_error("Expected it to be empty\n");
+    return 4;
+  }
+  return 0;
+}
+
+static int test_bulk_partial() {
+  uint8_t data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+  // Start near the end of the buffer, so the write wraps
+  for (size_t i = 0; i < RING_BUF_SIZE - 3; i++) {
+    uint8_t byte;
+    pictrl_spsc_rb_push(&ring_buffer, 0);
+    pictrl_spsc_rb_pop(&ring_buffer, &byte);
+  }
+
+  const size_t written = pictrl_spsc_rb_write(&ring_buffer, data, sizeof(data));
+  if (written != RING_BUF_SIZE) {
+    pictrl_log_error("Expected to fill it up\n");
+    return 1;
+  }
+  if (pictrl_spsc_rb_write(&ring_buffer, data, sizeof(data)) != 0 ||
+      pictrl_spsc_rb_push(&ring_buffer, 0)) {
+    pictrl_log_error("Wrote to a full ring buffer\n");
+    return 2;
+  }
+
+  uint8_t read_data[sizeof(data)] = {0};
+  if (pictrl_spsc_rb_read(&ring_buffer, read_data, sizeof(read_data),
+                          PICTRL_READ_CONSUME) != RING_BUF_SIZE ||
+      !array_equals(read_data, RING_BUF_SIZE, data, RING_BUF_SIZE)) {
+    pictrl_log_error("Data mismatch\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_peek() {
+  uint8_t data[] = {4, 9, 5, 6, 1};
+  pictrl_spsc_rb_write(&ring_buffer, data, sizeof(data));
+
+  uint8_t peeked[sizeof(data)] = {0};
+  if (pictrl_spsc_rb_read(&ring_buffer, peeked, sizeof(peeked),
+                          PICTRL_READ_PEEK) != sizeof(data) ||
+      !array_equals(peeked, sizeof(peeked), data, sizeof(data))) {
+    return 1;
+  }
+  if (pictrl_spsc_rb_size(&ring_buffer) != sizeof(data)) {
+    pictrl_log_error("Peeking consumed data\n");
+    return 2;
+  }
+
+  uint8_t byte;
+  if (!pictrl_spsc_rb_pop(&ring_buffer, &byte) || byte != data[0]) {
+    return 3;
+  }
+  return 0;
+}
+
+// Byte `i` of the stream both sides agree on
+static inline uint8_t stress_byte(size_t i) {
+  return (uint8_t)(i ^ (i >> 8));
+}
+
+static pictrl_spsc_rb_t stress_rb;
+
+// Pins the calling thread to the `nth` CPU we're allowed on, if there is one
+static void pin_to_nth_cpu(int nth) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && nth-- == 0) {
+      cpu_set_t pinned;
+      CPU_ZERO(&pinned);
+      CPU_SET(cpu, &pinned);
+      pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+      return;
+    }
+  }
+}
+
+// Alternates between bulk writes of different sizes and single bytes
+static void *produce(void *arg) {
+  (void)arg;
+  pin_to_nth_cpu(1);
+  uint8_t chunk[STRESS_RING_BUF_SIZE];
+  size_t produced = 0;
+  for (size_t round = 0; produced < STRESS_BYTES; round++) {
+    size_t written;
+    if (round % 4 == 0) {
+      written = pictrl_spsc_rb_push(&stress_rb, stress_byte(produced));
+    } else {
+      size_t len = round % (STRESS_RING_BUF_SIZE - 1) + 1;
+      if (len > STRESS_BYTES - produced) {
+        len = STRESS_BYTES - produced;
+      }
+      for (size_t i = 0; i < len; i++) {
+        chunk[i] = stress_byte(produced + i);
+      }
+      written = pictrl_spsc_rb_write(&stress_rb, chunk, len);
+    }
+    if (written == 0) {
+      sched_yield();  // In case we're sharing a core with the consumer
+    }
+    produced += written;
+  }
+  return NULL;
+}
+
+static int test_stress_two_cores() {
+  if (pictrl_spsc_rb_init(&stress_rb, STRESS_RING_BUF_SIZE) == NULL) {
+    pictrl_log_error("Could not initialize ring buffer\n");
+    return 1;
+  }
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 &&
+      CPU_COUNT(&allowed) < 2) {
+    pictrl_log_warn("Only 1 CPU, so producer and consumer will share it\n");
+  }
+
+  pthread_t producer;
+  if (pthread_create(&producer, NULL, &produce, NULL) != 0) {
+    pictrl_log_error("Could not start producer thread\n");
+    pictrl_spsc_rb_destroy(&stress_rb);
+    return 1;
+  }
+  pin_to_nth_cpu(0);
+
+  int ret = 0;
+  uint8_t chunk[STRESS_RING_BUF_SIZE];
+  size_t consumed = 0;
+  // Keeps going after a mismatch, or the producer would never finish
+  for (size_t round = 0; consumed < STRESS_BYTES; round++) {
+    size_t len;
+    if (round % 3 == 0) {
+      len = pictrl_spsc_rb_pop(&stress_rb, chunk) ? 1 : 0;
+    } else {
+      len = pictrl_spsc_rb_read(&stress_rb, chunk, round % sizeof(chunk) + 1,
+                                PICTRL_READ_CONSUME);
+    }
+    for (size_t i = 0; i < len && ret == 0; i++) {
+      if (chunk[i] != stress_byte(consumed + i)) {
+        pictrl_log_error("Byte %zu: expected %u, got %u\n", consumed + i,
+                         stress_byte(consumed + i), chunk[i]);
+        ret = 2;
+      }
+    }
+    if (len == 0) {
+      sched_yield();
+    }
+    consumed += len;
+  }
+
+  pthread_join(producer, NULL);
+  pictrl_spsc_rb_destroy(&stress_rb);
+  return ret;
+}
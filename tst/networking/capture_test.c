@@ -0,0 +1,164 @@
+#include "networking/capture.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging/log_utils.h"
+#include "model/protocol.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_round_trip();
+static int test_truncated_record();
+static int test_rewind();
+static int test_rejects_garbage();
+
+// Fixtures
+static char path[] = "/tmp/picontrol_capture_test.XXXXXX";
+static pictrl_capture capture;
+static pictrl_capture_reader reader;
+
+static const uint8_t move[] = {PI_CTRL_MOUSE_MV, 2, 5, (uint8_t)-3};
+static const uint8_t text[] = {PI_CTRL_TEXT, 3, 'H', 'i', '!'};
+
+int before_each() {
+  strcpy(path + strlen(path) - 6, "XXXXXX");
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+  reader.data = NULL;
+  return 0;
+}
+
+int after_each() {
+  pictrl_capture_reader_close(&reader);
+  unlink(path);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Round trip",
+          .test_function = &test_round_trip,
+      },
+      {
+          .test_name = "Truncated record",
+          .test_function = &test_truncated_record,
+      },
+      {
+          .test_name = "Rewind",
+          .test_function = &test_rewind,
+      },
+      {
+          .test_name = "Rejects garbage",
+          .test_function = &test_rejects_garbage,
+      }};
+
+  const TestSuite suite = {
+      .name = "Capture tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = &after_each}};
+
+  return run_test_suite(&suite);
+}
+
+// Captures `move` 1ms after the start, then `text` 2.5ms after that
+static bool write_capture() {
+  if (pictrl_capture_open(&capture, path) == NULL) {
+    return false;
+  }
+  const uint64_t start = capture.last_usec;
+  pictrl_capture_write(&capture, move, sizeof(move), start + 1000);
+  pictrl_capture_write(&capture, text, sizeof(text), start + 3500);
+  pictrl_capture_close(&capture);
+  return true;
+}
+
+static bool message_equals(const pictrl_capture_message *msg,
+                           uint64_t offset_usec, const uint8_t *expected,
+                           size_t len) {
+  return msg->offset_usec == offset_usec && msg->len == len &&
+         memcmp(msg->data, expected, len) == 0;
+}
+
+static int test_round_trip() {
+  if (!write_capture() ||
+      pictrl_capture_reader_open(&reader, path) == NULL) {
+    return 1;
+  }
+
+  pictrl_capture_message msg;
+  if (!pictrl_capture_next(&reader, &msg) ||
+      !message_equals(&msg, 1000, move, sizeof(move))) {
+    pictrl_log_error("First message doesn't match\n");
+    return 2;
+  }
+  if (!pictrl_capture_next(&reader, &msg) ||
+      !message_equals(&msg, 3500, text, sizeof(text))) {
+    pictrl_log_error("Second message doesn't match\n");
+    return 3;
+  }
+  if (pictrl_capture_next(&reader, &msg)) {
+    pictrl_log_error("Read past the end\n");
+    return 4;
+  }
+  return 0;
+}
+
+static int test_truncated_record() {
+  if (!write_capture() || truncate(path, sizeof(pictrl_capture_header) +
+                                             PICTRL_CAPTURE_RECORD_HEADER_SIZE +
+                                             sizeof(move) + 3) != 0 ||
+      pictrl_capture_reader_open(&reader, path) == NULL) {
+    return 1;
+  }
+
+  pictrl_capture_message msg;
+  if (!pictrl_capture_next(&reader, &msg)) {
+    pictrl_log_error("Lost the whole first message\n");
+    return 2;
+  }
+  if (pictrl_capture_next(&reader, &msg)) {
+    pictrl_log_error("Read a message that was cut short\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_rewind() {
+  if (!write_capture() ||
+      pictrl_capture_reader_open(&reader, path) == NULL) {
+    return 1;
+  }
+
+  pictrl_capture_message msg;
+  while (pictrl_capture_next(&reader, &msg)) {
+  }
+  pictrl_capture_reader_rewind(&reader);
+  if (!pictrl_capture_next(&reader, &msg) ||
+      !message_equals(&msg, 1000, move, sizeof(move))) {
+    pictrl_log_error("Didn't start over from the first message\n");
+    return 2;
+  }
+  return 0;
+}
+
+static int test_rejects_garbage() {
+  FILE *file = fopen(path, "w");
+  fprintf(file, "not a capture, but long enough to be one");
+  fclose(file);
+
+  if (pictrl_capture_reader_open(&reader, path) != NULL) {
+    pictrl_log_error("Opened a file that isn't a capture\n");
+    return 1;
+  }
+  return 0;
+}
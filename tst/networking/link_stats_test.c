@@ -0,0 +1,199 @@
+#include "networking/link_stats.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "data_structures/histogram.h"
+#include "logging/log_utils.h"
+#include "model/protocol.h"
+#include "pitest/api.h"
+#include "util.h"
+
+static int test_in_order();
+static int test_lost_and_reordered();
+static int test_seq_wraps_around();
+static int test_delay_and_jitter();
+static int test_client_clock_wraps_around();
+static int test_delay_by_cmd();
+
+// Fixtures
+static pictrl_link_stats stats;
+
+// Our clock, in the middle of nowhere, so it's nothing like the client's
+#define RECV_START_USEC ((uint64_t)123456789012)
+
+int before_each() {
+  pictrl_link_stats_init(&stats);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "In order",
+          .test_function = &test_in_order,
+      },
+      {
+          .test_name = "Lost and reordered",
+          .test_function = &test_lost_and_reordered,
+      },
+      {
+          .test_name = "Sequence numbers wrap around",
+          .test_function = &test_seq_wraps_around,
+      },
+      {
+          .test_name = "Delay and jitter",
+          .test_function = &test_delay_and_jitter,
+      },
+      {
+          .test_name = "Client clock wraps around",
+          .test_function = &test_client_clock_wraps_around,
+      },
+      {
+          .test_name = "Delay by command",
+          .test_function = &test_delay_by_cmd,
+      }};
+
+  const TestSuite suite = {
+      .name = "Link stats tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = &before_each, .teardown = NULL}};
+
+  return run_test_suite(&suite);
+}
+
+// One message every 1ms, taking the same time to arrive
+static void record_steady(uint16_t seq, uint32_t i) {
+  pictrl_link_stats_record(&stats, PI_CTRL_MOUSE_MV, seq, 5000 + i * 1000,
+                           RECV_START_USEC + i * 1000);
+}
+
+static int test_in_order() {
+  for (uint16_t i = 0; i < 100; i++) {
+    record_steady(i, i);
+  }
+
+  if (stats.received != 100 || stats.lost != 0 || stats.reordered != 0) {
+    pictrl_log_error("Received %" PRIu64 ", lost %" PRIu64
+                     ", reordered %" PRIu64 "\n",
+                     stats.received, stats.lost, stats.reordered);
+    return 1;
+  }
+  if (stats.all.delay_usec.max != 0 || stats.all.jitter_usec != 0) {
+    pictrl_log_error("Max delay %" PRIu64 "us, jitter %.2fus\n",
+                     stats.all.delay_usec.max, stats.all.jitter_usec);
+    return 2;
+  }
+  return 0;
+}
+
+static int test_lost_and_reordered() {
+  // 3 and 4 go missing, 4 turns up late, and 7 never does
+  const uint16_t seqs[] = {0, 1, 2, 5, 6, 4, 8};
+  for (size_t i = 0; i < PICTRL_SIZE(seqs); i++) {
+    record_steady(seqs[i], i);
+  }
+
+  if (stats.received != PICTRL_SIZE(seqs) || stats.lost != 2 ||
+      stats.reordered != 1) {
+    pictrl_log_error("Received %" PRIu64 ", lost %" PRIu64
+                     ", reordered %" PRIu64 "\n",
+                     stats.received, stats.lost, stats.reordered);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_seq_wraps_around() {
+  uint16_t seq = UINT16_MAX - 2;
+  for (uint32_t i = 0; i < 6; i++) {
+    record_steady(seq++, i);
+  }
+
+  if (stats.lost != 0 || stats.reordered != 0) {
+    pictrl_log_error("Lost %" PRIu64 ", reordered %" PRIu64 "\n", stats.lost,
+                     stats.reordered);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_delay_and_jitter() {
+  // Every other message takes 2ms longer
+  for (uint16_t i = 0; i < 200; i++) {
+    const uint64_t extra_usec = (i % 2) ? 2000 : 0;
+    pictrl_link_stats_record(&stats, PI_CTRL_MOUSE_MV, i, 5000 + i * 1000,
+                             RECV_START_USEC + i * 1000 + extra_usec);
+  }
+
+  const uint64_t p99 = pictrl_histogram_percentile(&stats.all.delay_usec, 99);
+  if (stats.all.delay_usec.min != 0 || p99 < 1900 || p99 > 2100) {
+    pictrl_log_error("Delay min %" PRIu64 "us, p99 %" PRIu64 "us\n",
+                     stats.all.delay_usec.min, p99);
+    return 1;
+  }
+  // It converges on the 2ms it changes by every message
+  if (stats.all.jitter_usec < 1950 || stats.all.jitter_usec > 2000) {
+    pictrl_log_error("Jitter %.2fus, expected about 2000us\n",
+                     stats.all.jitter_usec);
+    return 2;
+  }
+  return 0;
+}
+
+static int test_client_clock_wraps_around() {
+  // Steady, but the client's 32 bit clock wraps half way through
+  const uint32_t send_start = UINT32_MAX - 4500;
+  for (uint16_t i = 0; i < 10; i++) {
+    pictrl_link_stats_record(&stats, PI_CTRL_MOUSE_MV, i, send_start + i * 1000,
+                             RECV_START_USEC + i * 1000);
+  }
+
+  if (stats.all.delay_usec.max != 0 || stats.all.jitter_usec != 0) {
+    pictrl_log_error("Max delay %" PRIu64 "us, jitter %.2fus\n",
+                     stats.all.delay_usec.max, stats.all.jitter_usec);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_delay_by_cmd() {
+  // Moves get through straight away, but every 10th message is a click that
+  // always takes 3ms longer
+  for (uint16_t i = 0; i < 200; i++) {
+    const bool click = i % 10 == 9;
+    pictrl_link_stats_record(&stats,
+                             click ? PI_CTRL_MOUSE_CLICK : PI_CTRL_MOUSE_MV, i,
+                             5000 + i * 1000,
+                             RECV_START_USEC + i * 1000 + (click ? 3000 : 0));
+  }
+
+  const pictrl_link_delay *moves = &stats.by_cmd[PI_CTRL_MOUSE_MV];
+  const pictrl_link_delay *clicks = &stats.by_cmd[PI_CTRL_MOUSE_CLICK];
+  if (moves->received != 180 || clicks->received != 20 ||
+      stats.all.received != 200) {
+    pictrl_log_error("Received %" PRIu64 " moves, %" PRIu64
+                     " clicks, %" PRIu64 " in all\n",
+                     moves->received, clicks->received, stats.all.received);
+    return 1;
+  }
+  if (moves->delay_usec.max != 0 || clicks->delay_usec.min < 2900 ||
+      clicks->delay_usec.max > 3100) {
+    pictrl_log_error("Max move delay %" PRIu64 "us, click delay %" PRIu64
+                     "-%" PRIu64 "us\n",
+                     moves->delay_usec.max, clicks->delay_usec.min,
+                     clicks->delay_usec.max);
+    return 2;
+  }
+  // Clicks are always as late as each other, it's only overall that varies
+  if (moves->jitter_usec != 0 || clicks->jitter_usec != 0 ||
+      stats.all.jitter_usec == 0) {
+    pictrl_log_error("Jitter: moves %.2fus, clicks %.2fus, overall %.2fus\n",
+                     moves->jitter_usec, clicks->jitter_usec,
+                     stats.all.jitter_usec);
+    return 3;
+  }
+  return 0;
+}
@@ -1,5 +1,15 @@
 #include "pitest/api.h"
 
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "logging/log_utils.h"
 
 int run_test(const TestCase *test_case) {
@@ -28,6 +38,87 @@ int run_teardown_if_exists(TeardownFunction teardown) {
   return teardown();
 }
 
+// Runs one case, with its setup and teardown. Returns whether it failed
+static bool run_test_case(const TestSuite *suite, size_t test_id) {
+  const SetupFunction case_setup = suite->before_after_each.setup;
+  int case_setup_ret = run_setup_if_exists(case_setup);
+  if (case_setup_ret != 0) {
+    pictrl_log_error(
+        "Setup for test case '%s' failed with code %d\n. Skipping...",
+        suite->test_cases[test_id].test_name, case_setup_ret);
+    return true;
+  }
+
+  bool test_failed = run_test(&suite->test_cases[test_id]) != 0;
+
+  const TeardownFunction case_teardown = suite->before_after_each.teardown;
+  int case_teardown_ret = run_teardown_if_exists(case_teardown);
+  if (case_teardown_ret != 0) {
+    pictrl_log_error("Teardown for test case '%s' failed with code %d\n",
+                     suite->test_cases[test_id].test_name, case_teardown_ret);
+    test_failed = true;
+  }
+  return test_failed;
+}
+
+static bool env_enabled(const char *name) {
+  const char *value = getenv(name);
+  return value != NULL &&
+         (strcmp(value, "1") == 0 || strcmp(value, "true") == 0);
+}
+
+/*
+Same as `run_test_case()`, but in a child process, so a case that crashes (or
+hangs past `timeout_secs`, if it's not 0) only fails itself. Anything the case
+changes in its fixtures is gone once it's done, though, so suites whose cases
+build on each other can't be run like this.
+*/
+static bool run_test_case_forked(const TestSuite *suite, size_t test_id,
+                                 unsigned int timeout_secs) {
+  // Or whatever's still buffered gets printed by both processes
+  fflush(NULL);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    pictrl_log_error("Could not fork for test case '%s': %s\n",
+                     suite->test_cases[test_id].test_name, strerror(errno));
+    return true;
+  }
+  if (pid == 0) {
+    // Get as much out as possible before a crash or timeout kills us
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    alarm(timeout_secs);  // Default action kills us
+    const bool failed = run_test_case(suite, test_id);
+    fflush(NULL);
+    _exit(failed ? 1 : 0);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      pictrl_log_error("Lost track of test case '%s': %s\n",
+                       suite->test_cases[test_id].test_name, strerror(errno));
+      return true;
+    }
+  }
+  if (WIFSIGNALED(status)) {
+    if (WTERMSIG(status) == SIGALRM) {
+      pictrl_log_error("%s test timed out after %us\n",
+                       suite->test_cases[test_id].test_name, timeout_secs);
+    } else {
+      pictrl_log_error("%s test crashed: %s\n",
+                       suite->test_cases[test_id].test_name,
+                       strsignal(WTERMSIG(status)));
+    }
+    return true;
+  }
+  return WEXITSTATUS(status) != 0;
+}
+
+/*
+Cases run one after the other in this process, unless PITEST_FORK is "1" or
+"true", in which case each gets its own (see `run_test_case_forked()`), with
+PITEST_TIMEOUT seconds to finish (no limit if unset or 0).
+*/
 size_t run_test_suite(const TestSuite *suite) {
   if (suite->num_tests == 0) {
     return 0;
@@ -42,32 +133,19 @@ size_t run_test_suite(const TestSuite *suite) {
     return 1;
   }
 
+  const bool fork_cases = env_enabled("PITEST_FORK");
+  const char *timeout_env = getenv("PITEST_TIMEOUT");
+  const unsigned int timeout_secs =
+      (timeout_env != NULL) ? strtoul(timeout_env, NULL, 10) : 0;
+
   size_t failed_test_count = 0;
   for (size_t test_id = 0; test_id < suite->num_tests; test_id++) {
-    const SetupFunction case_setup = suite->before_after_each.setup;
-    int case_setup_ret = run_setup_if_exists(case_setup);
-    if (case_setup_ret != 0) {
-      pictrl_log_error(
-          "Setup for test case '%s' failed with code %d\n. Skipping...",
-          suite->test_cases[test_id].test_name, case_setup_ret);
-      failed_test_count++;
-      continue;
-    }
-
-    bool test_failed = run_test(&suite->test_cases[test_id]) != 0;
-    if (test_failed) {
+    const bool failed = fork_cases
+                            ? run_test_case_forked(suite, test_id, timeout_secs)
+                            : run_test_case(suite, test_id);
+    if (failed) {
       failed_test_count++;
     }
-
-    const TeardownFunction case_teardown = suite->before_after_each.teardown;
-    int case_teardown_ret = run_teardown_if_exists(case_teardown);
-    if (case_teardown_ret != 0) {
-      pictrl_log_error("Teardown for test case '%s' failed with code %d\n",
-                       suite->test_cases[test_id].test_name, case_teardown_ret);
-      if (!test_failed) {
-        failed_test_count++;
-      }
-    }
   }
 
   const TestFunction suite_teardown = suite->before_after_all.teardown;
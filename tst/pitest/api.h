@@ -30,4 +30,6 @@ typedef struct {
 
 int run_test(const TestCase *);
 size_t run_test_suite(const TestSuite *);
+int run_setup_if_exists(SetupFunction);
+int run_teardown_if_exists(TeardownFunction);
 #endif
@@ -0,0 +1,309 @@
+#include "pitest/api/benchmark.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logging/log_utils.h"
+#include "pitest/api.h"
+
+// Never more than this many iterations per sample, however fast each one is
+// (and never more than a size_t holds, i.e. on 32-bit machines)
+#define MAX_ITERATIONS \
+  (((uint64_t)SIZE_MAX < ((uint64_t)1 << 32)) ? (uint64_t)SIZE_MAX \
+                                              : ((uint64_t)1 << 32))
+
+static uint64_t now_nsec() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t time_nsec(BenchmarkFunction bench_function, size_t iterations) {
+  const uint64_t start = now_nsec();
+  bench_function(iterations);
+  return now_nsec() - start;
+}
+
+// Finds how many iterations take about PITEST_BENCH_SAMPLE_NSEC. Worked out in
+// 64 bits, since `iterations * PITEST_BENCH_SAMPLE_NSEC` overflows a 32-bit
+// size_t long before it gets there
+static size_t calibrate(BenchmarkFunction bench_function) {
+  uint64_t iterations = 1;
+  uint64_t elapsed;
+  while ((elapsed = time_nsec(bench_function, iterations)) <
+             PITEST_BENCH_SAMPLE_NSEC &&
+         iterations < MAX_ITERATIONS) {
+    // Jump most of the way there once the timer has something to go on
+    iterations = (elapsed > PITEST_BENCH_SAMPLE_NSEC / 100)
+                     ? iterations * PITEST_BENCH_SAMPLE_NSEC / elapsed + 1
+                     : iterations * 10;
+    if (iterations > MAX_ITERATIONS) {
+      iterations = MAX_ITERATIONS;
+    }
+  }
+  return (size_t)iterations;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// `samples` must be sorted
+static double percentile(const double *samples, size_t num_samples,
+                         double pct) {
+  size_t rank = (size_t)ceil(pct / 100 * num_samples);
+  if (rank == 0) {
+    rank = 1;
+  }
+  return samples[rank - 1];
+}
+
+int run_benchmark(const BenchmarkCase *bench_case, BenchmarkResult *result) {
+  pictrl_log_test_case("%s\n", bench_case->bench_name);
+  const BenchmarkFunction bench_function = bench_case->bench_function;
+
+  const size_t iterations = calibrate(bench_function);
+  const uint64_t warmup_start = now_nsec();
+  while (now_nsec() - warmup_start < PITEST_BENCH_WARMUP_NSEC) {
+    bench_function(iterations);
+  }
+
+  double samples[PITEST_BENCH_SAMPLES];
+  double sum = 0;
+  for (size_t i = 0; i < PITEST_BENCH_SAMPLES; i++) {
+    samples[i] = (double)time_nsec(bench_function, iterations) / iterations;
+    sum += samples[i];
+  }
+  const double mean = sum / PITEST_BENCH_SAMPLES;
+  double squares = 0;
+  for (size_t i = 0; i < PITEST_BENCH_SAMPLES; i++) {
+    squares += (samples[i] - mean) * (samples[i] - mean);
+  }
+  qsort(samples, PITEST_BENCH_SAMPLES, sizeof(samples[0]), &compare_doubles);
+
+  *result = (BenchmarkResult){
+      .iterations = iterations,
+      .num_samples = PITEST_BENCH_SAMPLES,
+      .mean_ns = mean,
+      .stddev_ns = sqrt(squares / (PITEST_BENCH_SAMPLES - 1)),
+      .min_ns = samples[0],
+      .p50_ns = percentile(samples, PITEST_BENCH_SAMPLES, 50),
+      .p99_ns = percentile(samples, PITEST_BENCH_SAMPLES, 99),
+      .max_ns = samples[PITEST_BENCH_SAMPLES - 1],
+  };
+  pictrl_log_info(
+      "%s: %.2f ns/iteration (+/- %.2f), min %.2f, p50 %.2f, p99 %.2f, max "
+      "%.2f (%zu x %zu iterations)\n",
+      bench_case->bench_name, result->mean_ns, result->stddev_ns,
+      result->min_ns, result->p50_ns, result->p99_ns, result->max_ns,
+      result->num_samples, result->iterations);
+  return 0;
+}
+
+// "Ring buffer benchmarks" -> "$dir/ring_buffer_benchmarks.json"
+static void report_path(char *path, size_t size, const char *dir,
+                        const char *suite_name) {
+  int len = snprintf(path, size, "%s/", dir);
+  for (const char *c = suite_name; *c != '\0' && (size_t)len + 1 < size; c++) {
+    path[len++] = isalnum((unsigned char)*c) ? tolower((unsigned char)*c) : '_';
+  }
+  snprintf(path + len, size - len, ".json");
+}
+
+// Only escapes what could show up in a benchmark's name
+static void print_json_string(FILE *file, const char *str) {
+  fputc('"', file);
+  for (const char *c = str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+/*
+One benchmark per line, so `find_baseline()` (and grep) can get at them without
+a real JSON parser:
+
+  {"suite": "...", "benchmarks": [
+    {"name": "...", "iterations": 123, "samples": 50, "mean_ns": 1.23, ...},
+    ...
+  ]}
+*/
+static void write_report(const BenchmarkSuite *suite,
+                         const BenchmarkResult *results) {
+  const char *dir = getenv("PITEST_BENCH_DIR");
+  if (dir == NULL || *dir == '\0') {
+    return;
+  }
+  char path[4096];
+  report_path(path, sizeof(path), dir, suite->name);
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    pictrl_log_warn("Could not write benchmark report %s: %s\n", path,
+                    strerror(errno));
+    return;
+  }
+
+  fprintf(file, "{\"suite\": ");
+  print_json_string(file, suite->name);
+  fprintf(file, ", \"benchmarks\": [\n");
+  for (size_t i = 0; i < suite->num_benchmarks; i++) {
+    const BenchmarkResult *result = &results[i];
+    fprintf(file, "  {\"name\": ");
+    print_json_string(file, suite->bench_cases[i].bench_name);
+    fprintf(file,
+            ", \"iterations\": %zu, \"samples\": %zu, \"mean_ns\": %.3f, "
+            "\"stddev_ns\": %.3f, \"min_ns\": %.3f, \"p50_ns\": %.3f, "
+            "\"p99_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+            result->iterations, result->num_samples, result->mean_ns,
+            result->stddev_ns, result->min_ns, result->p50_ns, result->p99_ns,
+            result->max_ns, (i + 1 < suite->num_benchmarks) ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  fclose(file);
+  pictrl_log_info("Wrote benchmark report %s\n", path);
+}
+
+// The median time per iteration `bench_name` had in the baseline `report`, or
+// a negative number if it wasn't there
+static double find_baseline(FILE *report, const char *bench_name) {
+  char line[1024];
+  char name_field[512];
+  snprintf(name_field, sizeof(name_field), "{\"name\": \"%s\",", bench_name);
+
+  rewind(report);
+  while (fgets(line, sizeof(line), report) != NULL) {
+    const char *start = strstr(line, name_field);
+    const char *p50 = (start != NULL) ? strstr(start, "\"p50_ns\": ") : NULL;
+    if (p50 != NULL) {
+      return strtod(p50 + strlen("\"p50_ns\": "), NULL);
+    }
+  }
+  return -1;
+}
+
+// Returns how many benchmarks got slower than the baseline allows
+static size_t compare_to_baseline(const BenchmarkSuite *suite,
+                                  const BenchmarkResult *results) {
+  const char *dir = getenv("PITEST_BENCH_BASELINE");
+  if (dir == NULL || *dir == '\0') {
+    return 0;
+  }
+  const char *threshold_env = getenv("PITEST_BENCH_THRESHOLD");
+  const double threshold = (threshold_env != NULL)
+                               ? strtod(threshold_env, NULL)
+                               : PITEST_BENCH_DEFAULT_THRESHOLD;
+
+  char path[4096];
+  report_path(path, sizeof(path), dir, suite->name);
+  FILE *report = fopen(path, "r");
+  if (report == NULL) {
+    pictrl_log_warn("No baseline for suite '%s' (%s): %s\n", suite->name,
+                    path, strerror(errno));
+    return 0;
+  }
+
+  size_t regressions = 0;
+  for (size_t i = 0; i < suite->num_benchmarks; i++) {
+    const char *bench_name = suite->bench_cases[i].bench_name;
+    const double baseline = find_baseline(report, bench_name);
+    if (baseline <= 0) {
+      pictrl_log_warn("No baseline for '%s'\n", bench_name);
+      continue;
+    }
+
+    const double change = (results[i].p50_ns / baseline - 1) * 100;
+    if (change > threshold) {
+      pictrl_log_error("%s regressed: %.2f ns/iteration vs. %.2f (%+.1f%%, "
+                       "more than %.1f%%)\n",
+                       bench_name, results[i].p50_ns, baseline, change,
+                       threshold);
+      regressions++;
+    } else {
+      pictrl_log_info("%s: %+.1f%% vs. baseline\n", bench_name, change);
+    }
+  }
+  fclose(report);
+  return regressions;
+}
+
+size_t run_benchmark_suite(const BenchmarkSuite *suite) {
+  if (suite->num_benchmarks == 0) {
+    return 0;
+  }
+  pictrl_log_info("Running benchmark suite '%s'\n", suite->name);
+
+  int suite_setup_ret = run_setup_if_exists(suite->before_after_all.setup);
+  if (suite_setup_ret != 0) {
+    pictrl_log_error("Setup for suite '%s' failed with code %d\n", suite->name,
+                     suite_setup_ret);
+    return 1;
+  }
+
+  BenchmarkResult *results =
+      calloc(suite->num_benchmarks, sizeof(BenchmarkResult));
+  if (results == NULL) {
+    pictrl_log_error("Could not allocate benchmark results\n");
+    run_teardown_if_exists(suite->before_after_all.teardown);
+    return 1;
+  }
+
+  size_t failed_count = 0;
+  for (size_t i = 0; i < suite->num_benchmarks; i++) {
+    const BenchmarkCase *bench_case = &suite->bench_cases[i];
+    int case_setup_ret = run_setup_if_exists(suite->before_after_each.setup);
+    if (case_setup_ret != 0) {
+      pictrl_log_error("Setup for benchmark '%s' failed with code %d. "
+                       "Skipping...\n",
+                       bench_case->bench_name, case_setup_ret);
+      failed_count++;
+      continue;
+    }
+
+    bool failed = run_benchmark(bench_case, &results[i]) != 0;
+
+    int case_teardown_ret =
+        run_teardown_if_exists(suite->before_after_each.teardown);
+    if (case_teardown_ret != 0) {
+      pictrl_log_error("Teardown for benchmark '%s' failed with code %d\n",
+                       bench_case->bench_name, case_teardown_ret);
+      failed = true;
+    }
+    if (failed) {
+      failed_count++;
+    }
+  }
+
+  int suite_teardown_ret =
+      run_teardown_if_exists(suite->before_after_all.teardown);
+  if (suite_teardown_ret != 0) {
+    pictrl_log_error("Teardown for suite '%s' failed with code %d\n",
+                     suite->name, suite_teardown_ret);
+    failed_count++;
+  }
+
+  // Half measured suites would make a misleading report (or baseline)
+  if (failed_count == 0) {
+    write_report(suite, results);
+    failed_count += compare_to_baseline(suite, results);
+  }
+  free(results);
+
+  if (failed_count > 0) {
+    pictrl_log_error("Benchmark suite '%s' failed!\n", suite->name);
+    return failed_count;
+  }
+  pictrl_log_info("Benchmark suite '%s' passed!\n", suite->name);
+  return 0;
+}
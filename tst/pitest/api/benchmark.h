@@ -0,0 +1,70 @@
+#ifndef _PITEST_API_BENCHMARK_H
+#define _PITEST_API_BENCHMARK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pitest/api.h"
+
+/*
+How long each benchmark runs before anything is measured (to fault in memory,
+warm the caches and wake the CPU up), how long each timed sample should take
+(iterations per sample get calibrated to hit it), and how many samples there
+are. In nanoseconds, except the number of samples.
+*/
+#define PITEST_BENCH_WARMUP_NSEC 20000000  // 20ms
+#define PITEST_BENCH_SAMPLE_NSEC 1000000   // 1ms
+#define PITEST_BENCH_SAMPLES 50
+
+/*
+Environment variables:
+  PITEST_BENCH_DIR        Where to write each suite's JSON report. Unset for
+                          no report
+  PITEST_BENCH_BASELINE   Where the reports to compare against are (i.e. a
+                          copy of an earlier PITEST_BENCH_DIR). Unset to not
+                          compare
+  PITEST_BENCH_THRESHOLD  How much slower (in %, median time per iteration) a
+                          benchmark can get than its baseline before it fails.
+                          Defaults to PITEST_BENCH_DEFAULT_THRESHOLD
+*/
+#define PITEST_BENCH_DEFAULT_THRESHOLD 10.0
+
+// Runs whatever's being measured `iterations` times in a row
+typedef void (*BenchmarkFunction)(size_t iterations);
+
+typedef struct {
+  const char *bench_name;
+  const BenchmarkFunction bench_function;
+} BenchmarkCase;
+
+typedef struct {
+  const char *name;
+  const BenchmarkCase *bench_cases;
+  const size_t num_benchmarks;
+  const SetupTeardown before_after_all;
+  const SetupTeardown before_after_each;
+} BenchmarkSuite;
+
+// All times are per iteration
+typedef struct {
+  size_t iterations;  // Per sample
+  size_t num_samples;
+  double mean_ns;
+  double stddev_ns;
+  double min_ns;
+  double p50_ns;
+  double p99_ns;
+  double max_ns;
+} BenchmarkResult;
+
+int run_benchmark(const BenchmarkCase *, BenchmarkResult *);
+size_t run_benchmark_suite(const BenchmarkSuite *);
+
+// Static "methods"
+
+// Makes the compiler assume `ptr` (and whatever it points at) gets used, so the
+// work that produced it doesn't get optimized out of a benchmark
+static inline void pitest_keep(const void *ptr) {
+  __asm__ volatile("" : : "g"(ptr) : "memory");
+}
+#endif
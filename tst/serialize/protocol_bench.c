@@ -0,0 +1,52 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "model/protocol.h"
+#include "pitest/api.h"
+#include "pitest/api/benchmark.h"
+#include "serialize/protocol.h"
+#include "util.h"
+
+static void bench_parse_mouse_move(size_t iterations);
+static void bench_parse_text(size_t iterations);
+
+static uint8_t move[] = {PI_CTRL_MOUSE_MV, 2, 5, (uint8_t)-3};
+static uint8_t text[] = {PI_CTRL_TEXT, 12, 'H', 'e', 'l', 'l',
+                         'o', ',', ' ', 'w', 'o', 'r', 'l', 'd'};
+
+int main() {
+  const BenchmarkCase bench_cases[] = {
+      {
+          .bench_name = "Parse mouse move",
+          .bench_function = &bench_parse_mouse_move,
+      },
+      {
+          .bench_name = "Parse text",
+          .bench_function = &bench_parse_text,
+      }};
+
+  const BenchmarkSuite suite = {
+      .name = "Protocol benchmarks",
+      .bench_cases = bench_cases,
+      .num_benchmarks = PICTRL_SIZE(bench_cases),
+      .before_after_all = {.setup = NULL, .teardown = NULL},
+      .before_after_each = {.setup = NULL, .teardown = NULL}};
+
+  return run_benchmark_suite(&suite);
+}
+
+static void bench_parse(uint8_t *msg, size_t len, size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) {
+    pitest_keep(msg);  // Or it only gets parsed once
+    RawPiCtrlMessage parsed = parse_to_pictrl_msg(msg, len);
+    pitest_keep(&parsed);
+  }
+}
+
+static void bench_parse_mouse_move(size_t iterations) {
+  bench_parse(move, sizeof(move), iterations);
+}
+
+static void bench_parse_text(size_t iterations) {
+  bench_parse(text, sizeof(text), iterations);
+}
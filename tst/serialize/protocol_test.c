@@ -0,0 +1,684 @@
+#include "serialize/protocol.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "data_structures/ring_buffer.h"
+#include "logging/log_utils.h"
+#include "model/protocol.h"
+#include "pitest/api.h"
+#include "pitest/api/assertions.h"
+#include "serialize/batch.h"
+#include "serialize/utf8.h"
+#include "util.h"
+
+static int test_partial_message();
+static int test_drain_back_to_back();
+static int test_wrapped_message_copied();
+static int test_mirrored_wrapped_message_in_place();
+static int test_split_and_packed_chunks();
+static int test_batch_records();
+static int test_batch_truncated_record();
+static int test_batch_hello_record();
+static int test_extended_header();
+static int test_hello_round_trip();
+static int test_hello_v1_unchecked();
+static int test_hello_caps_enforced();
+static int test_hello_max_payload_enforced();
+static int test_hello_batch_records_checked();
+static int test_utf8_valid();
+static int test_utf8_malformed();
+
+#define RING_BUF_SIZE (size_t)16
+
+// Fixtures
+static int pipe_fds[2] = {-1, -1};
+static pictrl_rb_t ring_buffer;
+static pictrl_rb_t mirrored_ring_buffer;
+static uint8_t scratch[PICTRL_MAX_MSG_LEN];
+
+static uint8_t move[] = {PI_CTRL_MOUSE_MV, 2, 5, (uint8_t)-3};
+static uint8_t text[] = {PI_CTRL_TEXT, 3, 'H', 'i', '!'};
+static uint8_t heartbeat[] = {PI_CTRL_HEARTBEAT, 0};
+
+int before_all() {
+  if (pipe(pipe_fds) < 0) {
+    pictrl_log_error("Could not create pipe: %s\n", strerror(errno));
+    return -1;
+  }
+  if (pictrl_rb_init(&ring_buffer, RING_BUF_SIZE) == NULL ||
+      pictrl_rb_init_mirrored(&mirrored_ring_buffer,
+                              (size_t)sysconf(_SC_PAGESIZE)) == NULL) {
+    pictrl_log_error("Could not initialize ring buffers\n");
+    return -1;
+  }
+  return 0;
+}
+
+int before_each() {
+  pictrl_rb_clear(&ring_buffer);
+  pictrl_rb_clear(&mirrored_ring_buffer);
+  return 0;
+}
+
+int after_all() {
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  pictrl_rb_destroy(&ring_buffer);
+  pictrl_rb_destroy(&mirrored_ring_buffer);
+  return 0;
+}
+
+int main() {
+  const TestCase test_cases[] = {
+      {
+          .test_name = "Partial message isn't a message",
+          .test_function = &test_partial_message,
+      },
+      {
+          .test_name = "Drain messages back to back",
+          .test_function = &test_drain_back_to_back,
+      },
+      {
+          .test_name = "Wrapped message gets copied",
+          .test_function = &test_wrapped_message_copied,
+      },
+      {
+          .test_name = "Mirrored: wrapped message stays in place",
+          .test_function = &test_mirrored_wrapped_message_in_place,
+      },
+      {
+          .test_name = "Messages split and packed across chunks",
+          .test_function = &test_split_and_packed_chunks,
+      },
+      {
+          .test_name = "Batch records",
+          .test_function = &test_batch_records,
+      },
+      {
+          .test_name = "Batch with a truncated record",
+          .test_function = &test_batch_truncated_record,
+      },
+      {
+          .test_name = "Batch with a hello in it",
+          .test_function = &test_batch_hello_record,
+      },
+      {
+          .test_name = "Extended header",
+          .test_function = &test_extended_header,
+      },
+      {
+          .test_name = "Hello round trip",
+          .test_function = &test_hello_round_trip,
+      },
+      {
+          .test_name = "Hello: v1 clients aren't checked",
+          .test_function = &test_hello_v1_unchecked,
+      },
+      {
+          .test_name = "Hello: capabilities not agreed on are rejected",
+          .test_function = &test_hello_caps_enforced,
+      },
+      {
+          .test_name = "Hello: payloads over the limit are rejected",
+          .test_function = &test_hello_max_payload_enforced,
+      },
+      {
+          .test_name = "Hello: records in a batch are checked too",
+          .test_function = &test_hello_batch_records_checked,
+      },
+      {
+          .test_name = "UTF-8: valid sequences",
+          .test_function = &test_utf8_valid,
+      },
+      {
+          .test_name = "UTF-8: malformed sequences",
+          .test_function = &test_utf8_malformed,
+      }};
+
+  const TestSuite suite = {
+      .name = "Protocol tests",
+      .test_cases = test_cases,
+      .num_tests = PICTRL_SIZE(test_cases),
+      .before_after_all = {.setup = &before_all, .teardown = &after_all},
+      .before_after_each = {.setup = &before_each, .teardown = NULL}};
+
+  return run_test_suite(&suite);
+}
+
+// Appends `data` to `rb`, the way it would come in off a socket
+static bool receive(pictrl_rb_t *rb, const uint8_t *data, size_t len) {
+  return write(pipe_fds[1], data, len) == (ssize_t)len &&
+         pictrl_rb_write(pipe_fds[0], len, rb) == (ssize_t)len;
+}
+
+// Whether `msg` is the same message as the `len` bytes in `expected`
+static bool msg_equals(const RawPiCtrlMessage *msg, uint8_t *expected,
+                       size_t len) {
+  return msg->header.cmd == expected[0] &&
+         msg->header.payload_size == expected[1] &&
+         array_equals(msg->payload, msg->header.payload_size, expected + 2,
+                      len - 2);
+}
+
+static bool points_into(const pictrl_rb_t *rb, const uint8_t *ptr) {
+  return ptr >= rb->buffer && ptr < rb->buffer + rb->capacity;
+}
+
+static int test_partial_message() {
+  RawPiCtrlMessage msg;
+  if (!receive(&ring_buffer, text, 1) || pictrl_rb_msg_len(&ring_buffer) != 0) {
+    pictrl_log_error("Half a header counted as a message\n");
+    return 1;
+  }
+  if (!receive(&ring_buffer, text + 1, 3) ||
+      pictrl_rb_peek_msg(&ring_buffer, &msg, scratch) != 0 ||
+      pictrl_rb_consume_msg(&ring_buffer) != 0) {
+    pictrl_log_error("Missing the end of the payload, but got a message\n");
+    return 2;
+  }
+
+  if (!receive(&ring_buffer, text + 4, 1) ||
+      pictrl_rb_peek_msg(&ring_buffer, &msg, scratch) != sizeof(text) ||
+      !msg_equals(&msg, text, sizeof(text))) {
+    pictrl_log_error("Didn't get the message once it was all there\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_drain_back_to_back() {
+  // Arrange
+  uint8_t *expected[] = {move, heartbeat, text};
+  const size_t lens[] = {sizeof(move), sizeof(heartbeat), sizeof(text)};
+  for (size_t i = 0; i < PICTRL_SIZE(expected); i++) {
+    if (!receive(&ring_buffer, expected[i], lens[i])) {
+      return 1;
+    }
+  }
+
+  // Act/Assert
+  RawPiCtrlMessage msg;
+  size_t num_msgs = 0;
+  size_t msg_len;
+  while ((msg_len = pictrl_rb_peek_msg(&ring_buffer, &msg, scratch)) > 0) {
+    if (num_msgs >= PICTRL_SIZE(expected) || msg_len != lens[num_msgs] ||
+        !msg_equals(&msg, expected[num_msgs], lens[num_msgs])) {
+      pictrl_log_error("Message %zu doesn't match\n", num_msgs);
+      return 2;
+    }
+    if (msg.header.payload_size > 0 &&
+        !points_into(&ring_buffer, msg.payload)) {
+      pictrl_log_error("Message %zu got copied\n", num_msgs);
+      return 3;
+    }
+    if (pictrl_rb_consume_msg(&ring_buffer) != msg_len) {
+      return 4;
+    }
+    num_msgs++;
+  }
+
+  if (num_msgs != PICTRL_SIZE(expected) || pictrl_rb_size(&ring_buffer) != 0) {
+    pictrl_log_error("Drained %zu messages, %zu bytes left\n", num_msgs,
+                     pictrl_rb_size(&ring_buffer));
+    return 5;
+  }
+  return 0;
+}
+
+static int test_wrapped_message_copied() {
+  // Arrange: the payload starts right at the end of the buffer
+  ring_buffer.data_start = RING_BUF_SIZE - 3;
+  if (!receive(&ring_buffer, text, sizeof(text))) {
+    return 1;
+  }
+
+  // Act
+  RawPiCtrlMessage msg;
+  const size_t msg_len = pictrl_rb_peek_msg(&ring_buffer, &msg, scratch);
+
+  // Assert
+  if (msg_len != sizeof(text) || !msg_equals(&msg, text, sizeof(text))) {
+    pictrl_log_error("Message doesn't match\n");
+    return 2;
+  }
+  if (msg.payload != scratch + sizeof(RawPictrlHeader)) {
+    pictrl_log_error("Payload should've been copied into scratch\n");
+    return 3;
+  }
+  if (pictrl_rb_consume_msg(&ring_buffer) != msg_len ||
+      pictrl_rb_size(&ring_buffer) != 0) {
+    return 4;
+  }
+  return 0;
+}
+
+static int test_mirrored_wrapped_message_in_place() {
+  // Arrange: same as above, but with the other copy of the pages after it
+  pictrl_rb_t *rb = &mirrored_ring_buffer;
+  rb->head = rb->tail = rb->capacity - 3;
+  if (!receive(rb, text, sizeof(text))) {
+    return 1;
+  }
+
+  // Act
+  RawPiCtrlMessage msg;
+  const size_t msg_len = pictrl_rb_peek_msg(rb, &msg, scratch);
+
+  // Assert
+  if (msg_len != sizeof(text) || !msg_equals(&msg, text, sizeof(text))) {
+    pictrl_log_error("Message doesn't match\n");
+    return 2;
+  }
+  if (msg.payload != pictrl_rb_data_start_address(rb) + 2) {
+    pictrl_log_error("Payload should've been read in place\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_split_and_packed_chunks() {
+  // Arrange: move, text, heartbeat, move, chopped up like a frame might be
+  uint8_t stream[2 * sizeof(move) + sizeof(text) + sizeof(heartbeat)];
+  uint8_t *expected[] = {move, text, heartbeat, move};
+  const size_t lens[] = {sizeof(move), sizeof(text), sizeof(heartbeat),
+                         sizeof(move)};
+  size_t stream_len = 0;
+  for (size_t i = 0; i < PICTRL_SIZE(expected); i++) {
+    memcpy(stream + stream_len, expected[i], lens[i]);
+    stream_len += lens[i];
+  }
+  const size_t chunk_lens[] = {1, 6, 2, 6};
+
+  // Act: append each chunk, then drain whatever's whole, like the server does
+  size_t offset = 0;
+  size_t num_msgs = 0;
+  for (size_t i = 0; i < PICTRL_SIZE(chunk_lens); i++) {
+    pictrl_rb_append(&ring_buffer, stream + offset, chunk_lens[i]);
+    offset += chunk_lens[i];
+
+    RawPiCtrlMessage msg;
+    size_t msg_len;
+    while ((msg_len = pictrl_rb_peek_msg(&ring_buffer, &msg, scratch)) > 0) {
+      // Assert
+      if (num_msgs >= PICTRL_SIZE(expected) ||
+          !msg_equals(&msg, expected[num_msgs], lens[num_msgs])) {
+        pictrl_log_error("Message %zu doesn't match\n", num_msgs);
+        return 1;
+      }
+      pictrl_rb_consume_msg(&ring_buffer);
+      num_msgs++;
+    }
+  }
+
+  if (offset != stream_len || num_msgs != PICTRL_SIZE(expected) ||
+      pictrl_rb_size(&ring_buffer) != 0) {
+    pictrl_log_error("Got %zu messages, %zu bytes left\n", num_msgs,
+                     pictrl_rb_size(&ring_buffer));
+    return 2;
+  }
+  return 0;
+}
+
+static int test_batch_records() {
+  // Arrange: a batch of move, heartbeat, text, as it'd come off the wire
+  uint8_t batch_msg[] = {PI_CTRL_BATCH, 11, PI_CTRL_MOUSE_MV, 2, 5,
+                         (uint8_t)-3, PI_CTRL_HEARTBEAT, 0, PI_CTRL_TEXT,
+                         3, 'H', 'i', '!'};
+  uint8_t *expected[] = {move, heartbeat, text};
+  const size_t lens[] = {sizeof(move), sizeof(heartbeat), sizeof(text)};
+  const RawPiCtrlMessage batch =
+      parse_to_pictrl_msg(batch_msg, sizeof(batch_msg));
+
+  // Act/Assert
+  RawPiCtrlMessage record;
+  size_t offset = 0;
+  size_t num_records = 0;
+  while (pictrl_batch_next(&batch, &offset, &record)) {
+    if (num_records >= PICTRL_SIZE(expected) ||
+        !msg_equals(&record, expected[num_records], lens[num_records])) {
+      pictrl_log_error("Record %zu doesn't match\n", num_records);
+      return 1;
+    }
+    num_records++;
+  }
+  if (num_records != PICTRL_SIZE(expected) ||
+      offset != batch.header.payload_size) {
+    pictrl_log_error("Got %zu records, stopped at offset %zu\n", num_records,
+                     offset);
+    return 2;
+  }
+  return 0;
+}
+
+static int test_batch_truncated_record() {
+  // Arrange: the text record says 3 bytes, but the batch ends after 2
+  uint8_t batch_msg[] = {PI_CTRL_BATCH, 8, PI_CTRL_MOUSE_MV, 2, 5,
+                         (uint8_t)-3, PI_CTRL_TEXT, 3, 'H', 'i'};
+  const RawPiCtrlMessage batch =
+      parse_to_pictrl_msg(batch_msg, sizeof(batch_msg));
+
+  // Act
+  RawPiCtrlMessage record;
+  size_t offset = 0;
+  size_t num_records = 0;
+  while (pictrl_batch_next(&batch, &offset, &record)) {
+    num_records++;
+  }
+
+  // Assert: only the move made it
+  if (num_records != 1 || record.header.cmd != PI_CTRL_MOUSE_MV) {
+    pictrl_log_error("Got %zu records\n", num_records);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_batch_hello_record() {
+  // Arrange: a hello between two moves
+  uint8_t batch_msg[] = {PI_CTRL_BATCH, 13, PI_CTRL_MOUSE_MV, 2, 5,
+                         (uint8_t)-3, PI_CTRL_HELLO, 3, PICTRL_PROTOCOL_VERSION,
+                         0, UINT8_MAX, PI_CTRL_MOUSE_MV, 2, 5, (uint8_t)-3};
+  const RawPiCtrlMessage batch =
+      parse_to_pictrl_msg(batch_msg, sizeof(batch_msg));
+
+  // Act
+  RawPiCtrlMessage record;
+  size_t offset = 0;
+  size_t num_records = 0;
+  while (pictrl_batch_next(&batch, &offset, &record)) {
+    num_records++;
+  }
+
+  // Assert: the batch ends at the hello, instead of handing it on
+  if (num_records != 1 || record.header.cmd != PI_CTRL_MOUSE_MV) {
+    pictrl_log_error("Got %zu records\n", num_records);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_extended_header() {
+  // Arrange: an extended move, with its last byte still to come
+  uint8_t ext_move[] = {PI_CTRL_MOUSE_MV | PICTRL_CMD_EXTENDED, 2, 0x12, 0x34,
+                        0xDE, 0xAD, 0xBE, 0xEF, 5, (uint8_t)-3};
+  if (!receive(&ring_buffer, ext_move, sizeof(ext_move) - 1) ||
+      pictrl_rb_msg_len(&ring_buffer) != 0) {
+    pictrl_log_error("Counted the extended header as payload\n");
+    return 1;
+  }
+  if (!receive(&ring_buffer, ext_move + sizeof(ext_move) - 1, 1)) {
+    return 2;
+  }
+
+  // Act
+  RawPiCtrlMessage msg;
+  const size_t msg_len = pictrl_rb_peek_msg(&ring_buffer, &msg, scratch);
+
+  // Assert: same as the regular move, plus the extended header
+  if (msg_len != sizeof(ext_move) || !msg_equals(&msg, move, sizeof(move))) {
+    pictrl_log_error("Message doesn't match\n");
+    return 3;
+  }
+  if (!msg.extended || msg.ext.seq != 0x1234 ||
+      msg.ext.send_usec != 0xDEADBEEF) {
+    pictrl_log_error("Extended header: %d, seq %x, send_usec %x\n",
+                     msg.extended, msg.ext.seq, msg.ext.send_usec);
+    return 4;
+  }
+
+  // And a regular message isn't extended
+  const RawPiCtrlMessage regular = parse_to_pictrl_msg(move, sizeof(move));
+  if (regular.extended) {
+    return 5;
+  }
+  return 0;
+}
+
+static int test_hello_round_trip() {
+  // Arrange
+  const PiCtrlHello hello = {.version = PICTRL_PROTOCOL_VERSION,
+                             .caps = PICTRL_CAP_BATCH | PICTRL_CAP_EXT_HEADER,
+                             .max_payload = 200,
+                             .backend = "uinput",
+                             .backend_len = 6};
+  uint8_t out[PICTRL_MAX_MSG_LEN];
+
+  // Act
+  const size_t len = pictrl_build_hello(&hello, out, sizeof(out));
+  const RawPiCtrlMessage msg = parse_to_pictrl_msg(out, len);
+  PiCtrlHello parsed;
+
+  // Assert
+  if (msg.header.cmd != PI_CTRL_HELLO || !pictrl_parse_hello(&msg, &parsed)) {
+    pictrl_log_error("Couldn't parse a hello back\n");
+    return 1;
+  }
+  if (parsed.version != hello.version || parsed.caps != hello.caps ||
+      parsed.max_payload != hello.max_payload ||
+      parsed.backend_len != hello.backend_len ||
+      memcmp(parsed.backend, hello.backend, hello.backend_len) != 0) {
+    pictrl_log_error("Hello doesn't match: v%d, caps 0x%02x, max %d, %.*s\n",
+                     parsed.version, parsed.caps, parsed.max_payload,
+                     (int)parsed.backend_len, parsed.backend);
+    return 2;
+  }
+
+  // Too short to be a hello
+  const RawPiCtrlMessage short_msg =
+      parse_to_pictrl_msg(heartbeat, sizeof(heartbeat));
+  if (pictrl_parse_hello(&short_msg, &parsed)) {
+    return 3;
+  }
+  return 0;
+}
+
+// Messages that each need one capability
+static uint8_t hires_move[] = {PI_CTRL_MOUSE_MV_HIRES, 4, 0, 8, 0, 8};
+static uint8_t ext_heartbeat[] = {PI_CTRL_HEARTBEAT | PICTRL_CMD_EXTENDED,
+                                  0, 0, 1, 0, 0, 0, 0};
+static uint8_t batch_of_moves[] = {PI_CTRL_BATCH, 8, PI_CTRL_MOUSE_MV, 2, 5,
+                                   (uint8_t)-3, PI_CTRL_MOUSE_MV, 2, 5,
+                                   (uint8_t)-3};
+
+static bool allows(const PiCtrlHello *hello, uint8_t *raw, size_t len) {
+  const RawPiCtrlMessage msg = parse_to_pictrl_msg(raw, len);
+  return pictrl_hello_allows(hello, &msg);
+}
+
+static int test_hello_v1_unchecked() {
+  // Arrange: never said hello
+  const PiCtrlHello v1 = {0};
+
+  // Act/Assert
+  if (!allows(&v1, move, sizeof(move)) ||
+      !allows(&v1, hires_move, sizeof(hires_move)) ||
+      !allows(&v1, ext_heartbeat, sizeof(ext_heartbeat)) ||
+      !allows(&v1, batch_of_moves, sizeof(batch_of_moves))) {
+    pictrl_log_error("Rejected a message from a v1 client\n");
+    return 1;
+  }
+  return 0;
+}
+
+static int test_hello_caps_enforced() {
+  // Arrange: everything but high resolution moves
+  const PiCtrlHello hello = {
+      .version = PICTRL_PROTOCOL_VERSION,
+      .caps = PICTRL_CAP_BATCH | PICTRL_CAP_EXT_HEADER,
+      .max_payload = UINT8_MAX};
+  const PiCtrlHello none = {.version = PICTRL_PROTOCOL_VERSION,
+                            .max_payload = UINT8_MAX};
+
+  // Act/Assert
+  if (!allows(&hello, move, sizeof(move)) ||
+      !allows(&hello, ext_heartbeat, sizeof(ext_heartbeat)) ||
+      !allows(&hello, batch_of_moves, sizeof(batch_of_moves))) {
+    pictrl_log_error("Rejected something that was agreed on\n");
+    return 1;
+  }
+  if (allows(&hello, hires_move, sizeof(hires_move))) {
+    pictrl_log_error("Allowed a high resolution move\n");
+    return 2;
+  }
+  if (!allows(&none, move, sizeof(move)) ||
+      allows(&none, ext_heartbeat, sizeof(ext_heartbeat)) ||
+      allows(&none, batch_of_moves, sizeof(batch_of_moves))) {
+    pictrl_log_error("Agreeing on nothing should only allow v1 commands\n");
+    return 3;
+  }
+  return 0;
+}
+
+static int test_hello_max_payload_enforced() {
+  // Arrange: payloads up to 2 bytes
+  const PiCtrlHello hello = {.version = PICTRL_PROTOCOL_VERSION,
+                             .max_payload = 2};
+
+  // Act/Assert
+  if (!allows(&hello, move, sizeof(move))) {
+    pictrl_log_error("Rejected a payload right at the limit\n");
+    return 1;
+  }
+  if (allows(&hello, text, sizeof(text))) {
+    pictrl_log_error("Allowed a payload over the limit\n");
+    return 2;
+  }
+  return 0;
+}
+
+static int test_hello_batch_records_checked() {
+  // Arrange: batching was agreed on, high resolution moves weren't
+  const PiCtrlHello hello = {.version = PICTRL_PROTOCOL_VERSION,
+                             .caps = PICTRL_CAP_BATCH,
+                             .max_payload = UINT8_MAX};
+  uint8_t sneaky_batch[] = {PI_CTRL_BATCH, 10, PI_CTRL_MOUSE_MV, 2, 5,
+                            (uint8_t)-3, PI_CTRL_MOUSE_MV_HIRES, 4, 0, 8,
+                            0, 8};
+  const RawPiCtrlMessage msg =
+      parse_to_pictrl_msg(sneaky_batch, sizeof(sneaky_batch));
+
+  // Act
+  const uint8_t needs = pictrl_hello_caps_needed(&msg);
+
+  // Assert
+  if (needs != (PICTRL_CAP_BATCH | PICTRL_CAP_MOUSE_HIRES)) {
+    pictrl_log_error("Batch needs capabilities 0x%02x\n", needs);
+    return 1;
+  }
+  if (pictrl_hello_allows(&hello, &msg)) {
+    pictrl_log_error("Allowed a high resolution move inside a batch\n");
+    return 2;
+  }
+  return 0;
+}
+
+// A sequence and what it should decode to
+typedef struct {
+  const char *name;
+  uint8_t bytes[4];
+  size_t len;
+  uint32_t code_point;
+  size_t consumed;
+} Utf8Case;
+
+static int check_utf8_cases(const Utf8Case *cases, size_t num_cases) {
+  for (size_t i = 0; i < num_cases; i++) {
+    uint32_t code_point;
+    const size_t consumed =
+        pictrl_utf8_decode(cases[i].bytes, cases[i].len, &code_point);
+    if (code_point != cases[i].code_point || consumed != cases[i].consumed) {
+      pictrl_log_error("%s: expected U+%04X from %zu bytes, got U+%04X from "
+                       "%zu\n",
+                       cases[i].name, cases[i].code_point, cases[i].consumed,
+                       code_point, consumed);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int test_utf8_valid() {
+  const Utf8Case cases[] = {
+      {"ASCII", {'A'}, 1, 'A', 1},
+      {"Smallest 2 byte", {0xC2, 0x80}, 2, 0x80, 2},
+      {"Biggest 2 byte", {0xDF, 0xBF}, 2, 0x7FF, 2},
+      {"Smallest 3 byte", {0xE0, 0xA0, 0x80}, 3, 0x800, 3},
+      {"Euro sign", {0xE2, 0x82, 0xAC}, 3, 0x20AC, 3},
+      {"Right before the surrogates", {0xED, 0x9F, 0xBF}, 3, 0xD7FF, 3},
+      {"Right after the surrogates", {0xEE, 0x80, 0x80}, 3, 0xE000, 3},
+      {"Smallest 4 byte", {0xF0, 0x90, 0x80, 0x80}, 4, 0x10000, 4},
+      {"Biggest code point", {0xF4, 0x8F, 0xBF, 0xBF}, 4, 0x10FFFF, 4},
+      // Only the first code point gets decoded
+      {"Followed by more", {0xC3, 0xA9, 'x'}, 3, 0xE9, 2},
+  };
+  return check_utf8_cases(cases, PICTRL_SIZE(cases));
+}
+
+// Anything malformed is U+FFFD, and only eats its first byte
+static int test_utf8_malformed() {
+  const Utf8Case cases[] = {
+      {"Stray continuation byte", {0x80}, 1, PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Stray last continuation byte", {0xBF, 'A'}, 2,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Invalid lead byte", {0xF8, 0x88, 0x80, 0x80}, 4,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Overlong 2 byte (/)", {0xC0, 0xAF}, 2, PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Overlong 2 byte (DEL)", {0xC1, 0xBF}, 2, PICTRL_UTF8_REPLACEMENT_CHAR,
+       1},
+      {"Overlong 3 byte", {0xE0, 0x9F, 0xBF}, 3, PICTRL_UTF8_REPLACEMENT_CHAR,
+       1},
+      {"Overlong 4 byte", {0xF0, 0x8F, 0xBF, 0xBF}, 4,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"First surrogate", {0xED, 0xA0, 0x80}, 3, PICTRL_UTF8_REPLACEMENT_CHAR,
+       1},
+      {"Last surrogate", {0xED, 0xBF, 0xBF}, 3, PICTRL_UTF8_REPLACEMENT_CHAR,
+       1},
+      {"Above U+10FFFF", {0xF4, 0x90, 0x80, 0x80}, 4,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Way above U+10FFFF", {0xF7, 0xBF, 0xBF, 0xBF}, 4,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Truncated 2 byte", {0xC3}, 1, PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Truncated 3 byte", {0xE2, 0x82}, 2, PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Truncated 4 byte", {0xF0, 0x9F, 0x98}, 3, PICTRL_UTF8_REPLACEMENT_CHAR,
+       1},
+      {"Cut short by ASCII", {0xE2, 0x82, 'A'}, 3,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+      {"Cut short by a lead byte", {0xE2, 0xC3, 0xA9}, 3,
+       PICTRL_UTF8_REPLACEMENT_CHAR, 1},
+  };
+  if (check_utf8_cases(cases, PICTRL_SIZE(cases)) < 0) {
+    return 1;
+  }
+
+  // Nothing at all
+  uint32_t code_point;
+  if (pictrl_utf8_decode(NULL, 0, &code_point) != 0) {
+    pictrl_log_error("Decoded something out of nothing\n");
+    return 2;
+  }
+
+  // A bad byte doesn't take the good characters after it down with it
+  const uint8_t text[] = {0xE2, 0x82, 'h', 0xFF, 0xC3, 0xA9};
+  const uint32_t expected[] = {PICTRL_UTF8_REPLACEMENT_CHAR,
+                               PICTRL_UTF8_REPLACEMENT_CHAR, 'h',
+                               PICTRL_UTF8_REPLACEMENT_CHAR, 0xE9};
+  size_t offset = 0;
+  for (size_t i = 0; i < PICTRL_SIZE(expected); i++) {
+    offset += pictrl_utf8_decode(text + offset, sizeof(text) - offset,
+                                 &code_point);
+    if (code_point != expected[i]) {
+      pictrl_log_error("Code point %zu: expected U+%04X, got U+%04X\n", i,
+                       expected[i], code_point);
+      return 3;
+    }
+  }
+  if (offset != sizeof(text)) {
+    return 4;
+  }
+  return 0;
+}
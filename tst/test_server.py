@@ -4,6 +4,7 @@ import argparse
 import asyncio
 import binascii
 import errno
+import math
 import sys
 import time
 import websockets
@@ -65,6 +66,9 @@ class PiControlCmd(IntEnum):
                                          # This is 1 byte, where 00000021 the 2 == PiCtrlMouseBtn and the 1 == PiCtrlMouseClick
         PI_CTRL_KEY_PRESS   = auto() # Client: Send UTF-8 value of key to be pressed (details TBD)
         PI_CTRL_KEYSYM      = auto() # Client: Send keysym (combination)
+        PI_CTRL_MOUSE_SCROLL = auto() # Client: Send vertical, horizontal amounts to scroll (int16 each, 120 == 1 notch)
+        PI_CTRL_MOUSE_ABS   = auto() # Client: Send x,y of absolute position to move mouse to (uint16 each, 0-65535 == whole screen)
+        PI_CTRL_MOUSE_MV_HIRES = auto() # Client: Send x,y of relative position to move mouse to (int16 each, 12.4 fixed point pixels)
 
 class PiControlMouseBtn(IntEnum):
         PI_CTRL_MOUSE_LEFT  = 0
@@ -136,10 +140,14 @@ def parse_args():
     tests = {
         "one":  test_one_msg,
         "mul":  test_multiple_msgs,
+        "str":  test_whole_string,
         "cont": test_continuous_msgs,
         "ksym": test_keysym,
         "maus": test_mouse_move,
         "maus-man": test_mouse_move_manual,
+        "scrl": test_scroll,
+        "abs":  test_mouse_abs,
+        "maus-hires": test_mouse_move_hires,
         "rus":  test_russian,
     }
     parser.add_argument("--tests",
@@ -196,6 +204,12 @@ async def test_multiple_msgs(sock):
         await sock.send(msg.serialized)
         time.sleep(0.3)
         
+async def test_whole_string(sock):
+    # The whole string (UTF-8 and all) goes out in a single message
+    msg = PiControlMessage(PiControlCmd.PI_CTRL_KEY_PRESS, "Hello, world! Здравствуйте".encode("utf-8"))
+    print(msg)
+    await sock.send(msg.serialized)
+
 async def test_continuous_msgs(sock):
     while True:
         try:
@@ -264,6 +278,38 @@ async def test_mouse_move_manual(sock):
         except KeyboardInterrupt:
             break
 
+async def test_scroll(sock):
+    # Smooth scroll down 2 notches (like a touchpad would), then 1 notch right
+    for vertical, horizontal in [(-15, 0)] * 16 + [(0, 120)]:
+        payload = vertical.to_bytes(2, 'big', signed=True) + horizontal.to_bytes(2, 'big', signed=True)
+        msg = PiControlMessage(PiControlCmd.PI_CTRL_MOUSE_SCROLL, payload)
+        print(msg)
+        await sock.send(msg.serialized)
+
+        time.sleep(0.008)
+
+async def test_mouse_move_hires(sock):
+    # A slow drift right of 0.3 pixels at a time, then one big jump back
+    for rel_x in [0.3] * 100 + [-30.0]:
+        x = round(rel_x * 16)
+        msg = PiControlMessage(PiControlCmd.PI_CTRL_MOUSE_MV_HIRES, x.to_bytes(2, 'big', signed=True) + (0).to_bytes(2, 'big', signed=True))
+        print(msg)
+        await sock.send(msg.serialized)
+
+        time.sleep(0.004)
+
+async def test_mouse_abs(sock):
+    # Trace a circle around the middle of the screen
+    for i in range(360):
+        angle = math.radians(i)
+        x = int(32767 + 16000 * math.cos(angle))
+        y = int(32767 + 16000 * math.sin(angle))
+        msg = PiControlMessage(PiControlCmd.PI_CTRL_MOUSE_ABS, x.to_bytes(2, 'big') + y.to_bytes(2, 'big'))
+        print(msg)
+        await sock.send(msg.serialized)
+
+        time.sleep(0.004)
+
 async def test_keysym(sock):
     msg = PiControlMessage(PiControlCmd.PI_CTRL_KEYSYM, "Ctrl+a".encode("utf-8"))
     print(msg)